@@ -0,0 +1,45 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory which is allocated by moving a pointer forward, and deallocated all at once. The blocks of an
+// arena are kept when it is reset, so that an arena which is reset after each document stops allocating
+// once it has grown to fit the largest one.
+
+// Size of the blocks of an arena, unless an allocation needs a larger one
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+} ArenaBlock;
+
+typedef struct Arena {
+  ArenaBlock *first;
+  // The block allocations are made from, the ones after it are unused
+  ArenaBlock *current;
+  // Only for arenas made by `Arena_newDeduplicating`: the strings copied by `Arena_strdup`, as an open
+  // addressing set
+  bool deduplicate;
+  char **strings;
+  uint32_t *hashes;
+  size_t stringCount;
+  size_t stringCapacity;
+} Arena;
+
+Arena Arena_new();
+// An arena whose `Arena_strdup` returns the same copy for equal strings, which must then not be modified.
+Arena Arena_newDeduplicating();
+// Returns `size` bytes which are aligned for any type, and valid until the arena is reset.
+void *Arena_alloc(Arena *arena, size_t size);
+char *Arena_strdup(Arena *arena, const char *string);
+// Deallocates everything allocated from the arena, keeping its blocks.
+void Arena_reset(Arena *arena);
+void Arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "validate.h"
+
+// Processing many files at once, as done by `cson --batch`. Files are mapped into memory rather than
+// read, and handed out to a pool of threads one at a time. Each thread writes what it prints about a
+// file into a buffer of its own, which is then printed in the order of the files, so that the output
+// does not depend on the number of threads. Like compiled documents, this is not built for the Game Boy
+// Advance.
+
+typedef struct BatchOptions {
+  // Only validate the files, instead of parsing and printing them
+  bool validateOnly;
+  // Accept a comma after the last element of a list or object when validating, as parsing always does
+  bool allowTrailingCommas;
+  int threads;
+  FILE *out;
+} BatchOptions;
+
+typedef struct BatchSummary {
+  size_t files;
+  size_t failed;
+  size_t bytes;
+  double seconds;
+} BatchSummary;
+
+// Processes the files at `paths`, and every `.json` file found in the directories among them, in sorted
+// order. Prints a status line for each file, followed by its tree when parsing.
+BatchSummary runBatch(char **paths, int count, const BatchOptions *options);
+
+#endif
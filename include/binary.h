@@ -0,0 +1,64 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoders.h"
+#include "parser.h"
+
+// Compact binary encoding of a parsed document, which can be loaded again without parsing.
+//
+// The file is a header followed by a section holding every `JSONNode`, and a string table. The node
+// section starts with the root, followed by one block per non-empty container in breadth first order,
+// holding its items and then, for objects, their keys. Pointers are stored as offsets from the start
+// of the file, which the tree keeps once loaded, since it is read in place from a read-only mapping of
+// the file. They are resolved as they are read, see `JSONNode_resolve`. Keys are stored with an
+// `InternedKey` header, like the keys of a parsed tree.
+//
+// The layout is that of the in-memory structs, so a file can only be loaded on a platform with
+// the same struct layout and byte order as the one that wrote it. This is checked when loading.
+
+#define BINARY_MAGIC "CSONB"
+#define BINARY_VERSION 3
+#define BINARY_BYTE_ORDER_MARK 0x01020304u
+#define BINARY_ERROR_MAX_SIZE 256
+
+typedef struct BinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrderMark;
+  uint32_t pointerSize;
+  uint32_t nodeSize;
+  uint64_t nodesOffset;
+  uint64_t nodesSize;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+} BinaryHeader;
+
+typedef struct BinaryDocument {
+  void *base;
+  size_t size;
+  JSONNode *root;
+} BinaryDocument;
+
+// Writes `root` to the file at `path`. On failure, returns false and writes a message to `errorMsg`.
+bool Binary_write(JSONNode *root, const char *path, char errorMsg[BINARY_ERROR_MAX_SIZE]);
+
+// Maps the file at `path` into memory, read-only, without allocating or reading more than its header.
+// The tree is valid until the document is closed using `BinaryDocument_close`, and must not be
+// deallocated using `JSONNode_free`. Its offsets are only checked by `BinaryDocument_verify`. On failure,
+// returns false and writes a message to `errorMsg`.
+bool BinaryDocument_load(const char *path, BinaryDocument *dest, char errorMsg[BINARY_ERROR_MAX_SIZE]);
+// Checks every node of a loaded document, which is needed before reading a file which may be corrupt or
+// come from an untrusted source. Takes time linear in the size of the document. On failure, returns
+// false and writes a message to `errorMsg`.
+bool BinaryDocument_verify(const BinaryDocument *document, char errorMsg[BINARY_ERROR_MAX_SIZE]);
+// Same as `decodeTree`, for the tree of the document.
+DecodeResult BinaryDocument_decode(const BinaryDocument *document, void *dest, decodeFun decoder);
+// Same as `printTree`, for the tree of the document.
+void BinaryDocument_print(const BinaryDocument *document);
+void BinaryDocument_close(BinaryDocument *document);
+
+#endif
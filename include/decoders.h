@@ -2,61 +2,250 @@
 #define DECODERS_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "jsonmap.h"
 #include "parser.h"
 
 typedef struct JSONPath {
   enum { JSON_FIELD, JSON_INDEX } tag;
   union {
     struct JSON_FIELD { char *fieldName; } JSON_FIELD;
-    struct JSON_INDEX { int index;       } JSON_INDEX;
+    struct JSON_INDEX { size_t index;    } JSON_INDEX;
   } data;
 } JSONPath;
 
 typedef struct DecoderError {
   JSONPath *path;
-  int depth;
-  int pathCapacity;
+  size_t depth;
+  size_t pathCapacity;
   char *errorMsg;
 } DecoderError;
 
+// Why a decoder failed. Decoders only record this and the values which go into the message; the message
+// itself is formatted once the failure reaches `decode` or another entry point, so that failures which
+// `oneOf` recovers from cost no more than a few stores.
+typedef struct DecodeFailure {
+  enum {
+    // Nothing was recorded, as when a custom decoder returns false without calling another one which failed
+    FAILURE_NONE,
+    FAILURE_WRONG_TAG,
+    FAILURE_NOT_INTEGER,
+    FAILURE_MISSING_FIELD,
+    FAILURE_NO_DECODER,
+    FAILURE_INT_LENGTH,
+    FAILURE_LIST_CAPACITY,
+    FAILURE_STRING_CAPACITY,
+    FAILURE_UNKNOWN_TAG,
+  } code;
+  union {
+    struct FAILURE_NONE            {                                                   } FAILURE_NONE;
+    struct FAILURE_WRONG_TAG       { enum JSONNode_Tag expected; enum JSONNode_Tag got; } FAILURE_WRONG_TAG;
+    struct FAILURE_NOT_INTEGER     { double number;                                    } FAILURE_NOT_INTEGER;
+    // The strings belong to the decoder or to the tree, which outlive the failure until it is formatted
+    struct FAILURE_MISSING_FIELD   { const char *name;                                 } FAILURE_MISSING_FIELD;
+    struct FAILURE_NO_DECODER      { int count;                                        } FAILURE_NO_DECODER;
+    struct FAILURE_INT_LENGTH      { size_t length;                                    } FAILURE_INT_LENGTH;
+    struct FAILURE_LIST_CAPACITY   { size_t capacity; size_t length;                   } FAILURE_LIST_CAPACITY;
+    struct FAILURE_STRING_CAPACITY { size_t capacity; size_t length;                   } FAILURE_STRING_CAPACITY;
+    struct FAILURE_UNKNOWN_TAG     { const char *tag;                                  } FAILURE_UNKNOWN_TAG;
+  } data;
+} DecodeFailure;
+
+#define FIELD_NAME_CACHE_BITS 5
+#define FIELD_NAME_CACHE_SIZE (1 << FIELD_NAME_CACHE_BITS)
+
+// The interned copies of the field names looked up so far, by the address of the name, which for
+// decoders is nearly always a string literal. Each name is thus hashed once per document rather than
+// once per object. A NULL copy means that the name does not occur in the document.
+typedef struct FieldNameCache {
+  struct { const char *name; char *interned; } entries[FIELD_NAME_CACHE_SIZE];
+} FieldNameCache;
+
 // TODO This takes up a lot of space, could we make it more compact?
 typedef struct DecoderState {
   JSONNode *currentNode;
+  // Field names of the document. May be NULL for trees that were not produced by `parse`.
+  InternTable *keys;
+  // Only valid for `keys`, so it must be cleared along with any change to them
+  FieldNameCache names;
+  // Start of the compiled document the tree was loaded from, or NULL, see `JSONNode_resolve`
+  const void *base;
+  // Set when the tree was parsed in situ, in which case decoded strings point into the input as well.
+  bool inSitu;
+  // Where decoded values are allocated, or NULL to use malloc. See `decodeAlloc`.
+  Arena *arena;
   DecoderError error;
+  // Recorded by the last decoder which failed, and turned into `error.errorMsg` by the entry point
+  DecodeFailure failure;
+  // Greater than zero while `oneOf` tries alternatives, whose allocations are then listed here (unless
+  // they come from `arena`) so that those of an alternative which fails can be freed
+  int speculating;
+  void **allocations;
+  size_t allocationCount;
+  size_t allocationCapacity;
 } DecoderState;
 
 typedef bool(*decodeFun)(DecoderState*, void*);
+// Defined in tagtable.h, which builds on the types above
+struct TagTable;
+// Receives each decoded element of `decodeEach` and `decodeStream`. The element is only valid for the
+// duration of the call, but anything the decoder allocated for it is owned by the callback.
+typedef void(*eachFun)(void *elem, void *ctx);
+
+// What to do with a list or string which does not fit into the storage provided by the caller
+typedef enum OverflowPolicy {
+  OVERFLOW_FAIL,
+  // Keep as many elements, or as many whole UTF-8 characters, as fit
+  OVERFLOW_TRUNCATE,
+} OverflowPolicy;
 
 typedef struct FieldDef {
-  enum { NORMAL_FIELD, LIST_FIELD } type;
+  enum { NORMAL_FIELD, LIST_FIELD, OPTIONAL_FIELD, DEFAULT_FIELD, FIXED_LIST_FIELD, FIXED_STRING_FIELD } type;
   union {
     struct NORMAL_FIELD {
       void *dest;
       decodeFun decoder;
     } NORMAL_FIELD;
+    struct OPTIONAL_FIELD {
+      void *dest;
+      decodeFun decoder;
+      bool *present;
+    } OPTIONAL_FIELD;
+    struct DEFAULT_FIELD {
+      void *dest;
+      decodeFun decoder;
+      const void *defaultValue;
+      size_t size;
+    } DEFAULT_FIELD;
     struct LIST_FIELD {
       void *dest;
       int *lengthDest;
       size_t size;
       decodeFun decoder;
     } LIST_FIELD;
+    struct FIXED_LIST_FIELD {
+      void *dest;
+      int *lengthDest;
+      size_t capacity;
+      size_t size;
+      decodeFun decoder;
+      OverflowPolicy overflow;
+    } FIXED_LIST_FIELD;
+    struct FIXED_STRING_FIELD {
+      char *dest;
+      size_t capacity;
+      OverflowPolicy overflow;
+    } FIXED_STRING_FIELD;
   } data;
   char* name;
 } FieldDef;
 
+// A column of `decodeColumns`. `dest` points to the pointer which will hold the newly allocated
+// array of values of `size` bytes, such as an `int*` for `decodeInt`.
+typedef struct ColumnDef {
+  char *name;
+  void *dest;
+  size_t size;
+  decodeFun decoder;
+} ColumnDef;
+
 typedef struct DecodeResult {
   bool success;
   DecoderError error;
   int depth;
 } DecodeResult;
 
+// Memory which `decodeWithContext` keeps from one call to the next instead of allocating it every time:
+// a copy of the input, the token list, the stacks of the parser, the tree, the table of object keys and
+// the path of errors. A context may only be used by one thread at a time, so threads which decode
+// concurrently should each have their own.
+typedef struct DecodeContext {
+  // The input is copied here and lexed in situ, unless it is parsed in situ already
+  char *input;
+  size_t inputCapacity;
+  TokenList tokens;
+  ParserScratch parser;
+  // Path of the last successful decode, or NULL if the last one failed and its path went to the caller
+  JSONPath *path;
+  size_t pathCapacity;
+} DecodeContext;
+
+// Once this many distinct keys have been interned in a context, its table of keys is cleared
+#define DECODE_CONTEXT_MAX_KEYS 4096
+
 bool decodeInt(DecoderState *state, void *dest);
 bool decodeFloat(DecoderState *state, void *dest);
 bool decodeString(DecoderState *state, void *dest);
 FieldDef makeField(char *name, void *dest, decodeFun decoder);
 FieldDef makeListField(char *name, void *dest, int *lengthDest, size_t size, decodeFun decoder);
+// A field which may be missing, in which case `dest` is left untouched. `present` (may be NULL) is set to
+// whether the field was found. A field which is present must still decode successfully.
+FieldDef optionalField(char *name, void *dest, decodeFun decoder, bool *present);
+// A field which may be missing, in which case the `size` bytes at `defaultValue` are copied to `dest`.
+FieldDef defaultField(char *name, void *dest, decodeFun decoder, const void *defaultValue, size_t size);
+// Fields decoded into storage of the caller, such as the members `Point points[16]` and `char name[32]`, so
+// that nothing is allocated for them. See `decodeFixedList` and `decodeFixedString`.
+FieldDef makeFixedListField(char *name, void *dest, int *lengthDest, size_t capacity, size_t size, decodeFun decoder,
+                            OverflowPolicy overflow);
+FieldDef makeFixedStringField(char *name, char *dest, size_t capacity, OverflowPolicy overflow);
+// Same as the above for arrays, whose capacity is known from their type.
+#define fixedListField(name, array, lengthDest, decoder, overflow)\
+  makeFixedListField(name, array, lengthDest, sizeof(array) / sizeof((array)[0]), sizeof((array)[0]), decoder, overflow)
+#define fixedStringField(name, array, overflow) makeFixedStringField(name, array, sizeof(array), overflow)
 bool decodeFields(DecoderState *state, int count, ...);
+// Decodes the current node into the `size` bytes at `dest` with the first of `count` decoders which
+// succeeds. Each alternative which fails before the last is undone: `dest` is restored and whatever it
+// allocated with `decodeAlloc` or `decodeStrdup` is freed. If none succeeds, the failure is that of the
+// last decoder.
+bool oneOf(DecoderState *state, void *dest, size_t size, int count, ...);
+// Adds the names of `fields` to `projection`, so that a projected parse keeps them.
+void Projection_addFields(Projection *projection, int count, FieldDef *fields);
+// Fails for lists whose length does not fit in an `int`, as do the other decoders with an `int` length.
 bool decodeList(DecoderState *state, void *dest, int *length, size_t size, decodeFun decoder);
+// Same as `decodeList`, for lists of any length.
+bool decodeListSized(DecoderState *state, void *dest, size_t *length, size_t size, decodeFun decoder);
+// Decodes a list into the array of `capacity` elements of `size` bytes at `dest`, instead of allocating one.
+bool decodeFixedList(DecoderState *state, void *dest, int *length, size_t capacity, size_t size, decodeFun decoder,
+                     OverflowPolicy overflow);
+// Copies a string into the `capacity` bytes at `dest`, which include its terminating NUL.
+bool decodeFixedString(DecoderState *state, char *dest, size_t capacity, OverflowPolicy overflow);
+// Decodes the elements of a list one at a time into a single reusable element of `size` bytes, which
+// is passed to `callback`, instead of allocating an array for all of them.
+bool decodeEach(DecoderState *state, size_t size, decodeFun decoder, eachFun callback, void *ctx);
+// Decodes an object which is one of several variants, told apart by the string in its field `tagField`.
+// The decoder of the matching case of `table` decodes the whole object into `dest`, and `tagDest` is set
+// to the index of that case. `table` is a `TagTable*` from tagtable.h.
+bool decodeTagged(DecoderState *state, char *tagField, const struct TagTable *table, int *tagDest, void *dest);
+// Decodes every member of an object into the `JSONMap` pointed to by `dest`, with values of `size` bytes
+// decoded by `decoder`. If a key occurs more than once, only its last value is decoded, which is why the
+// members are decoded from the last to the first. On failure, the map is still owned by the caller, and the
+// path of the error refers to its keys.
+bool decodeMap(DecoderState *state, void *dest, size_t size, decodeFun decoder);
+ColumnDef makeColumn(char *name, void *dest, size_t size, decodeFun decoder);
+// Decodes a list of objects column-wise: the field `name` of every object is decoded into one array per
+// `ColumnDef`, so that the values of a field are contiguous, and `length` is set to the number of objects.
+bool decodeColumns(DecoderState *state, int *length, int count, ...);
+// Specialized versions of `decodeList` for lists of numbers. `dest` points to the `int*`, `int64_t*`,
+// `double*` or `float*` which will hold the newly allocated array.
+bool decodeIntArray(DecoderState *state, void *dest, int *length);
+bool decodeInt64Array(DecoderState *state, void *dest, int *length);
+bool decodeDoubleArray(DecoderState *state, void *dest, int *length);
+bool decodeFloatArray(DecoderState *state, void *dest, int *length);
+// Building blocks for decoders which look up fields themselves, like the ones generated by schema.h
+bool expectTag(DecoderState *state, enum JSONNode_Tag tag);
+// Decodes `node`, a member of the current object, as described by `field`.
+bool decodeFieldNode(DecoderState *state, JSONNode *node, FieldDef field);
+// Make `node`, a member `name` of the current object, the current node and add it to the path of errors,
+// and make `object` the current node again once the member is decoded.
+void enterField(DecoderState *state, JSONNode *node, char *name);
+void leaveField(DecoderState *state, JSONNode *object);
+bool failMissingField(DecoderState *state, char *name);
+// Allocate memory of the decoded value, from the output arena of the `ParseOptions` if there is one.
+// Custom decoders should use these, so that their values can be released along with the arena, and by
+// `oneOf` when they belong to an alternative which fails.
+void *decodeAlloc(DecoderState *state, size_t size);
+char *decodeStrdup(DecoderState *state, const char *string);
+
 void printDecoderError(DecoderError err);
 char *buildDecoderError(DecoderError err);
 void DecodeError_free(DecoderError err);
@@ -65,5 +254,48 @@ void DecodeError_free(DecoderError err);
 // field. On failure, ownership of the `DecodeError` is transferred to the caller who must
 // deallocate it using `DecodeError_free`.
 DecodeResult decode(char *input, void *dest, decodeFun decoder);
+// Same as `decode`, but parses with the given `ParseOptions` (may be NULL). When using a projection,
+// it must contain every field name the decoder asks for. When parsing in situ, `input` is modified and
+// decoded strings point into it, so it must outlive the decoded value.
+DecodeResult decodeWithOptions(char *input, void *dest, decodeFun decoder, const ParseOptions *options);
+// Same as `decodeWithOptions`, reusing the memory of `context` from earlier calls.
+DecodeResult decodeWithContext(DecodeContext *context, char *input, void *dest, decodeFun decoder,
+                               const ParseOptions *options);
+DecodeContext DecodeContext_new();
+void DecodeContext_free(DecodeContext *context);
+// Decodes a document consisting of a list like `decodeEach`, but without parsing the whole document
+// first: each element is lexed, parsed and decoded on its own, so memory use is bounded by the size of
+// a single element rather than that of the document.
+DecodeResult decodeStream(char *input, size_t size, decodeFun decoder, eachFun callback, void *ctx);
+// Same as `decodeStream`, but with optional `ParseOptions` (NULL for the defaults). The limits apply to the
+// whole document, with the depth and number of values counted across all elements.
+DecodeResult decodeStreamWithOptions(char *input, size_t size, decodeFun decoder, eachFun callback, void *ctx,
+                                     const ParseOptions *options);
+
+// Decoding which is done a bounded amount of work at a time, for programs like event loops which cannot
+// block on a large document. The input is lexed, parsed and decoded in steps, each of which handles about
+// as many tokens as it is given. Decoders are plain functions, which cannot be suspended half way through
+// a value, so only documents consisting of a list can be decoded in steps, one element at a time.
+typedef struct DecodeTask DecodeTask;
+
+typedef enum DecodeStatus {
+  DECODE_IN_PROGRESS,
+  DECODE_DONE,
+} DecodeStatus;
+
+// Starts decoding a document consisting of a list like `decodeStreamWithOptions`, each step decoding as
+// many elements as fit in its budget. `input` must outlive the task.
+DecodeTask *DecodeTask_newEach(char *input, size_t size, decodeFun decoder, eachFun callback, void *ctx,
+                               const ParseOptions *options);
+// Does about `budget` tokens worth of work, and returns whether the task is done, successfully or not.
+DecodeStatus decodeStep(DecodeTask *task, size_t budget);
+// Deallocates the task and returns its result, like that of `decode`. Fails if the task is not done yet.
+DecodeResult DecodeTask_finish(DecodeTask *task);
+// Decodes an already parsed tree, such as that of `parse`. Does not take ownership of
+// `tree`. `keys` is the table the field names of the tree are interned in, or NULL if there is none.
+DecodeResult decodeTree(JSONNode *tree, InternTable *keys, void *dest, decodeFun decoder);
+// Same as `decodeTree`, for a tree holding offsets from `base` rather than pointers, like that of a
+// compiled document. See `BinaryDocument_decode`.
+DecodeResult decodeTreeAt(JSONNode *tree, const void *base, void *dest, decodeFun decoder);
 
 #endif
@@ -0,0 +1,20 @@
+#ifndef ENCODERS_H
+#define ENCODERS_H
+
+#include <stddef.h>
+
+#include "stringbuilder.h"
+
+// Encoders append the JSON representation of the value at `src` to `builder`. They mirror the
+// decoders, so `encodeFloat` takes a `double*` and `encodeString` a `char**`.
+typedef void(*encodeFun)(StringBuilder*, const void*);
+
+void encodeInt(StringBuilder *builder, const void *src);
+void encodeFloat(StringBuilder *builder, const void *src);
+void encodeString(StringBuilder *builder, const void *src);
+void encodeList(StringBuilder *builder, const void *list, size_t length, size_t size, encodeFun encoder);
+
+// Returns the JSON representation of `src`. Ownership of the string is transferred to the caller.
+char *encode(const void *src, encodeFun encoder);
+
+#endif
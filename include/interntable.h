@@ -0,0 +1,42 @@
+#ifndef INTERNTABLE_H
+#define INTERNTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INTERNTABLE_START_CAPACITY 16
+
+// Header stored in front of every interned string. Strings handed out by the table point at
+// `string`, so they can be used as regular `char*`s.
+typedef struct InternedKey {
+  uint32_t hash;
+  uint32_t length;
+  char string[];
+} InternedKey;
+
+// Open addressing hash set of strings. Each distinct string is stored once, so two interned strings
+// from the same table are equal if and only if their pointers are equal.
+typedef struct InternTable {
+  InternedKey **slots;
+  size_t length;
+  size_t capacity;
+} InternTable;
+
+InternTable *InternTable_new();
+// Does not take ownership of `string`. The returned string is owned by the table.
+char *InternTable_intern(InternTable *table, const char *string);
+// Returns the interned copy of `string`, or NULL if it has never been interned in this table.
+char *InternTable_find(const InternTable *table, const char *string);
+// Removes every string, keeping the allocated slots.
+void InternTable_clear(InternTable *table);
+void InternTable_free(InternTable *table);
+
+uint32_t InternTable_hash(const char *string, size_t length);
+
+// Only valid for strings returned by `InternTable_intern`.
+static inline InternedKey *InternedKey_of(char *interned) {
+  return (InternedKey*)(interned - offsetof(InternedKey, string));
+}
+
+#endif
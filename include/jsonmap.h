@@ -0,0 +1,46 @@
+#ifndef JSONMAP_H
+#define JSONMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// Open addressing hash map from strings to values of `valueSize` bytes, as produced by `decodeMap`.
+// Values are stored inline, next to each other, and all keys share a single allocation. A slot is in
+// use if its key is not NULL, so the entries can be iterated over as follows:
+//
+//   for (size_t i = 0; i < map.capacity; i++) {
+//     if (map.keys[i] != NULL) { ... map.keys[i] ... JSONMap_valueAt(&map, i) ... }
+//   }
+typedef struct JSONMap {
+  char **keys;
+  uint32_t *hashes;
+  char *values;
+  size_t valueSize;
+  size_t length;
+  size_t capacity;
+  // Storage for the keys
+  char *keyData;
+  size_t keyDataLength;
+} JSONMap;
+
+// Creates a map with room for `count` entries whose keys, including their NUL terminators, take up
+// `keyBytes` bytes in total. The map does not grow, so it must not be given more than that.
+JSONMap JSONMap_new(size_t count, size_t keyBytes, size_t valueSize);
+// Same as `JSONMap_new`, but allocated from `arena` unless it is NULL, in which case the map is deallocated
+// along with the arena rather than by `JSONMap_free`.
+JSONMap JSONMap_newIn(Arena *arena, size_t count, size_t keyBytes, size_t valueSize);
+// Returns the slot of `key`, inserting it with a zeroed value first if it is not in the map yet. `hash`
+// must be `InternTable_hash(key, length)`. The key is copied.
+size_t JSONMap_insert(JSONMap *map, const char *key, size_t length, uint32_t hash);
+// Returns the value for `key`, or NULL if there is none.
+void *JSONMap_get(const JSONMap *map, const char *key);
+// Frees the map, but not anything its values point to.
+void JSONMap_free(JSONMap *map);
+
+static inline void *JSONMap_valueAt(const JSONMap *map, size_t slot) {
+  return map->values + slot * map->valueSize;
+}
+
+#endif
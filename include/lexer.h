@@ -2,10 +2,14 @@
 #define LEXER_H
 
 #include "stdbool.h"
+#include <stddef.h>
 
 #define TOKEN_START_CAPACITY 10
-
-#define DIE(msg...) do { fprintf(stderr, msg); exit(1); } while(0);
+// Initial guess of the number of input bytes per token, used to size the token list up front.
+#define TOKEN_BYTES_ESTIMATE 8
+// Upper bound of that initial size, beyond which the list grows as needed instead, so that huge inputs
+// do not reserve more memory than the machine may have for tokens which might never exist.
+#define TOKEN_ESTIMATE_MAX_CAPACITY ((size_t)1 << 22)
 
 typedef enum {
   TOKEN_STRING_LITERAL,
@@ -26,24 +30,59 @@ typedef struct Token {
     struct TOKEN_STRING_LITERAL { char *string;  } TOKEN_STRING_LITERAL;
     struct TOKEN_NUMBER_LITERAL { double number; } TOKEN_NUMBER_LITERAL;
     struct TOKEN_BOOL_LITERAL   { bool boolean;  } TOKEN_BOOL_LITERAL;
+    // Number of elements/members of the container, filled in by the parser before building nodes.
+    struct TOKEN_OPEN_CURLY     { size_t length; } TOKEN_OPEN_CURLY;
+    struct TOKEN_OPEN_SQUARE    { size_t length; } TOKEN_OPEN_SQUARE;
   } data;
-  int row;
-  int col;
+  size_t row;
+  size_t col;
 } Token;
 
 typedef struct TokenList {
   struct Token *tokens;
-  int length;
-  int capacity;
+  size_t length;
+  size_t capacity;
+  // Set when the strings point into the input rather than being owned by the list
+  bool borrowsStrings;
 } TokenList;
 
 #define MAX_ERR_SIZE 256
 
+struct Projection;
+
+// Bounds on the work done for a single document, so that hostile input is rejected as soon as it exceeds
+// one of them rather than after it has been lexed and parsed in full. Each is 0 for no limit.
+typedef struct ParseLimits {
+  size_t maxInputBytes;
+  // Nesting depth of lists and objects
+  size_t maxDepth;
+  // Bytes of a string once unescaped, keys included
+  size_t maxStringLength;
+  // Items of a list or members of an object
+  size_t maxContainerLength;
+  // Values in the whole document, containers included. Each takes a 16-byte node in the tree, plus a key
+  // for the members of objects.
+  size_t maxNodes;
+} ParseLimits;
+
 typedef struct {
   char *input;
   struct TokenList *tokenList;
-  int row;
-  int col;
+  bool inSitu;
+  // Checked for every token when not NULL, all but `maxInputBytes`
+  const ParseLimits *limits;
+  // Containers which are open and values seen so far, counted only to check the limits
+  size_t depth;
+  size_t nodes;
+  // The elements of each open container, only kept when `limits->maxContainerLength` is set. Freed by
+  // `LexerState_free`.
+  struct OpenContainer *containers;
+  size_t containersCapacity;
+  // When not NULL, the values of members whose key is not in the projection are skipped over without
+  // lexing them. Their key token is left without a string, and a null token stands in for the value.
+  const struct Projection *projection;
+  size_t row;
+  size_t col;
   char errorMsg[MAX_ERR_SIZE];
 } LexerState;
 
@@ -58,9 +97,37 @@ typedef struct {
   } result;
 } LexResult;
 
+// Strings are NUL-terminated, so a string literal containing \u0000 fails to lex rather than being cut short.
 // Does not take ownership of the input, caller must deallocate. On failure, deallocates its partial `TokenList`.
 // On success, ownership of the `TokenList` transfers to the caller, who must deallocate it using `TokenList_free`
 LexResult lex(char *input);
+// Same as `lex`, but destructive: string literals are unescaped and NUL-terminated within `input`,
+// and the string tokens point there. `input` must outlive the tokens and anything made from them.
+LexResult lexInSitu(char *input);
+// Same as `lex` or `lexInSitu`, failing as soon as the input exceeds one of the `limits` (NULL for none).
+LexResult lexWithLimits(char *input, bool inSitu, const ParseLimits *limits);
+// Same as `lexWithLimits`, but appends the tokens to `list`, which must be empty, so that its memory
+// can be reused from one input to the next, and skips the members left out by `projection` (NULL for
+// none). On failure, returns false with the error in `errorMsg`, and the list is left empty. The list
+// always remains owned by the caller.
+bool lexInto(char *input, bool inSitu, const ParseLimits *limits, const struct Projection *projection, TokenList *list,
+             char *errorMsg);
+// Finds the length of the input, reading no further than `limits->maxInputBytes` past its start. Returns
+// false with the error in `errorMsg` if it is longer than that.
+bool measureInput(const char *input, const ParseLimits *limits, size_t *length, char *errorMsg);
+
+// For lexing incrementally, one token at a time. `lexToken` appends the next token to the token list,
+// or does nothing at the end of the input, and returns false with `errorMsg` set on failure.
+LexerState LexerState_new(char *input, TokenList *tokenList, bool inSitu);
+void LexerState_free(LexerState *state);
+bool lexToken(LexerState *state);
+// Skips whitespace and returns whether the end of the input has been reached.
+bool lexerAtEnd(LexerState *state);
+// Lexes the tokens which start before `stop` using a `StructuralIndex` (see structural.h), which is how
+// large inputs are lexed. `state->input` must be outside of any string or token. Tokens which do not fit
+// into the capacity of the token list go to `overflow` instead, unless it is NULL, so that the token
+// list can be part of a larger array, as when lexing chunks of the input in parallel.
+bool lexIndexedRange(LexerState *state, char *stop, TokenList *overflow);
 
 void printToken(Token *token);
 void printTokenType(TokenType type);
@@ -68,8 +135,12 @@ void printTokenType(TokenType type);
 char *tokenTypeToString(TokenType type);
 #define printTokenLn(token) do { printToken(token); printf("\n"); } while(0);
 
+TokenList TokenList_new(size_t capacity, bool borrowsStrings);
 void TokenList_free(TokenList *list);
+// Makes room for at least `capacity` tokens in total.
+void TokenList_reserve(TokenList *list, size_t capacity);
 struct Token *TokenList_insertNew(TokenList *list);
-void TokenList_free(TokenList *list);
+// Removes all tokens, keeping the allocated capacity.
+void TokenList_clear(TokenList *list);
 
 #endif
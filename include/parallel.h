@@ -0,0 +1,27 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+
+#include "lexer.h"
+#include "parser.h"
+
+// Lexing a single large document on several threads. The input is split into chunks at whitespace or
+// operators, and every chunk is summarized by a `StructuralIndex` on its own thread. Whether each chunk
+// starts inside of a string then follows from the number of quotes in the chunks before it, which also
+// gives the number of tokens of each chunk, so that every thread lexes its chunk straight into its part
+// of a single token list. Building the tree from the tokens is still done on one thread.
+//
+// The result, including any error, is the same as that of lexing on a single thread. Inputs with chunks
+// smaller than `PARALLEL_MIN_CHUNK_SIZE` are lexed on fewer threads, and small ones on just one.
+
+#define PARALLEL_MIN_CHUNK_SIZE (1 << 20)
+
+// Same as `lexWithLimits`, using up to `threads` threads. The limits other than `maxInputBytes` and
+// `maxStringLength` depend on the chunks before, so they are only checked by the parser, which may report
+// them at another position.
+LexResult lexParallel(char *input, bool inSitu, const ParseLimits *limits, int threads);
+// Same as `parseWithOptions`, lexing using up to `threads` threads.
+ParserResult parseParallel(char *input, const ParseOptions *options, int threads);
+
+#endif
@@ -2,12 +2,18 @@
 #define PARSER_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
+#include "arena.h"
 #include "lexer.h"
+#include "interntable.h"
 
-struct NodeList;
 typedef struct JSONNode JSONNode;
 
+// 16 bytes: the tag shares a word with the length of containers. The items of a list or object are
+// stored in a single allocation, and those of an object are followed by an array with the key of each
+// member, see `JSONNode_keys`. Scalars have no key, which is why it is not stored in the node itself.
 struct JSONNode {
   enum JSONNode_Tag {
     JSON_NUMBER,
@@ -16,25 +22,90 @@ struct JSONNode {
     JSON_NULL,
     JSON_OBJECT,
     JSON_LIST,
-  } tag;
+  } tag : 3;
+  // Number of items of a list or members of an object, 0 for scalars
+  uint64_t length : 61;
   union {
-    struct JSON_NUMBER { double number;          } JSON_NUMBER;
-    struct JSON_STRING { char *string;           } JSON_STRING;
-    struct JSON_BOOL   { bool boolean;           } JSON_BOOL;
-    struct JSON_NULL   {                         } JSON_NULL;
-    struct JSON_OBJECT { struct NodeList *nodes; } JSON_OBJECT;
-    struct JSON_LIST   { struct NodeList *nodes; } JSON_LIST;
+    struct JSON_NUMBER { double number;    } JSON_NUMBER;
+    struct JSON_STRING { char *string;     } JSON_STRING;
+    struct JSON_BOOL   { bool boolean;     } JSON_BOOL;
+    struct JSON_NULL   {                   } JSON_NULL;
+    // `items` is NULL when `length` is 0
+    struct JSON_OBJECT { JSONNode *items;  } JSON_OBJECT;
+    struct JSON_LIST   { JSONNode *items;  } JSON_LIST;
   } data;
-  char *fieldName;
 };
 
+_Static_assert(sizeof(JSONNode) == 16, "JSONNode should be 16 bytes");
+
+// The keys of the members of an object, interned in the table of the document, in the same order as
+// the members themselves.
+static inline char **JSONNode_keys(const JSONNode *object) {
+  return (char**)(object->data.JSON_OBJECT.items + object->length);
+}
+
+// Compiled documents (see binary.h) are read from a read-only mapping of the file, so their nodes hold
+// offsets from the start of the file instead of pointers. The accessors below add them to `base`, which
+// is NULL for any other tree, whose pointers are then returned as they are.
+static inline void *JSONNode_resolve(const void *base, const void *stored) {
+  return (void*)((uintptr_t)base + (uintptr_t)stored);
+}
+
+static inline JSONNode *JSONNode_items(const JSONNode *node, const void *base) {
+  return JSONNode_resolve(base, node->data.JSON_LIST.items);
+}
+
+static inline char *JSONNode_string(const JSONNode *node, const void *base) {
+  return JSONNode_resolve(base, node->data.JSON_STRING.string);
+}
+
+static inline char *JSONNode_key(const JSONNode *object, size_t index, const void *base) {
+  char **keys = (char**)(JSONNode_items(object, base) + object->length);
+  return JSONNode_resolve(base, keys[index]);
+}
+
 #define PARSER_ERROR_MAX_SIZE 256
 
+// The set of object keys a consumer is interested in, at any depth. Object members whose key is
+// not in the projection are skipped without creating any nodes for them, and where possible without
+// lexing their values either.
+typedef struct Projection {
+  char **names;
+  size_t length;
+  size_t capacity;
+} Projection;
+
+typedef struct ParseOptions {
+  const Projection *projection;
+  // Checked while lexing, as far as possible, and while parsing. A member skipped by the projection while
+  // lexing counts as a single value, and only its key and its size in bytes are checked.
+  ParseLimits limits;
+  // Parse destructively: strings are unescaped and NUL-terminated within the input, and string nodes
+  // (and strings decoded from them) point there instead of being copied. The input must outlive the
+  // tree, which must be deallocated using `JSONNode_freeInSitu`.
+  bool inSitu;
+  // Only used when decoding: where the decoders allocate the decoded value, or NULL to use malloc.
+  Arena *outputArena;
+} ParseOptions;
+
+#define PARSER_STACK_START_CAPACITY 16
+
 typedef struct {
   Token *current_token;
   Token *tokens_end;
   JSONNode *current_node;
-  int depth;
+  const Projection *projection;
+  InternTable *keys;
+  // Where the items and strings of the tree are allocated, or NULL to use malloc
+  Arena *arena;
+  bool inSitu;
+  // The lists and objects which are currently being parsed, innermost last.
+  struct ParserFrame *stack;
+  size_t stackCapacity;
+  size_t depth;
+  ParseLimits limits;
+  // Nodes of the tree, counted when their container is opened
+  size_t nodes;
   char errorMsg[PARSER_ERROR_MAX_SIZE];
 } ParserState;
 
@@ -46,6 +117,7 @@ typedef struct {
   union {
     struct PARSER_SUCCESS {
       JSONNode *tree;
+      InternTable *keys;
     } PARSER_SUCCESS;
     struct PARSER_FAIL {
       char errorMsg[PARSER_ERROR_MAX_SIZE];
@@ -53,12 +125,86 @@ typedef struct {
   } result;
 } ParserResult;
 
+// Counts the items of every list and object, which the parser needs before it can build them, while
+// the tokens are still being lexed. See `countContainerLengths` in parser.c.
+typedef struct ContainerCounter {
+  // Indices of the opening tokens of the containers which have not been closed yet
+  size_t *open;
+  size_t depth;
+  size_t capacity;
+  // Number of tokens counted so far
+  size_t scanned;
+} ContainerCounter;
+
+// Memory of the parser which can be reused from one document to the next, see `DecodeContext`.
+typedef struct ParserScratch {
+  ContainerCounter counter;
+  struct ParserFrame *stack;
+  size_t stackCapacity;
+  // Kept from one document to the next, so that keys which occur in each of them are interned only once
+  InternTable *keys;
+  // Holds the tree of the last document
+  Arena arena;
+} ParserScratch;
+
+// Parsing which can be suspended after any number of tokens, and later resumed.
+typedef struct ParserTask {
+  ParserState state;
+  JSONNode *root;
+  bool needValue;
+  bool done;
+  bool success;
+  // Where the memory of the parser comes from and goes back to, if not NULL
+  ParserScratch *scratch;
+} ParserTask;
+
 // Does not take ownership of the input, caller must deallocate. On failure, will deallocate its partial `JSONNode`.
 // On success, ownership of the returned `JSONNode` is transferred to the caller who must deallocate it using `JSONNode_free`.
+// Every key in the tree is interned in `keys`, which must outlive the tree and be deallocated using `InternTable_free`.
 ParserResult parse(char *input);
+// Same as `parse`, but with optional `ParseOptions` (NULL for the defaults). Note that skipped
+// members are only checked for balanced brackets, not for being well-formed JSON.
+ParserResult parseWithOptions(char *input, const ParseOptions *options);
+// Builds a tree from already lexed tokens, which must form exactly one value. Does not take ownership
+// of the tokens. Strings are copied out of them unless `options->inSitu` is set.
+ParserResult parseTokens(Token *tokens, size_t length, const ParseOptions *options);
+
+// Same as `parseTokens`, but using the memory of `scratch`. The tree, including its strings, and its keys
+// are owned by `scratch` and only valid until it is used again, so they must not be deallocated.
+ParserResult parseTokensWith(Token *tokens, size_t length, const ParseOptions *options, ParserScratch *scratch);
+
+ContainerCounter ContainerCounter_new();
+// Counts the tokens from `counter->scanned` up to `length`. The tokens before those must be the same as
+// in the previous call, but may have moved.
+void ContainerCounter_scan(ContainerCounter *counter, Token *tokens, size_t length);
+void ContainerCounter_free(ContainerCounter *counter);
+
+// Starts parsing tokens which have all been counted by a `ContainerCounter`, and which must not move
+// until the task is finished. Does not take ownership of the tokens.
+ParserTask ParserTask_new(Token *tokens, size_t length, const ParseOptions *options);
+// Parses about `budget` more tokens, and returns whether parsing is done, successfully or not.
+bool ParserTask_step(ParserTask *task, size_t budget);
+// Returns the result of the task like `parseTokens`, or an error if it is not done yet.
+ParserResult ParserTask_finish(ParserTask *task);
+
+ParserScratch ParserScratch_new();
+void ParserScratch_free(ParserScratch *scratch);
 void printTree(JSONNode *root);
+// Same as `printTree`, printing to `out` instead of stdout.
+void fprintTree(FILE *out, JSONNode *root);
+// Same as `fprintTree`, for a tree holding offsets from `base`, see `JSONNode_resolve`.
+void fprintTreeAt(FILE *out, JSONNode *root, const void *base);
 void JSONNode_free(JSONNode *node);
-void _JSONNode_free(JSONNode *node, bool inList);
+// Deallocates a tree parsed with `inSitu`, whose strings are not owned by the tree.
+void JSONNode_freeInSitu(JSONNode *node);
 char *nodeTagToString(enum JSONNode_Tag tag);
 
+Projection Projection_new();
+// Does not take ownership of `name`, which must outlive the projection.
+void Projection_add(Projection *projection, char *name);
+bool Projection_contains(const Projection *projection, char *name);
+// Same as `Projection_contains`, for a name which is not NUL-terminated
+bool Projection_containsLength(const Projection *projection, const char *name, size_t length);
+void Projection_free(Projection *projection);
+
 #endif
@@ -0,0 +1,118 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "decoders.h"
+#include "encoders.h"
+#include "interntable.h"
+
+// X-macros generating a struct, a decoder and an encoder from a single description of its fields.
+// A description is a macro taking the name of another macro, which it applies to each field as
+// `FIELD(kind, name, type)`:
+//
+//   #define PERSON_FIELDS(FIELD) FIELD(STRING, firstName, _) FIELD(STRING, lastName, _) FIELD(INT, age, _)
+//
+//   CSON_STRUCT(Person, PERSON_FIELDS)
+//   CSON_DECODER(Person, PERSON_FIELDS)   // bool decodePerson(DecoderState*, void*)
+//   CSON_ENCODER(Person, PERSON_FIELDS)   // void encodePerson(StringBuilder*, const void*)
+//
+// The kinds are INT (`int`), FLOAT (`double`), STRING (`char*`), OBJECT (a struct `type` with its own
+// generated decoder and encoder) and LIST (a `type*` named `name` plus an `int` named `nameCount`).
+// FIXED_STRING (`char name[type]`) and FIXED_LIST, whose type is a pair `(Type, N)` giving `Type name[N]`
+// plus an `int` named `nameCount`, are stored inline and fail to decode when the value does not fit.
+//
+// Unlike `decodeFields`, which looks up each field in turn, the generated decoder walks the members
+// of the object once and matches each key against the field names with their lengths known at
+// compile time, then calls the decoder of the field directly rather than through a `FieldDef`, so
+// there are no calls through function pointers for scalar fields. It relies on
+// every field name in the tree being interned, as is the case for trees produced by `parse` or
+// loaded by `BinaryDocument_load`. A struct may have at most 64 fields.
+
+#define CSON_STRUCT(Type, FIELDS)\
+  typedef struct Type {\
+    FIELDS(CSON_MEMBER_)\
+  } Type;
+
+#define CSON_MEMBER_(kind, name, type) CSON_MEMBER_##kind(name, type)
+#define CSON_MEMBER_INT(name, type) int name;
+#define CSON_MEMBER_FLOAT(name, type) double name;
+#define CSON_MEMBER_STRING(name, type) char *name;
+#define CSON_MEMBER_OBJECT(name, type) type name;
+#define CSON_MEMBER_LIST(name, type) type *name; int name##Count;
+#define CSON_MEMBER_FIXED_STRING(name, type) char name[type];
+#define CSON_MEMBER_FIXED_LIST(name, type) CSON_PAIR_TYPE_ type name[CSON_PAIR_LENGTH_ type]; int name##Count;
+
+#define CSON_PAIR_TYPE_(Type, N) Type
+#define CSON_PAIR_LENGTH_(Type, N) N
+#define CSON_PAIR_DECODER_(Type, N) decode##Type
+#define CSON_PAIR_ENCODER_(Type, N) encode##Type
+
+#define CSON_DECODER(Type, FIELDS)\
+  bool decode##Type(DecoderState *state, void *dest) {\
+    Type *value = (Type*)dest;\
+    enum { FIELDS(CSON_INDEX_) CSON_FIELD_COUNT_ };\
+    _Static_assert(CSON_FIELD_COUNT_ <= 64, "Too many fields in " #Type);\
+    if (!expectTag(state, JSON_OBJECT)) return false;\
+    uint64_t found = 0;\
+    JSONNode *object = state->currentNode;\
+    JSONNode *members = JSONNode_items(object, state->base);\
+    for (size_t i = 0; i < object->length; i++) {\
+      JSONNode *member = &members[i];\
+      char *key = JSONNode_key(object, i, state->base);\
+      uint32_t length = InternedKey_of(key)->length;\
+      FIELDS(CSON_MATCH_)\
+    }\
+    FIELDS(CSON_CHECK_FOUND_)\
+    return true;\
+  }
+
+#define CSON_INDEX_(kind, name, type) CSON_INDEX_##name,
+
+#define CSON_MATCH_(kind, name, type)\
+  if (length == sizeof(#name) - 1 && memcmp(key, #name, sizeof(#name) - 1) == 0) {\
+    enterField(state, member, #name);\
+    if (!CSON_DECODE_##kind(name, type)) return false;\
+    leaveField(state, object);\
+    found |= (uint64_t)1 << CSON_INDEX_##name;\
+    continue;\
+  }
+
+#define CSON_DECODE_INT(name, type) decodeInt(state, &value->name)
+#define CSON_DECODE_FLOAT(name, type) decodeFloat(state, &value->name)
+#define CSON_DECODE_STRING(name, type) decodeString(state, &value->name)
+#define CSON_DECODE_OBJECT(name, type) decode##type(state, &value->name)
+#define CSON_DECODE_LIST(name, type) decodeList(state, &value->name, &value->name##Count, sizeof(type), decode##type)
+#define CSON_DECODE_FIXED_STRING(name, type) decodeFixedString(state, value->name, sizeof(value->name), OVERFLOW_FAIL)
+#define CSON_DECODE_FIXED_LIST(name, type)\
+  decodeFixedList(state, value->name, &value->name##Count, CSON_PAIR_LENGTH_ type, sizeof(value->name[0]),\
+                  CSON_PAIR_DECODER_ type, OVERFLOW_FAIL)
+
+#define CSON_CHECK_FOUND_(kind, name, type)\
+  if (!(found & ((uint64_t)1 << CSON_INDEX_##name))) return failMissingField(state, #name);
+
+#define CSON_ENCODER(Type, FIELDS)\
+  void encode##Type(StringBuilder *builder, const void *src) {\
+    const Type *value = (const Type*)src;\
+    const char *separator = "";\
+    StringBuilder_append(builder, "{");\
+    FIELDS(CSON_ENCODE_)\
+    StringBuilder_append(builder, "}");\
+  }
+
+#define CSON_ENCODE_(kind, name, type)\
+  StringBuilder_append(builder, "%s\"" #name "\":", separator);\
+  separator = ",";\
+  CSON_ENCODE_##kind(name, type);
+
+#define CSON_ENCODE_INT(name, type) encodeInt(builder, &value->name)
+#define CSON_ENCODE_FLOAT(name, type) encodeFloat(builder, &value->name)
+#define CSON_ENCODE_STRING(name, type) encodeString(builder, &value->name)
+#define CSON_ENCODE_OBJECT(name, type) encode##type(builder, &value->name)
+#define CSON_ENCODE_LIST(name, type) encodeList(builder, value->name, value->name##Count, sizeof(type), encode##type)
+#define CSON_ENCODE_FIXED_STRING(name, type) encodeString(builder, &(const char*){ value->name })
+#define CSON_ENCODE_FIXED_LIST(name, type)\
+  encodeList(builder, value->name, value->name##Count, sizeof(value->name[0]), CSON_PAIR_ENCODER_ type)
+
+#endif
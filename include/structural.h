@@ -0,0 +1,59 @@
+#ifndef STRUCTURAL_H
+#define STRUCTURAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// First stage of lexing large inputs: finds the position of every token in a window of the input,
+// 64 bytes at a time, without branching on individual bytes. Tokens are the brackets, commas and
+// colons outside of strings, the opening quote of every string, and the first byte of every other
+// run of bytes outside of strings which are not whitespace (numbers and literals). Escaped quotes are
+// told apart from closing ones by the parity of the backslashes in front of them, and the bytes inside
+// of strings are found with a prefix XOR of the quotes. The lexer then jumps from position to position,
+// and only looks at the bytes of the tokens themselves.
+//
+// A window must start outside of a string and of any token, such as right after one. Strings may run
+// past the end of a window, which ends the positions of that window.
+
+// Number of bytes of input covered by a window
+#define STRUCTURAL_WINDOW_SIZE (16 * 1024)
+// Inputs shorter than this are lexed a byte at a time, as building the index does not pay off
+#define STRUCTURAL_INDEX_MIN_LENGTH (64 * 1024)
+
+typedef struct StructuralIndex {
+  const char *start;
+  const char *end;
+  // Offsets from `start` of the tokens in the window, in increasing order
+  uint32_t *positions;
+  size_t length;
+} StructuralIndex;
+
+StructuralIndex StructuralIndex_new();
+// Indexes the window of at most `STRUCTURAL_WINDOW_SIZE` bytes starting at `start`, where `inputEnd` is
+// the end of the whole input.
+void StructuralIndex_build(StructuralIndex *index, const char *start, const char *inputEnd);
+// Returns the number of tokens of the whole input from `start` to `end`, which is exact unless the
+// input is malformed, without storing their positions.
+size_t StructuralIndex_count(const char *start, const char *end);
+void StructuralIndex_free(StructuralIndex *index);
+
+// What is needed to lex a chunk of the input independently of the ones before it, once it is known
+// whether it starts inside of a string, which only depends on `flipsString` of the chunks before it.
+typedef struct StructuralChunk {
+  // Number of tokens starting in the chunk if it starts outside [0] or inside [1] of a string
+  size_t tokens[2];
+  // Whether the chunk has an odd number of unescaped quotes
+  bool flipsString;
+  // The first unescaped quote, which closes the string the chunk starts in if it does, or NULL
+  const char *firstQuote;
+  size_t newlines;
+  // The last newline of the chunk, or NULL if there is none
+  const char *lastNewline;
+} StructuralChunk;
+
+// Summarizes the chunk from `start` to `end`, which must not start in the middle of an escape sequence,
+// a number or a literal, for example by following whitespace or an operator.
+StructuralChunk StructuralIndex_summarize(const char *start, const char *end);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef TAGTABLE_H
+#define TAGTABLE_H
+
+#include <stdint.h>
+
+#include "decoders.h"
+
+// A variant of a tagged union: objects whose discriminator equals `tag` are decoded by `decoder`.
+typedef struct TagCase {
+  char *tag;
+  decodeFun decoder;
+} TagCase;
+
+// Open addressing hash table from tags to the index of their case, built once and then shared by
+// every call to `decodeTagged`.
+typedef struct TagTable {
+  TagCase *cases;
+  uint32_t *hashes;
+  int count;
+  // Index of the case stored in each slot, or -1 for empty slots
+  int *slots;
+  int capacity;
+} TagTable;
+
+// Does not take ownership of `cases`, but the tags must outlive the table. Tags must be distinct.
+TagTable *TagTable_new(int count, const TagCase *cases);
+// Returns the index of the case for `tag`, or -1 if there is none.
+int TagTable_find(const TagTable *table, const char *tag);
+void TagTable_free(TagTable *table);
+
+#endif
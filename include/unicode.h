@@ -0,0 +1,22 @@
+#ifndef UNICODE_H
+#define UNICODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UNICODE_MAX_UTF8_LENGTH 4
+
+// Returns the number of bytes before the first byte of `str` which is a quote, a backslash, a control
+// character or not ASCII. `str` must be NUL-terminated, which always ends the run. Uses SSE2 where
+// available, and otherwise compares a machine word at a time.
+size_t Unicode_plainAsciiLength(const char *str);
+
+// Returns the length of the well-formed UTF-8 sequence starting at `str`, or 0 if it is malformed,
+// overlong, a surrogate or above U+10FFFF.
+int Unicode_utf8SequenceLength(const char *str);
+
+// Writes `codepoint` as UTF-8 to `dest`, which must have room for `UNICODE_MAX_UTF8_LENGTH` bytes.
+// Returns the number of bytes written.
+int Unicode_encodeUtf8(uint32_t codepoint, char *dest);
+
+#endif
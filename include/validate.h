@@ -0,0 +1,36 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lexer.h"
+
+// Checking whether an input is well-formed JSON without parsing it. The input is scanned once, byte by
+// byte, without producing tokens or nodes, so it suits gateways which only need to accept or reject a body
+// before passing it on. The only memory allocated is for lists and objects nested more than
+// `VALIDATE_STACK_SIZE` deep, whose positions no longer fit on the C stack.
+//
+// The grammar is that of RFC 8259, which is stricter than `parse` about numbers (no leading `+`, leading
+// zeros, hexadecimal or missing digits). Strings must be valid UTF-8 and their escapes are checked like
+// `lex` does, so \u0000 is rejected even though RFC 8259 allows it: the input would be valid but could not
+// be parsed.
+
+// Open lists and objects kept on the C stack before moving to the heap
+#define VALIDATE_STACK_SIZE 256
+
+typedef struct ValidateResult {
+  bool valid;
+  // Position of the first error, the offset counting from 0 and the row and column from 1.
+  size_t offset;
+  size_t row;
+  size_t col;
+  char errorMsg[MAX_ERR_SIZE];
+} ValidateResult;
+
+// Checks the `length` bytes at `input`, which need not be NUL-terminated, against the same `limits` as
+// `parseWithOptions` (NULL for none), with the same messages. A comma after the last element of a list or
+// object, which `parse` accepts, is only allowed with `allowTrailingCommas`.
+ValidateResult validate(const char *input, size_t length, const ParseLimits *limits, bool allowTrailingCommas);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "interntable.h"
+
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+#define ARENA_STRINGS_START_CAPACITY 64
+
+Arena Arena_new() {
+  return (Arena) {
+    .first = NULL,
+    .current = NULL,
+    .deduplicate = false,
+    .strings = NULL,
+    .hashes = NULL,
+    .stringCount = 0,
+    .stringCapacity = 0,
+  };
+}
+
+Arena Arena_newDeduplicating() {
+  Arena arena = Arena_new();
+  arena.deduplicate = true;
+  return arena;
+}
+
+void *Arena_alloc(Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+  // The rest of a block that is too small is left unused until the arena is reset
+  ArenaBlock *last = NULL;
+  ArenaBlock *block = arena->current;
+  while (block != NULL && block->size - block->used < size) {
+    last = block;
+    block = block->next;
+  }
+
+  if (block == NULL) {
+    size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    block = malloc(sizeof(ArenaBlock) + blockSize);
+    block->next = NULL;
+    block->size = blockSize;
+    block->used = 0;
+    if (last != NULL) {
+      last->next = block;
+    } else {
+      arena->first = block;
+    }
+  }
+
+  arena->current = block;
+  void *ptr = (char*)block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+// Returns the slot holding `string`, or the empty slot where it would be inserted.
+static size_t findString(const Arena *arena, const char *string, uint32_t hash) {
+  size_t mask = arena->stringCapacity - 1;
+  size_t i = hash & mask;
+  while (arena->strings[i] != NULL) {
+    if (arena->hashes[i] == hash && strcmp(arena->strings[i], string) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+// Doubles the capacity of the set, keeping it at most half full
+static void growStrings(Arena *arena) {
+  char **strings = arena->strings;
+  uint32_t *hashes = arena->hashes;
+  size_t capacity = arena->stringCapacity;
+
+  arena->stringCapacity = capacity > 0 ? 2 * capacity : ARENA_STRINGS_START_CAPACITY;
+  arena->strings = calloc(arena->stringCapacity, sizeof(char*));
+  arena->hashes = malloc(arena->stringCapacity * sizeof(uint32_t));
+  for (size_t i = 0; i < capacity; i++) {
+    if (strings[i] != NULL) {
+      size_t slot = findString(arena, strings[i], hashes[i]);
+      arena->strings[slot] = strings[i];
+      arena->hashes[slot] = hashes[i];
+    }
+  }
+  free(strings);
+  free(hashes);
+}
+
+char *Arena_strdup(Arena *arena, const char *string) {
+  size_t size = strlen(string) + 1;
+  if (!arena->deduplicate) {
+    return memcpy(Arena_alloc(arena, size), string, size);
+  }
+
+  if (2 * (arena->stringCount + 1) > arena->stringCapacity) {
+    growStrings(arena);
+  }
+  uint32_t hash = InternTable_hash(string, size - 1);
+  size_t slot = findString(arena, string, hash);
+  if (arena->strings[slot] == NULL) {
+    arena->strings[slot] = memcpy(Arena_alloc(arena, size), string, size);
+    arena->hashes[slot] = hash;
+    arena->stringCount++;
+  }
+  return arena->strings[slot];
+}
+
+void Arena_reset(Arena *arena) {
+  for (ArenaBlock *block = arena->first; block != NULL; block = block->next) {
+    block->used = 0;
+  }
+  arena->current = arena->first;
+  if (arena->stringCount > 0) {
+    memset(arena->strings, 0, arena->stringCapacity * sizeof(char*));
+    arena->stringCount = 0;
+  }
+}
+
+void Arena_free(Arena *arena) {
+  ArenaBlock *block = arena->first;
+  while (block != NULL) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->first = NULL;
+  arena->current = NULL;
+  free(arena->strings);
+  free(arena->hashes);
+  arena->strings = NULL;
+  arena->hashes = NULL;
+  arena->stringCount = 0;
+  arena->stringCapacity = 0;
+}
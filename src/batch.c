@@ -0,0 +1,244 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "parser.h"
+
+#define BATCH_FILES_START_CAPACITY 64
+
+typedef struct BatchFile {
+  char *path;
+  size_t size;
+  bool success;
+  // Set once `output` is complete, under the lock of the batch
+  bool done;
+  char *output;
+  size_t outputLength;
+} BatchFile;
+
+typedef struct Batch {
+  BatchFile *files;
+  size_t length;
+  size_t capacity;
+  const BatchOptions *options;
+  // Index of the next file to be processed
+  size_t next;
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+} Batch;
+
+// Takes ownership of `path`
+static void addFile(Batch *batch, char *path) {
+  if (batch->length == batch->capacity) {
+    batch->capacity = batch->capacity > 0 ? 2 * batch->capacity : BATCH_FILES_START_CAPACITY;
+    batch->files = reallocarray(batch->files, batch->capacity, sizeof(BatchFile));
+  }
+  memset(&batch->files[batch->length], 0, sizeof(BatchFile));
+  batch->files[batch->length++].path = path;
+}
+
+static bool hasJsonExtension(const char *name) {
+  size_t length = strlen(name);
+  return length >= 5 && strcmp(name + length - 5, ".json") == 0;
+}
+
+static void addDirectory(Batch *batch, const char *path) {
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    // Reported when the file is processed
+    addFile(batch, strdup(path));
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    size_t length = strlen(path);
+    const char *separator = length > 0 && path[length - 1] == '/' ? "" : "/";
+    size_t size = length + strlen(entry->d_name) + 2;
+    char *child = malloc(size);
+    snprintf(child, size, "%s%s%s", path, separator, entry->d_name);
+
+    struct stat st;
+    if (stat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+      addDirectory(batch, child);
+      free(child);
+    } else if (hasJsonExtension(entry->d_name)) {
+      addFile(batch, child);
+    } else {
+      free(child);
+    }
+  }
+  closedir(dir);
+}
+
+static int comparePaths(const void *a, const void *b) {
+  return strcmp(((const BatchFile*)a)->path, ((const BatchFile*)b)->path);
+}
+
+static void collectFiles(Batch *batch, char **paths, int count) {
+  for (int i = 0; i < count; i++) {
+    struct stat st;
+    if (stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+      // Directories are listed in no particular order
+      size_t first = batch->length;
+      addDirectory(batch, paths[i]);
+      qsort(batch->files + first, batch->length - first, sizeof(BatchFile), comparePaths);
+    } else {
+      addFile(batch, strdup(paths[i]));
+    }
+  }
+}
+
+// Parses or validates the file, printing to `out`. Returns whether it succeeded.
+static bool processInput(BatchFile *file, char *input, const BatchOptions *options, FILE *out) {
+  if (options->validateOnly) {
+    ValidateResult res = validate(input, file->size, NULL, options->allowTrailingCommas);
+    if (res.valid) {
+      fprintf(out, "%s: Valid\n", file->path);
+    } else {
+      fprintf(out, "%s: Invalid: %s\n", file->path, res.errorMsg);
+    }
+    return res.valid;
+  }
+
+  // The mapping is private, so parsing in situ does not write to the file
+  ParseOptions parseOptions = { .inSitu = true };
+  ParserResult res = parseWithOptions(input, &parseOptions);
+  if (res.status != PARSER_SUCCESS) {
+    fprintf(out, "%s: Parsing failed: %s\n", file->path, res.result.PARSER_ERROR.errorMsg);
+    return false;
+  }
+  fprintf(out, "%s:\n", file->path);
+  fprintTree(out, res.result.PARSER_SUCCESS.tree);
+  JSONNode_freeInSitu(res.result.PARSER_SUCCESS.tree);
+  InternTable_free(res.result.PARSER_SUCCESS.keys);
+  return true;
+}
+
+static void processFile(BatchFile *file, const BatchOptions *options) {
+  FILE *out = open_memstream(&file->output, &file->outputLength);
+
+  int fd = open(file->path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    fprintf(out, "%s: Could not read file\n", file->path);
+    if (fd >= 0) close(fd);
+    fclose(out);
+    return;
+  }
+  file->size = st.st_size;
+
+  char empty[1] = "";
+  char *input = empty;
+  char *mapped = MAP_FAILED;
+  char *copy = NULL;
+  if (file->size > 0) {
+    mapped = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      fprintf(out, "%s: Could not map file\n", file->path);
+      close(fd);
+      fclose(out);
+      return;
+    }
+    madvise(mapped, file->size, MADV_SEQUENTIAL);
+    input = mapped;
+    // The rest of the last page of a mapping reads as zeros, so the input is NUL-terminated unless it
+    // ends exactly at the end of a page, which only matters to the parser
+    if (!options->validateOnly && file->size % sysconf(_SC_PAGESIZE) == 0) {
+      copy = malloc(file->size + 1);
+      memcpy(copy, mapped, file->size);
+      copy[file->size] = '\0';
+      input = copy;
+    }
+  }
+  close(fd);
+
+  file->success = processInput(file, input, options, out);
+
+  free(copy);
+  if (mapped != MAP_FAILED) {
+    munmap(mapped, file->size);
+  }
+  fclose(out);
+}
+
+static void *runWorker(void *arg) {
+  Batch *batch = (Batch*)arg;
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    size_t i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (i >= batch->length) {
+      return NULL;
+    }
+
+    processFile(&batch->files[i], batch->options);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->files[i].done = true;
+    pthread_cond_broadcast(&batch->finished);
+    pthread_mutex_unlock(&batch->lock);
+  }
+}
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+BatchSummary runBatch(char **paths, int count, const BatchOptions *options) {
+  Batch batch = { .files = NULL, .length = 0, .capacity = 0, .options = options, .next = 0 };
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.finished, NULL);
+
+  double start = now();
+  collectFiles(&batch, paths, count);
+
+  int threadCount = options->threads > 0 ? options->threads : 1;
+  pthread_t threads[threadCount];
+  int started = 0;
+  while (started < threadCount && pthread_create(&threads[started], NULL, runWorker, &batch) == 0) {
+    started++;
+  }
+  if (started == 0) {
+    runWorker(&batch);
+  }
+
+  // Printing in order while the workers move on to the next files
+  BatchSummary summary = { .files = batch.length, .failed = 0, .bytes = 0, .seconds = 0 };
+  for (size_t i = 0; i < batch.length; i++) {
+    BatchFile *file = &batch.files[i];
+    pthread_mutex_lock(&batch.lock);
+    while (!file->done) {
+      pthread_cond_wait(&batch.finished, &batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+
+    fwrite(file->output, 1, file->outputLength, options->out);
+    free(file->output);
+    free(file->path);
+    summary.failed += !file->success;
+    summary.bytes += file->size;
+  }
+
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  summary.seconds = now() - start;
+
+  free(batch.files);
+  pthread_cond_destroy(&batch.finished);
+  pthread_mutex_destroy(&batch.lock);
+  return summary;
+}
@@ -0,0 +1,546 @@
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "decoders.h"
+#include "parallel.h"
+#include "parser.h"
+#include "schema.h"
+#include "stringbuilder.h"
+
+// Benchmarks of the library on generated documents, so that they can be repeated on any machine:
+//
+//   bench <name> [size] [repetitions] [file...]
+//
+// Each prints the best time out of the repetitions, which is the least disturbed by the rest of the
+// machine. Benchmarks which can also run on real documents take them as files. `bench` without arguments
+// lists the benchmarks. Like the other host tools, this is not
+// built for the Game Boy Advance.
+
+#define DIE(msg...) do { fprintf(stderr, msg); exit(1); } while(0);
+
+typedef struct Benchmark {
+  char *name;
+  char *description;
+  // Size of the generated document, in records or values
+  size_t defaultSize;
+  void(*run)(size_t size, int repetitions, char **files, int fileCount);
+} Benchmark;
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Bytes currently allocated with malloc
+static size_t heapInUse() {
+  return mallinfo2().uordblks;
+}
+
+static char *readFile(char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    DIE("Cannot open %s\n", path);
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char *contents = malloc(size + 1);
+  size_t read = fread(contents, 1, size, file);
+  contents[read] = '\0';
+  fclose(file);
+  return contents;
+}
+
+// A list of `count` objects with a few fields each, like a typical API response
+static char *generateRecords(size_t count) {
+  StringBuilder builder = StringBuilder_new();
+  StringBuilder_append(&builder, "[");
+  for (size_t i = 0; i < count; i++) {
+    StringBuilder_append(&builder, "%s{\"id\": %zu, \"firstName\": \"First%zu\", \"lastName\": \"Last%zu\", "
+                         "\"age\": %zu, \"tags\": [\"a\", \"b\"], \"position\": {\"x\": %zu.5, \"y\": -%zu}}",
+                         i > 0 ? ", " : "", i, i % 1000, i % 777, i % 90, i % 1000, i % 500);
+  }
+  StringBuilder_append(&builder, "]");
+  return StringBuilder_getString(&builder);
+}
+
+// A list of `count` integers
+static char *generateInts(size_t count) {
+  StringBuilder builder = StringBuilder_new();
+  StringBuilder_append(&builder, "[");
+  for (size_t i = 0; i < count; i++) {
+    StringBuilder_append(&builder, "%s%zu", i > 0 ? "," : "", i * 7919 % 1000003);
+  }
+  StringBuilder_append(&builder, "]");
+  return StringBuilder_getString(&builder);
+}
+
+// A list of `count` families of the README, with two parents and up to three children each
+static char *generateFamilies(size_t count) {
+  StringBuilder builder = StringBuilder_new();
+  StringBuilder_append(&builder, "[");
+  for (size_t i = 0; i < count; i++) {
+    StringBuilder_append(&builder, "%s{\"father\": {\"firstName\": \"Walter%zu\", \"lastName\": \"White\", \"age\": 52}, "
+                         "\"mother\": {\"firstName\": \"Skyler%zu\", \"lastName\": \"White\", \"age\": 40}, \"children\": [",
+                         i > 0 ? ", " : "", i, i);
+    for (size_t j = 0; j < i % 4; j++) {
+      StringBuilder_append(&builder, "%s{\"firstName\": \"Child%zu\", \"lastName\": \"White\", \"age\": %zu}",
+                           j > 0 ? ", " : "", j, i % 18);
+    }
+    StringBuilder_append(&builder, "]}");
+  }
+  StringBuilder_append(&builder, "]");
+  return StringBuilder_getString(&builder);
+}
+
+static size_t countValues(JSONNode *node) {
+  size_t count = 1;
+  if (node->tag == JSON_LIST || node->tag == JSON_OBJECT) {
+    for (size_t i = 0; i < node->length; i++) {
+      count += countValues(&node->data.JSON_LIST.items[i]);
+    }
+  }
+  return count;
+}
+
+static void benchParseDocument(char *name, char *input, int repetitions) {
+  double best = -1;
+  size_t treeBytes = 0;
+  size_t values = 0;
+  for (int i = 0; i < repetitions; i++) {
+    size_t heapBefore = heapInUse();
+    double start = now();
+    ParserResult res = parse(input);
+    double time = now() - start;
+    if (res.status != PARSER_SUCCESS) {
+      printf("%-24s parsing failed: %s\n", name, res.result.PARSER_ERROR.errorMsg);
+      return;
+    }
+    // Only the tree and the keys are left once parsing is done
+    treeBytes = heapInUse() - heapBefore;
+    values = countValues(res.result.PARSER_SUCCESS.tree);
+    JSONNode_free(res.result.PARSER_SUCCESS.tree);
+    InternTable_free(res.result.PARSER_SUCCESS.keys);
+    if (best < 0 || time < best) best = time;
+  }
+  printf("%-24s %10zu bytes %9zu values %8.2f ms %6.1f bytes/value\n", name, strlen(input), values, best * 1e3,
+         (double)treeBytes / values);
+}
+
+// Time to parse, and heap taken up by the tree, which depend on how nodes and containers are laid out.
+// The heap of small documents is mostly the intern table and malloc rounding. glibc counts the freed chunks
+// it caches as in use, so their figures are only exact with
+// GLIBC_TUNABLES=glibc.malloc.tcache_count=0:glibc.malloc.mxfast=0.
+static void benchParse(size_t size, int repetitions, char **files, int fileCount) {
+  char *records = generateRecords(size);
+  benchParseDocument("records", records, repetitions);
+  free(records);
+
+  char *ints = generateInts(size * 10);
+  benchParseDocument("ints", ints, repetitions);
+  free(ints);
+
+  for (int i = 0; i < fileCount; i++) {
+    char *input = readFile(files[i]);
+    benchParseDocument(files[i], input, repetitions);
+    free(input);
+  }
+}
+
+// The family of the README, decoded by hand-written decoders using `decodeFields`...
+
+typedef struct Person {
+  char *firstName;
+  char *lastName;
+  int age;
+} Person;
+
+typedef struct Family {
+  Person father;
+  Person mother;
+  Person *children;
+  int childCount;
+} Family;
+
+static bool decodePerson(DecoderState *state, void *dest) {
+  Person *person = (Person*)dest;
+  return decodeFields(state, 3,
+    makeField("firstName", &person->firstName, decodeString),
+    makeField("lastName", &person->lastName, decodeString),
+    makeField("age", &person->age, decodeInt)
+  );
+}
+
+static bool decodeFamily(DecoderState *state, void *dest) {
+  Family *family = (Family*)dest;
+  return decodeFields(state, 3,
+    makeField("father", &family->father, decodePerson),
+    makeField("mother", &family->mother, decodePerson),
+    makeListField("children", &family->children, &family->childCount, sizeof(Person), decodePerson)
+  );
+}
+
+// ...and by decoders generated from a description of its fields
+
+#define FAMILY_MEMBER_FIELDS(FIELD)\
+  FIELD(STRING, firstName, _)\
+  FIELD(STRING, lastName, _)\
+  FIELD(INT, age, _)
+
+CSON_STRUCT(FamilyMember, FAMILY_MEMBER_FIELDS)
+CSON_DECODER(FamilyMember, FAMILY_MEMBER_FIELDS)
+
+#define HOUSEHOLD_FIELDS(FIELD)\
+  FIELD(OBJECT, father, FamilyMember)\
+  FIELD(OBJECT, mother, FamilyMember)\
+  FIELD(LIST, children, FamilyMember)
+
+CSON_STRUCT(Household, HOUSEHOLD_FIELDS)
+CSON_DECODER(Household, HOUSEHOLD_FIELDS)
+
+typedef struct FamilyList {
+  void *families;
+  int length;
+} FamilyList;
+
+static bool decodeFamilyList(DecoderState *state, void *dest) {
+  FamilyList *list = (FamilyList*)dest;
+  return decodeList(state, &list->families, &list->length, sizeof(Family), decodeFamily);
+}
+
+static bool decodeHouseholdList(DecoderState *state, void *dest) {
+  FamilyList *list = (FamilyList*)dest;
+  return decodeList(state, &list->families, &list->length, sizeof(Household), decodeHousehold);
+}
+
+// Both kinds of structs hold the same members in the same order
+static void freeFamilyList(FamilyList list) {
+  Family *families = list.families;
+  for (int i = 0; i < list.length; i++) {
+    Person *people[] = { &families[i].father, &families[i].mother };
+    for (int j = 0; j < 2; j++) {
+      free(people[j]->firstName);
+      free(people[j]->lastName);
+    }
+    for (int j = 0; j < families[i].childCount; j++) {
+      free(families[i].children[j].firstName);
+      free(families[i].children[j].lastName);
+    }
+    free(families[i].children);
+  }
+  free(families);
+}
+
+static double timeDecodeTree(ParserResult *document, decodeFun decoder, int repetitions) {
+  double best = -1;
+  for (int i = 0; i < repetitions; i++) {
+    FamilyList list;
+    double start = now();
+    DecodeResult res = decodeTree(document->result.PARSER_SUCCESS.tree, document->result.PARSER_SUCCESS.keys, &list,
+                                  decoder);
+    double time = now() - start;
+    if (!res.success) {
+      DIE("Decoding failed: %s\n", buildDecoderError(res.error));
+    }
+    freeFamilyList(list);
+    if (best < 0 || time < best) best = time;
+  }
+  return best;
+}
+
+// Time to decode an already parsed list of families, by `decodeFields` and by generated decoders
+static void benchSchema(size_t size, int repetitions, char **files, int fileCount) {
+  (void) files;
+  (void) fileCount;
+  _Static_assert(sizeof(Family) == sizeof(Household), "Family and Household must have the same layout");
+  char *input = generateFamilies(size);
+  ParserResult document = parse(input);
+  if (document.status != PARSER_SUCCESS) {
+    DIE("Parsing failed: %s\n", document.result.PARSER_ERROR.errorMsg);
+  }
+
+  double fields = timeDecodeTree(&document, decodeFamilyList, repetitions);
+  double generated = timeDecodeTree(&document, decodeHouseholdList, repetitions);
+  printf("decodeFields %8.2f ms\n", fields * 1e3);
+  printf("generated    %8.2f ms\n", generated * 1e3);
+
+  JSONNode_free(document.result.PARSER_SUCCESS.tree);
+  InternTable_free(document.result.PARSER_SUCCESS.keys);
+  free(input);
+}
+
+// Records decoded into an array of structs, and into one array per field
+
+typedef struct Record {
+  int id;
+  char *firstName;
+  char *lastName;
+  int age;
+} Record;
+
+typedef struct RecordList {
+  Record *records;
+  int length;
+} RecordList;
+
+typedef struct RecordColumns {
+  int *ids;
+  char **firstNames;
+  char **lastNames;
+  int *ages;
+  int length;
+} RecordColumns;
+
+static bool decodeRecord(DecoderState *state, void *dest) {
+  Record *record = (Record*)dest;
+  return decodeFields(state, 4,
+    makeField("id", &record->id, decodeInt),
+    makeField("firstName", &record->firstName, decodeString),
+    makeField("lastName", &record->lastName, decodeString),
+    makeField("age", &record->age, decodeInt)
+  );
+}
+
+static bool decodeRecordList(DecoderState *state, void *dest) {
+  RecordList *list = (RecordList*)dest;
+  return decodeList(state, &list->records, &list->length, sizeof(Record), decodeRecord);
+}
+
+static bool decodeRecordColumns(DecoderState *state, void *dest) {
+  RecordColumns *columns = (RecordColumns*)dest;
+  return decodeColumns(state, &columns->length, 4,
+    makeColumn("id", &columns->ids, sizeof(int), decodeInt),
+    makeColumn("firstName", &columns->firstNames, sizeof(char*), decodeString),
+    makeColumn("lastName", &columns->lastNames, sizeof(char*), decodeString),
+    makeColumn("age", &columns->ages, sizeof(int), decodeInt)
+  );
+}
+
+// Number of times the ages are summed, since a single sum is too quick to time
+#define COLUMN_SUMS 20
+
+// Time to decode an already parsed list of records and then to sum one of their fields, for an array of
+// structs and for columns
+static void benchColumns(size_t size, int repetitions, char **files, int fileCount) {
+  (void) files;
+  (void) fileCount;
+  char *input = generateRecords(size);
+  ParserResult document = parse(input);
+  if (document.status != PARSER_SUCCESS) {
+    DIE("Parsing failed: %s\n", document.result.PARSER_ERROR.errorMsg);
+  }
+  JSONNode *tree = document.result.PARSER_SUCCESS.tree;
+  InternTable *keys = document.result.PARSER_SUCCESS.keys;
+
+  double bestDecode[2] = { -1, -1 };
+  double bestSum[2] = { -1, -1 };
+  long sums[2] = { 0, 0 };
+  for (int i = 0; i < repetitions; i++) {
+    RecordList list;
+    double start = now();
+    DecodeResult res = decodeTree(tree, keys, &list, decodeRecordList);
+    double decoded = now();
+    if (!res.success) {
+      DIE("Decoding failed: %s\n", buildDecoderError(res.error));
+    }
+    sums[0] = 0;
+    for (int n = 0; n < COLUMN_SUMS; n++) {
+      for (int j = 0; j < list.length; j++) {
+        sums[0] += list.records[j].age;
+      }
+    }
+    double summed = now();
+    if (bestDecode[0] < 0 || decoded - start < bestDecode[0]) bestDecode[0] = decoded - start;
+    if (bestSum[0] < 0 || summed - decoded < bestSum[0]) bestSum[0] = summed - decoded;
+    for (int j = 0; j < list.length; j++) {
+      free(list.records[j].firstName);
+      free(list.records[j].lastName);
+    }
+    free(list.records);
+
+    RecordColumns columns;
+    start = now();
+    res = decodeTree(tree, keys, &columns, decodeRecordColumns);
+    decoded = now();
+    if (!res.success) {
+      DIE("Decoding failed: %s\n", buildDecoderError(res.error));
+    }
+    sums[1] = 0;
+    for (int n = 0; n < COLUMN_SUMS; n++) {
+      for (int j = 0; j < columns.length; j++) {
+        sums[1] += columns.ages[j];
+      }
+    }
+    summed = now();
+    if (bestDecode[1] < 0 || decoded - start < bestDecode[1]) bestDecode[1] = decoded - start;
+    if (bestSum[1] < 0 || summed - decoded < bestSum[1]) bestSum[1] = summed - decoded;
+    for (int j = 0; j < columns.length; j++) {
+      free(columns.firstNames[j]);
+      free(columns.lastNames[j]);
+    }
+    free(columns.ids);
+    free(columns.firstNames);
+    free(columns.lastNames);
+    free(columns.ages);
+  }
+  if (sums[0] != sums[1]) {
+    DIE("The sums differ: %ld and %ld\n", sums[0], sums[1]);
+  }
+
+  printf("structs  decode %8.2f ms, sum %d times %8.2f ms\n", bestDecode[0] * 1e3, COLUMN_SUMS, bestSum[0] * 1e3);
+  printf("columns  decode %8.2f ms, sum %d times %8.2f ms\n", bestDecode[1] * 1e3, COLUMN_SUMS, bestSum[1] * 1e3);
+
+  JSONNode_free(tree);
+  InternTable_free(keys);
+  free(input);
+}
+
+// Time to lex and to parse a list of records on 1, 2, 4 and 8 threads. Only lexing is split between threads,
+// and threads beyond the number of cores can only add overhead, so that number is printed along.
+static void benchParallel(size_t size, int repetitions, char **files, int fileCount) {
+  (void) files;
+  (void) fileCount;
+  char *input = generateRecords(size);
+  printf("%zu bytes, %ld cores online\n", strlen(input), sysconf(_SC_NPROCESSORS_ONLN));
+
+  double serialLex = 0;
+  double serialParse = 0;
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    double bestLex = -1;
+    double bestParse = -1;
+    for (int i = 0; i < repetitions; i++) {
+      double start = now();
+      LexResult lexed = lexParallel(input, false, NULL, threads);
+      double time = now() - start;
+      if (lexed.status != LEXER_SUCCESS) {
+        DIE("Lexing failed: %s\n", lexed.result.LEXER_FAIL.errorMsg);
+      }
+      TokenList_free(&lexed.result.LEXER_SUCCESS.tokenList);
+      if (bestLex < 0 || time < bestLex) bestLex = time;
+
+      start = now();
+      ParserResult parsed = parseParallel(input, NULL, threads);
+      time = now() - start;
+      if (parsed.status != PARSER_SUCCESS) {
+        DIE("Parsing failed: %s\n", parsed.result.PARSER_ERROR.errorMsg);
+      }
+      JSONNode_free(parsed.result.PARSER_SUCCESS.tree);
+      InternTable_free(parsed.result.PARSER_SUCCESS.keys);
+      if (bestParse < 0 || time < bestParse) bestParse = time;
+    }
+    if (threads == 1) {
+      serialLex = bestLex;
+      serialParse = bestParse;
+    }
+    printf("%d threads  lex %8.2f ms (x%.2f)  parse %8.2f ms (x%.2f)\n", threads, bestLex * 1e3, serialLex / bestLex,
+           bestParse * 1e3, serialParse / bestParse);
+  }
+  free(input);
+}
+
+// Records per document of the `threads` benchmark, which is about the small documents of a server
+#define THREADS_DOCUMENT_RECORDS 20
+
+typedef struct DecodeWorker {
+  pthread_t thread;
+  char *input;
+  size_t decodes;
+  bool useContext;
+} DecodeWorker;
+
+static void *decodeRepeatedly(void *arg) {
+  DecodeWorker *worker = (DecodeWorker*)arg;
+  DecodeContext context = DecodeContext_new();
+  for (size_t i = 0; i < worker->decodes; i++) {
+    RecordList list;
+    DecodeResult res = worker->useContext ? decodeWithContext(&context, worker->input, &list, decodeRecordList, NULL)
+                                          : decode(worker->input, &list, decodeRecordList);
+    if (!res.success) {
+      DIE("Decoding failed: %s\n", buildDecoderError(res.error));
+    }
+    for (int j = 0; j < list.length; j++) {
+      free(list.records[j].firstName);
+      free(list.records[j].lastName);
+    }
+    free(list.records);
+  }
+  DecodeContext_free(&context);
+  return NULL;
+}
+
+// Returns the number of documents decoded per second by `threads` threads, each decoding `decodes` of them
+static double decodeThroughput(char *input, int threads, size_t decodes, bool useContext) {
+  DecodeWorker workers[threads];
+  double start = now();
+  for (int i = 0; i < threads; i++) {
+    workers[i] = (DecodeWorker) { .input = input, .decodes = decodes, .useContext = useContext };
+    if (pthread_create(&workers[i].thread, NULL, decodeRepeatedly, &workers[i]) != 0) {
+      DIE("Cannot create thread\n");
+    }
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  return threads * decodes / (now() - start);
+}
+
+// Documents decoded per second by 1, 2, 4 and 8 threads, each decoding `size` small documents, with `decode`
+// and with a `DecodeContext` per thread. Throughput can only grow up to the number of cores, which is
+// printed along.
+static void benchThreads(size_t size, int repetitions, char **files, int fileCount) {
+  (void) files;
+  (void) fileCount;
+  char *input = generateRecords(THREADS_DOCUMENT_RECORDS);
+  printf("%zu bytes per document, %ld cores online\n", strlen(input), sysconf(_SC_NPROCESSORS_ONLN));
+
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    double best[2] = { 0, 0 };
+    for (int i = 0; i < repetitions; i++) {
+      for (int mode = 0; mode < 2; mode++) {
+        double throughput = decodeThroughput(input, threads, size, mode == 1);
+        if (throughput > best[mode]) best[mode] = throughput;
+      }
+    }
+    printf("%d threads  decode %10.0f documents/s  context %10.0f documents/s\n", threads, best[0], best[1]);
+  }
+  free(input);
+}
+
+static Benchmark benchmarks[] = {
+  { "parse", "parse records, integers and any files, reporting the heap taken by the tree", 100000, benchParse },
+  { "schema", "decode families using decodeFields and using generated decoders", 100000, benchSchema },
+  { "columns", "decode records into structs and into columns, and sum a field of each", 100000, benchColumns },
+  { "parallel", "lex and parse records on 1 to 8 threads", 100000, benchParallel },
+  { "threads", "decode small documents on 1 to 8 threads, with and without a DecodeContext", 20000, benchThreads },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage: bench <name> [size] [repetitions] [file...]\n\n");
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+      printf("  %-10s %s (default size %zu)\n", benchmarks[i].name, benchmarks[i].description, benchmarks[i].defaultSize);
+    }
+    return 0;
+  }
+
+  for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+    if (strcmp(argv[1], benchmarks[i].name) == 0) {
+      size_t size = argc > 2 ? strtoull(argv[2], NULL, 10) : benchmarks[i].defaultSize;
+      int repetitions = argc > 3 ? atoi(argv[3]) : 5;
+      if (size == 0 || repetitions <= 0) {
+        DIE("Invalid size or number of repetitions\n");
+      }
+      benchmarks[i].run(size, repetitions, argv + 4, argc > 4 ? argc - 4 : 0);
+      return 0;
+    }
+  }
+  DIE("Unknown benchmark %s\n", argv[1]);
+}
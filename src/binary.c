@@ -0,0 +1,389 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binary.h"
+#include "decoders.h"
+#include "interntable.h"
+
+#define FAIL(errorMsg, args...) do {\
+  snprintf(errorMsg, BINARY_ERROR_MAX_SIZE, args);\
+  return false;\
+} while(0)
+
+#define ALIGN(n, alignment) (((n) + (alignment) - 1) & ~((uint64_t)(alignment) - 1))
+
+typedef struct ByteBuffer {
+  char *bytes;
+  size_t length;
+  size_t capacity;
+} ByteBuffer;
+
+// Appends `size` bytes aligned to `alignment`, returning the offset they were written at
+static size_t ByteBuffer_append(ByteBuffer *buffer, const void *data, size_t size, size_t alignment) {
+  size_t offset = ALIGN(buffer->length, alignment);
+  while (offset + size > buffer->capacity) {
+    buffer->capacity = buffer->capacity > 0 ? buffer->capacity * 2 : 256;
+    buffer->bytes = realloc(buffer->bytes, buffer->capacity);
+  }
+  memset(buffer->bytes + buffer->length, 0, offset - buffer->length);
+  memcpy(buffer->bytes + offset, data, size);
+  buffer->length = offset + size;
+  return offset;
+}
+
+// Maps interned field names of the tree being written to their offset in the string table. Since
+// the names are interned, they can be compared by pointer.
+typedef struct KeyOffsets {
+  char **keys;
+  size_t *offsets;
+  size_t length;
+  size_t capacity;
+} KeyOffsets;
+
+static size_t *KeyOffsets_slot(KeyOffsets *map, char *key) {
+  if ((map->length + 1) * 2 > map->capacity) {
+    KeyOffsets old = *map;
+    map->capacity = old.capacity > 0 ? old.capacity * 2 : 64;
+    map->keys = calloc(map->capacity, sizeof(char*));
+    map->offsets = calloc(map->capacity, sizeof(size_t));
+    map->length = 0;
+    for (size_t i = 0; i < old.capacity; i++) {
+      if (old.keys[i] != NULL) {
+        *KeyOffsets_slot(map, old.keys[i]) = old.offsets[i];
+      }
+    }
+    free(old.keys);
+    free(old.offsets);
+  }
+
+  size_t mask = map->capacity - 1;
+  size_t i = ((uintptr_t)key >> 3) & mask;
+  while (map->keys[i] != NULL && map->keys[i] != key) {
+    i = (i + 1) & mask;
+  }
+  if (map->keys[i] == NULL) {
+    map->keys[i] = key;
+    map->offsets[i] = 0;
+    map->length++;
+  }
+  return &map->offsets[i];
+}
+
+static size_t appendKey(ByteBuffer *strings, KeyOffsets *keyOffsets, size_t stringsOffset, char *key) {
+  size_t *offset = KeyOffsets_slot(keyOffsets, key);
+  if (*offset == 0) {
+    size_t length = strlen(key);
+    InternedKey header = { .hash = InternTable_hash(key, length), .length = length };
+    size_t headerOffset = ByteBuffer_append(strings, &header, sizeof(InternedKey), _Alignof(InternedKey));
+    ByteBuffer_append(strings, key, length + 1, 1);
+    *offset = stringsOffset + headerOffset + offsetof(InternedKey, string);
+  }
+  return *offset;
+}
+
+// Bytes taken up by the items of a container, followed by their keys for objects
+static size_t blockSize(JSONNode *node) {
+  size_t itemSize = sizeof(JSONNode) + (node->tag == JSON_OBJECT ? sizeof(char*) : 0);
+  return node->length * itemSize;
+}
+
+static bool isContainer(JSONNode *node) {
+  return node->tag == JSON_OBJECT || node->tag == JSON_LIST;
+}
+
+// Copies `node` with its string turned into an offset. The items of containers are filled in later.
+static JSONNode writeNode(JSONNode *node, ByteBuffer *strings, size_t stringsOffset) {
+  JSONNode out = *node;
+  if (node->tag == JSON_STRING) {
+    char *string = node->data.JSON_STRING.string;
+    size_t offset = ByteBuffer_append(strings, string, strlen(string) + 1, 1);
+    out.data.JSON_STRING.string = (char*)(uintptr_t)(stringsOffset + offset);
+  } else if (isContainer(node)) {
+    out.data.JSON_LIST.items = NULL;
+  }
+  return out;
+}
+
+bool Binary_write(JSONNode *root, const char *path, char errorMsg[BINARY_ERROR_MAX_SIZE]) {
+  // Breadth first order, in which the blocks of the containers are written after the root
+  size_t containerCount = 0;
+  size_t containerCapacity = PARSER_STACK_START_CAPACITY;
+  JSONNode **containers = malloc(containerCapacity * sizeof(JSONNode*));
+  size_t nodesSize = sizeof(JSONNode);
+  if (isContainer(root)) {
+    containers[containerCount++] = root;
+  }
+
+  for (size_t i = 0; i < containerCount; i++) {
+    JSONNode *node = containers[i];
+    nodesSize += blockSize(node);
+    for (size_t j = 0; j < node->length; j++) {
+      JSONNode *child = &node->data.JSON_LIST.items[j];
+      if (!isContainer(child)) {
+        continue;
+      }
+      if (containerCount == containerCapacity) {
+        containerCapacity *= 2;
+        containers = reallocarray(containers, containerCapacity, sizeof(JSONNode*));
+      }
+      containers[containerCount++] = child;
+    }
+  }
+
+  BinaryHeader header;
+  memset(&header, 0, sizeof(BinaryHeader));
+  memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.version = BINARY_VERSION;
+  header.byteOrderMark = BINARY_BYTE_ORDER_MARK;
+  header.pointerSize = sizeof(void*);
+  header.nodeSize = sizeof(JSONNode);
+  header.nodesOffset = ALIGN(sizeof(BinaryHeader), _Alignof(JSONNode));
+  header.nodesSize = nodesSize;
+  header.stringsOffset = ALIGN(header.nodesOffset + nodesSize, 8);
+
+  char *nodes = calloc(nodesSize, 1);
+  // Where the copy of each container was written, in the same order as `containers`
+  size_t *written = malloc(containerCapacity * sizeof(size_t));
+  ByteBuffer strings = { .bytes = NULL, .length = 0, .capacity = 0 };
+  KeyOffsets keyOffsets = { .keys = NULL, .offsets = NULL, .length = 0, .capacity = 0 };
+
+  *(JSONNode*)nodes = writeNode(root, &strings, header.stringsOffset);
+  written[0] = 0;
+  size_t nextWritten = 1;
+  size_t cursor = sizeof(JSONNode);
+
+  for (size_t i = 0; i < containerCount; i++) {
+    JSONNode *node = containers[i];
+    if (node->length == 0) {
+      continue;
+    }
+    JSONNode *out = (JSONNode*)(nodes + written[i]);
+    out->data.JSON_LIST.items = (JSONNode*)(uintptr_t)(header.nodesOffset + cursor);
+
+    JSONNode *items = (JSONNode*)(nodes + cursor);
+    for (size_t j = 0; j < node->length; j++) {
+      JSONNode *child = &node->data.JSON_LIST.items[j];
+      items[j] = writeNode(child, &strings, header.stringsOffset);
+      if (isContainer(child)) {
+        written[nextWritten++] = cursor + j * sizeof(JSONNode);
+      }
+    }
+    if (node->tag == JSON_OBJECT) {
+      char **keys = JSONNode_keys(node);
+      char **outKeys = (char**)(items + node->length);
+      for (size_t j = 0; j < node->length; j++) {
+        outKeys[j] = (char*)(uintptr_t)appendKey(&strings, &keyOffsets, header.stringsOffset, keys[j]);
+      }
+    }
+    cursor += blockSize(node);
+  }
+
+  // Makes sure that every string in the table is terminated within the file
+  ByteBuffer_append(&strings, "", 1, 1);
+  header.stringsSize = strings.length;
+
+  bool success = true;
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    snprintf(errorMsg, BINARY_ERROR_MAX_SIZE, "Could not open %s for writing", path);
+    success = false;
+  } else {
+    char padding[16] = { 0 };
+    fwrite(&header, sizeof(BinaryHeader), 1, fp);
+    fwrite(padding, 1, header.nodesOffset - sizeof(BinaryHeader), fp);
+    fwrite(nodes, 1, nodesSize, fp);
+    fwrite(padding, 1, header.stringsOffset - (header.nodesOffset + nodesSize), fp);
+    fwrite(strings.bytes, 1, strings.length, fp);
+    if (ferror(fp)) {
+      snprintf(errorMsg, BINARY_ERROR_MAX_SIZE, "Error writing %s", path);
+      success = false;
+    }
+    fclose(fp);
+  }
+
+  free(containers);
+  free(written);
+  free(nodes);
+  free(strings.bytes);
+  free(keyOffsets.keys);
+  free(keyOffsets.offsets);
+  return success;
+}
+
+static bool checkHeader(BinaryHeader *header, size_t size, char errorMsg[BINARY_ERROR_MAX_SIZE]) {
+  if (size < sizeof(BinaryHeader) || memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+    FAIL(errorMsg, "Not a compiled document");
+  }
+  if (header->version != BINARY_VERSION) {
+    FAIL(errorMsg, "Unsupported version %u, expected %u", header->version, BINARY_VERSION);
+  }
+  if (header->byteOrderMark != BINARY_BYTE_ORDER_MARK || header->pointerSize != sizeof(void*)
+      || header->nodeSize != sizeof(JSONNode)) {
+    FAIL(errorMsg, "Compiled document was written on an incompatible platform");
+  }
+  if (header->nodesSize < sizeof(JSONNode) || header->nodesSize > size
+      || header->nodesOffset % _Alignof(JSONNode) != 0 || header->nodesSize % sizeof(char*) != 0
+      || header->nodesOffset + header->nodesSize > header->stringsOffset
+      || header->stringsOffset + header->stringsSize > size
+      || header->stringsSize == 0) {
+    FAIL(errorMsg, "Compiled document is truncated or corrupt");
+  }
+  return true;
+}
+
+#define IN_SECTION(offset, start, end) ((uint64_t)(uintptr_t)(offset) >= (start) && (uint64_t)(uintptr_t)(offset) < (end))
+
+// Checks the string offset and the tag of `node`
+static bool checkNode(BinaryHeader *header, JSONNode *node, char errorMsg[BINARY_ERROR_MAX_SIZE]) {
+  switch (node->tag) {
+    case JSON_NULL:
+    case JSON_NUMBER:
+    case JSON_OBJECT:
+    case JSON_LIST:
+      return true;
+
+    case JSON_BOOL:
+      // Any other byte would not be a valid `bool`
+      if (*(unsigned char*)&node->data.JSON_BOOL.boolean > 1) {
+        FAIL(errorMsg, "Compiled document is corrupt: invalid boolean");
+      }
+      return true;
+
+    case JSON_STRING:
+      if (!IN_SECTION(node->data.JSON_STRING.string, header->stringsOffset, header->stringsOffset + header->stringsSize)) {
+        FAIL(errorMsg, "Compiled document is corrupt: string out of bounds");
+      }
+      return true;
+  }
+  FAIL(errorMsg, "Compiled document is corrupt: unknown tag %u", (unsigned)node->tag);
+}
+
+// Checks that a key is preceded by its `InternedKey` header within the string table, and has the length
+// it gives, which generated decoders rely on
+static bool checkKey(char *base, BinaryHeader *header, char *key, char errorMsg[BINARY_ERROR_MAX_SIZE]) {
+  uint64_t offset = (uintptr_t)key;
+  uint64_t headerOffset = offset - offsetof(InternedKey, string);
+  if (!IN_SECTION(key, header->stringsOffset + offsetof(InternedKey, string), header->stringsOffset + header->stringsSize)
+      || headerOffset % _Alignof(InternedKey) != 0
+      || ((InternedKey*)(base + headerOffset))->length != strlen(base + offset)) {
+    FAIL(errorMsg, "Compiled document is corrupt: key out of bounds");
+  }
+  return true;
+}
+
+bool BinaryDocument_verify(const BinaryDocument *document, char errorMsg[BINARY_ERROR_MAX_SIZE]) {
+  char *base = document->base;
+  BinaryHeader *header = (BinaryHeader*)base;
+  JSONNode *root = document->root;
+  if (!checkNode(header, root, errorMsg)) {
+    return false;
+  }
+
+  // Every container is a node of the section, which bounds the length of the queue
+  JSONNode **queue = malloc(header->nodesSize / sizeof(JSONNode) * sizeof(JSONNode*));
+  size_t head = 0;
+  size_t tail = 0;
+  if (root->tag == JSON_OBJECT || root->tag == JSON_LIST) {
+    queue[tail++] = root;
+  }
+  uint64_t cursor = sizeof(JSONNode);
+  bool success = true;
+
+  while (success && head < tail) {
+    JSONNode *node = queue[head++];
+    if (node->length == 0) {
+      continue;
+    }
+
+    size_t itemSize = sizeof(JSONNode) + (node->tag == JSON_OBJECT ? sizeof(char*) : 0);
+    if ((uintptr_t)node->data.JSON_LIST.items != header->nodesOffset + cursor
+        || node->length > (header->nodesSize - cursor) / itemSize) {
+      snprintf(errorMsg, BINARY_ERROR_MAX_SIZE, "Compiled document is corrupt: items out of bounds");
+      success = false;
+      break;
+    }
+    JSONNode *items = JSONNode_items(node, base);
+    cursor += node->length * itemSize;
+
+    for (size_t i = 0; success && i < node->length; i++) {
+      success = checkNode(header, &items[i], errorMsg);
+      if (items[i].tag == JSON_OBJECT || items[i].tag == JSON_LIST) {
+        queue[tail++] = &items[i];
+      }
+    }
+
+    char **keys = node->tag == JSON_OBJECT ? (char**)(items + node->length) : NULL;
+    for (size_t i = 0; success && keys != NULL && i < node->length; i++) {
+      success = checkKey(base, header, keys[i], errorMsg);
+    }
+  }
+
+  if (success && cursor != header->nodesSize) {
+    snprintf(errorMsg, BINARY_ERROR_MAX_SIZE, "Compiled document is corrupt: unreferenced nodes");
+    success = false;
+  }
+  free(queue);
+  return success;
+}
+
+#undef IN_SECTION
+
+bool BinaryDocument_load(const char *path, BinaryDocument *dest, char errorMsg[BINARY_ERROR_MAX_SIZE]) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    FAIL(errorMsg, "File %s not found", path);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    FAIL(errorMsg, "Could not read %s", path);
+  }
+
+  // The tree is read in place, so pages are only read from the file once they are first used
+  size_t size = st.st_size;
+  void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    FAIL(errorMsg, "Could not map %s", path);
+  }
+
+  BinaryHeader *header = (BinaryHeader*)base;
+  if (!checkHeader(header, size, errorMsg)) {
+    munmap(base, size);
+    return false;
+  }
+  // Makes sure that every string in the table is terminated within the file
+  if (((char*)base)[header->stringsOffset + header->stringsSize - 1] != '\0') {
+    munmap(base, size);
+    FAIL(errorMsg, "Compiled document is truncated or corrupt");
+  }
+
+  *dest = (BinaryDocument) {
+    .base = base,
+    .size = size,
+    .root = (JSONNode*)((char*)base + header->nodesOffset),
+  };
+  return true;
+}
+
+DecodeResult BinaryDocument_decode(const BinaryDocument *document, void *dest, decodeFun decoder) {
+  return decodeTreeAt(document->root, document->base, dest, decoder);
+}
+
+void BinaryDocument_print(const BinaryDocument *document) {
+  fprintTreeAt(stdout, document->root, document->base);
+}
+
+void BinaryDocument_close(BinaryDocument *document) {
+  if (document->base != NULL) {
+    munmap(document->base, document->size);
+  }
+  document->base = NULL;
+  document->root = NULL;
+}
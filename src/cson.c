@@ -1,42 +1,180 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "batch.h"
+#include "binary.h"
+#include "parallel.h"
 #include "parser.h"
+#include "validate.h"
 
-#define MAXBUFLEN 1000000
+#define DIE(msg...) do { fprintf(stderr, msg); exit(1); } while(0);
 
-size_t read_whole_file(FILE* fp, char *filename, char *dest) {
+// Reads the whole file into a newly allocated, NUL-terminated buffer, storing its length in `length`
+// unless it is NULL
+char *read_whole_file(char *filename, size_t *length) {
+  FILE *fp = fopen(filename, "r");
   if (fp == NULL) {
     DIE("File %s not found\n", filename);
   }
 
-  size_t new_len = fread(dest, sizeof(char), MAXBUFLEN, fp);
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  rewind(fp);
+
+  char *dest = malloc(size + 1);
+  size_t new_len = fread(dest, sizeof(char), size, fp);
   if (ferror( fp ) != 0) {
     DIE("Error reading file");
   }
-  dest[new_len++] = '\0'; /* Just to be safe. */
-  return new_len;
+  dest[new_len] = '\0';
+  if (length != NULL) {
+    *length = new_len;
+  }
+  fclose(fp);
+  return dest;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    printf("Expected filename as input\n");
-    return 1;
+int printFile(char *filename, int threads) {
+  char *input = read_whole_file(filename, NULL);
+
+  int status = 0;
+  ParserResult res = threads > 1 ? parseParallel(input, NULL, threads) : parse(input);
+  if (res.status == PARSER_SUCCESS) {
+    JSONNode *tree = res.result.PARSER_SUCCESS.tree;
+    printTree(tree);
+    JSONNode_free(res.result.PARSER_SUCCESS.tree);
+    InternTable_free(res.result.PARSER_SUCCESS.keys);
+  } else {
+    printf("Parsing failed: %s\n", res.result.PARSER_ERROR.errorMsg);
+    status = 1;
   }
 
-  FILE *fp;
-  fp = fopen(argv[1], "r");
-  char input[MAXBUFLEN + 1];
-  size_t file_len = read_whole_file(fp, argv[2], input);
+  free(input);
+  return status;
+}
+
+int compileFile(char *filename, char *outFilename) {
+  char *input = read_whole_file(filename, NULL);
 
+  int status = 0;
   ParserResult res = parse(input);
   if (res.status == PARSER_SUCCESS) {
-    JSONNode *tree = res.result.PARSER_SUCCESS.tree;
-    printTree(tree);
+    char errorMsg[BINARY_ERROR_MAX_SIZE];
+    if (!Binary_write(res.result.PARSER_SUCCESS.tree, outFilename, errorMsg)) {
+      printf("Compiling failed: %s\n", errorMsg);
+      status = 1;
+    }
     JSONNode_free(res.result.PARSER_SUCCESS.tree);
+    InternTable_free(res.result.PARSER_SUCCESS.keys);
   } else {
     printf("Parsing failed: %s\n", res.result.PARSER_ERROR.errorMsg);
+    status = 1;
   }
 
-  fclose(fp);
+  free(input);
+  return status;
+}
+
+int validateFile(char *filename, bool allowTrailingCommas) {
+  size_t length;
+  char *input = read_whole_file(filename, &length);
+
+  ValidateResult res = validate(input, length, NULL, allowTrailingCommas);
+  if (res.valid) {
+    printf("Valid\n");
+  } else {
+    printf("Invalid: %s\n", res.errorMsg);
+  }
+
+  free(input);
+  return res.valid ? 0 : 1;
+}
+
+int printCompiledFile(char *filename) {
+  BinaryDocument document;
+  char errorMsg[BINARY_ERROR_MAX_SIZE];
+  if (!BinaryDocument_load(filename, &document, errorMsg)) {
+    printf("Loading failed: %s\n", errorMsg);
+    return 1;
+  }
+  if (!BinaryDocument_verify(&document, errorMsg)) {
+    printf("Loading failed: %s\n", errorMsg);
+    BinaryDocument_close(&document);
+    return 1;
+  }
+  BinaryDocument_print(&document);
+  BinaryDocument_close(&document);
+  return 0;
+}
+
+// Handles `cson --batch [--validate] [--trailing-commas] [--threads <n>] <path>...`, starting at the
+// arguments after `--batch`
+int runBatchCommand(int argc, char *argv[]) {
+  BatchOptions options = { .validateOnly = false, .threads = sysconf(_SC_NPROCESSORS_ONLN), .out = stdout };
+  int i = 0;
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "--validate") == 0) {
+      options.validateOnly = true;
+    } else if (strcmp(argv[i], "--trailing-commas") == 0) {
+      options.allowTrailingCommas = true;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.threads = atoi(argv[++i]);
+    } else {
+      return -1;
+    }
+  }
+  if (i == argc) {
+    return -1;
+  }
+
+  BatchSummary summary = runBatch(argv + i, argc - i, &options);
+  double megabytes = summary.bytes / 1e6;
+  fprintf(stderr, "%zu files, %zu failed, %.1f MB in %.3f s: %.1f MB/s, %.0f files/s\n", summary.files,
+          summary.failed, megabytes, summary.seconds, megabytes / summary.seconds, summary.files / summary.seconds);
+  return summary.failed > 0 ? 1 : 0;
+}
+
+void printUsage() {
+  printf("Usage:\n");
+  printf("  cson <file.json>                         Parse and print a file\n");
+  printf("  cson --compile <file.json> <out.csonb>   Write a file in the binary format\n");
+  printf("  cson --load <file.csonb>                 Print a file in the binary format\n");
+  printf("  cson --threads <n> <file.json>           Parse and print a file, lexing it on n threads\n");
+  printf("  cson --validate [--trailing-commas] <file.json>\n");
+  printf("                                           Check that a file is well-formed JSON\n");
+  printf("  cson --batch [--validate] [--trailing-commas] [--threads <n>] <path>...\n");
+  printf("                                           Parse and print, or validate, many files and the .json\n");
+  printf("                                           files in directories, on n threads (default: all cores)\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 2 && argv[1][0] != '-') {
+    return printFile(argv[1], 1);
+  }
+  if (argc == 4 && strcmp(argv[1], "--threads") == 0) {
+    return printFile(argv[3], atoi(argv[2]));
+  }
+  if (argc == 4 && strcmp(argv[1], "--compile") == 0) {
+    return compileFile(argv[2], argv[3]);
+  }
+  if (argc == 3 && strcmp(argv[1], "--validate") == 0) {
+    return validateFile(argv[2], false);
+  }
+  if (argc == 4 && strcmp(argv[1], "--validate") == 0 && strcmp(argv[2], "--trailing-commas") == 0) {
+    return validateFile(argv[3], true);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+    int status = runBatchCommand(argc - 2, argv + 2);
+    if (status >= 0) {
+      return status;
+    }
+  }
+  if (argc == 3 && strcmp(argv[1], "--load") == 0) {
+    return printCompiledFile(argv[2]);
+  }
+
+  printUsage();
+  return 1;
 }
@@ -1,6 +1,46 @@
+#include "arena.h"
+#include "batch.h"
+#include "binary.h"
 #include "decoders.h"
+#include "parallel.h"
+#include "schema.h"
+#include "stringbuilder.h"
+#include "structural.h"
+#include "tagtable.h"
+#include "validate.h"
 #include "stdio.h"
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Number of failed checks. The sections below print what they decode, and check it as well so that the
+// program can be run as a test.
+static int failures = 0;
+
+#define CHECK(condition) do {\
+  if (!(condition)) {\
+    printf("Check failed at line %d: %s\n", __LINE__, #condition);\
+    failures++;\
+  }\
+} while(0)
+
+// Checks that `res` failed with `message`, and frees its error
+static void checkError(DecodeResult res, const char *message, int line) {
+  if (res.success) {
+    printf("Check failed at line %d: expecting error \"%s\"\n", line, message);
+    failures++;
+    return;
+  }
+  if (strcmp(res.error.errorMsg, message) != 0) {
+    printf("Check failed at line %d: expecting error \"%s\", got \"%s\"\n", line, message, res.error.errorMsg);
+    failures++;
+  }
+  DecodeError_free(res.error);
+}
+
+#define CHECK_ERROR(res, message) checkError(res, message, __LINE__)
 
 char *pointStr =
 "{\n\
@@ -8,8 +48,10 @@ char *pointStr =
   \"y\": 420,\n\
 }";
 char *personStr = "{\n  \"firstName\": \"Walter\",\n  \"lastName\" : \"White\",\n  \"age\": 52\n}";
+char *wideRecordStr = "{\"id\": 7, \"tags\": [\"a\", {\"b\": []}], \"firstName\": \"Jesse\", \"notes\": {\"x\": 1}, \"lastName\": \"Pinkman\", \"age\": 24}";
 char *numbersStr = "[1, 2, 3, 4, 5]";
 char *pointListStr = "[{ \"x\": 19, \"y\": 95 }, { \"x\": 4, \"y\": 20 }, { \"x\": 18, \"y\": 99 }]";
+char *shapesStr = "[{\"shape\": \"point\", \"x\": 3, \"y\": 4}, {\"radius\": 2.5, \"shape\": \"circle\"}]";
 char *familyStr = "{\"father\":{\"firstName\":\"Walter\",\"lastName\":\"White\",\"age\":52},\"mother\":{\"firstName\":\"Skyler\",\"lastName\":\"White\",\"age\":40},\"children\":[{\"firstName\":\"Walter Jr.\",\"lastName\":\"White\",\"age\":17},{\"firstName\":\"Holly\",\"lastName\":\"White\",\"age\":1}]}";
 char *familyStrWrong = "{\"father\":{\"firstName\":\"Walter\",\"lastName\":\"White\",\"age\":52},\"mother\":{\"firstName\":\"Skyler\",\"lastName\":\"White\",\"age\":40},\"children\":[{\"firstName\":\"Walter Jr.\",\"lastName\":\"White\",\"age\":17},{\"firstName\":\"Holly\",\"lastName\":\"White\",\"age\": \"hello\"}]}";
 
@@ -40,6 +82,27 @@ bool decodeNumberList(DecoderState *state, void *dest) {
   return decodeList(state, &numberList->numbers, &numberList->length, sizeof(int), decodeInt);
 }
 
+bool decodeNumberArray(DecoderState *state, void *dest) {
+  NumberList *numberList = (NumberList*)dest;
+  return decodeIntArray(state, &numberList->numbers, &numberList->length);
+}
+
+// The length of the lists below is checked by the test instead of being kept
+bool decodeDoubleList(DecoderState *state, void *dest) {
+  int length;
+  return decodeDoubleArray(state, dest, &length);
+}
+
+bool decodeFloatList(DecoderState *state, void *dest) {
+  int length;
+  return decodeFloatArray(state, dest, &length);
+}
+
+bool decodeInt64List(DecoderState *state, void *dest) {
+  int length;
+  return decodeInt64Array(state, dest, &length);
+}
+
 void printNumberList(NumberList list) {
   for (int i = 0; i < list.length; i++) {
     printf("%d\n", list.numbers[i]);
@@ -91,6 +154,449 @@ bool decodeFamily(DecoderState *state, void *dest) {
   );
 }
 
+// The same family, with the structs, decoders and encoders generated from a description of the fields
+
+#define FAMILY_MEMBER_FIELDS(FIELD)\
+  FIELD(STRING, firstName, _)\
+  FIELD(STRING, lastName, _)\
+  FIELD(INT, age, _)
+
+CSON_STRUCT(FamilyMember, FAMILY_MEMBER_FIELDS)
+CSON_DECODER(FamilyMember, FAMILY_MEMBER_FIELDS)
+CSON_ENCODER(FamilyMember, FAMILY_MEMBER_FIELDS)
+
+#define HOUSEHOLD_FIELDS(FIELD)\
+  FIELD(OBJECT, father, FamilyMember)\
+  FIELD(OBJECT, mother, FamilyMember)\
+  FIELD(LIST, children, FamilyMember)
+
+CSON_STRUCT(Household, HOUSEHOLD_FIELDS)
+CSON_DECODER(Household, HOUSEHOLD_FIELDS)
+CSON_ENCODER(Household, HOUSEHOLD_FIELDS)
+
+typedef struct PointColumns {
+  int *xs;
+  int *ys;
+  int length;
+} PointColumns;
+
+bool decodePointColumns(DecoderState *state, void *dest) {
+  PointColumns *columns = (PointColumns*)dest;
+  return decodeColumns(state, &columns->length, 2,
+    makeColumn("x", &columns->xs, sizeof(int), decodeInt),
+    makeColumn("y", &columns->ys, sizeof(int), decodeInt)
+  );
+}
+
+typedef struct Circle {
+  double radius;
+} Circle;
+
+bool decodeCircle(DecoderState *state, void *dest) {
+  Circle *circle = (Circle*)dest;
+  return decodeFields(state, 1, makeField("radius", &circle->radius, decodeFloat));
+}
+
+// The index of each case in `shapeCases` is its tag in `Shape`
+enum { SHAPE_POINT, SHAPE_CIRCLE };
+
+typedef struct Shape {
+  int tag;
+  union {
+    Point point;
+    Circle circle;
+  } data;
+} Shape;
+
+TagCase shapeCases[] = {
+  [SHAPE_POINT] = { "point", decodePoint },
+  [SHAPE_CIRCLE] = { "circle", decodeCircle },
+};
+TagTable *shapeTable;
+
+bool decodeShape(DecoderState *state, void *dest) {
+  Shape *shape = (Shape*)dest;
+  return decodeTagged(state, "shape", shapeTable, &shape->tag, &shape->data);
+}
+
+typedef struct ShapeList {
+  Shape *shapes;
+  int length;
+} ShapeList;
+
+bool decodeShapeList(DecoderState *state, void *dest) {
+  ShapeList *list = (ShapeList*)dest;
+  return decodeList(state, &list->shapes, &list->length, sizeof(Shape), decodeShape);
+}
+
+// Numbers which are sometimes quoted. The string is only needed until it is converted, so it is
+// decoded into a buffer rather than allocated. Strings which are not numbers fail without a reason.
+bool decodeNumericString(DecoderState *state, void *dest) {
+  char str[32];
+  if (!decodeFixedString(state, str, sizeof(str), OVERFLOW_FAIL)) {
+    return false;
+  }
+  char *end;
+  *(double*)dest = strtod(str, &end);
+  return str[0] != '\0' && *end == '\0';
+}
+
+bool decodeNumber(DecoderState *state, void *dest) {
+  return oneOf(state, dest, sizeof(double), 2, decodeFloat, decodeNumericString);
+}
+
+// A number which may be quoted, followed by one which must be
+bool decodeNumberPair(DecoderState *state, void *dest) {
+  double *pair = (double*)dest;
+  if (!expectTag(state, JSON_LIST) || state->currentNode->length != 2) {
+    return false;
+  }
+  JSONNode *list = state->currentNode;
+  state->currentNode = &list->data.JSON_LIST.items[0];
+  bool success = decodeNumber(state, &pair[0]);
+  state->currentNode = &list->data.JSON_LIST.items[1];
+  success = success && decodeNumericString(state, &pair[1]);
+  state->currentNode = list;
+  return success;
+}
+
+typedef struct Alias {
+  char *first;
+  char *last;
+} Alias;
+
+bool decodeFullName(DecoderState *state, void *dest) {
+  Alias *alias = (Alias*)dest;
+  return decodeFields(state, 2,
+    makeField("first", &alias->first, decodeString),
+    makeField("last", &alias->last, decodeString)
+  );
+}
+
+bool decodeNickname(DecoderState *state, void *dest) {
+  Alias *alias = (Alias*)dest;
+  return decodeFields(state, 1, makeField("nickname", &alias->first, decodeString));
+}
+
+// The full name is tried first, and fails after decoding `first` when there is no `last`
+bool decodeAlias(DecoderState *state, void *dest) {
+  return oneOf(state, dest, sizeof(Alias), 2, decodeFullName, decodeNickname);
+}
+
+typedef struct Contact {
+  char *name;
+  char *email;
+  bool hasEmail;
+  int age;
+} Contact;
+
+static const int defaultContactAge = 18;
+
+bool decodeContact(DecoderState *state, void *dest) {
+  Contact *contact = (Contact*)dest;
+  return decodeFields(state, 3,
+    makeField("name", &contact->name, decodeString),
+    optionalField("email", &contact->email, decodeString, &contact->hasEmail),
+    defaultField("age", &contact->age, decodeInt, &defaultContactAge, sizeof(int))
+  );
+}
+
+bool decodePersonMap(DecoderState *state, void *dest) {
+  return decodeMap(state, dest, sizeof(Person), decodePerson);
+}
+
+#define DECODE_THREADS 4
+#define DECODES_PER_THREAD 500
+
+// Decodes the same shared inputs over and over with a context of its own, counting wrong results
+void *decodeConcurrently(void *arg) {
+  int *wrong = (int*)arg;
+  DecodeContext context = DecodeContext_new();
+  for (int i = 0; i < DECODES_PER_THREAD; i++) {
+    Family decoded;
+    DecodeResult res = decodeWithContext(&context, familyStr, &decoded, decodeFamily, NULL);
+    if (!res.success) {
+      (*wrong)++;
+      DecodeError_free(res.error);
+      continue;
+    }
+    if (strcmp(decoded.father.firstName, "Walter") != 0 || strcmp(decoded.mother.firstName, "Skyler") != 0 ||
+        decoded.childCount != 2 || strcmp(decoded.children[1].firstName, "Holly") != 0 || decoded.children[0].age != 17) {
+      (*wrong)++;
+    }
+    Person *people[] = { &decoded.father, &decoded.mother, &decoded.children[0], &decoded.children[1] };
+    for (int j = 0; j < 4; j++) {
+      free(people[j]->firstName);
+      free(people[j]->lastName);
+    }
+    free(decoded.children);
+
+    // Failures must not disturb the next decode with the same context
+    PointList points;
+    res = decodeWithContext(&context, i % 2 == 0 ? pointListStr : "[{\"x\": 1}]", &points, decodePointList, NULL);
+    if (i % 2 == 0) {
+      if (!res.success || points.len != 3 || points.points[2].y != 99) {
+        (*wrong)++;
+      }
+      free(points.points);
+    } else {
+      if (res.success || strcmp(res.error.errorMsg, "No field with name \"y\" was found") != 0) {
+        (*wrong)++;
+      }
+      DecodeError_free(res.error);
+    }
+  }
+  DecodeContext_free(&context);
+  return NULL;
+}
+
+// Sums the coordinates of the points decoded by a task
+void sumEachPoint(void *elem, void *ctx) {
+  Point *point = (Point*)elem;
+  *(int*)ctx += point->x + point->y;
+}
+
+// Appends each streamed point to a `PointList` with room for all of them
+void appendEachPoint(void *elem, void *ctx) {
+  PointList *list = (PointList*)ctx;
+  list->points[list->len++] = *(Point*)elem;
+}
+
+bool decodePointSum(DecoderState *state, void *dest) {
+  *(int*)dest = 0;
+  return decodeEach(state, sizeof(Point), decodePoint, sumEachPoint, dest);
+}
+
+// Counts the children of the families decoded by a task
+void countChildren(void *elem, void *ctx) {
+  Family *family = (Family*)elem;
+  *(int*)ctx += family->childCount;
+}
+
+// Runs `task` to the end with the given budget per step, returning the number of steps
+int runTask(DecodeTask *task, size_t budget) {
+  int steps = 1;
+  while (decodeStep(task, budget) != DECODE_DONE) {
+    steps++;
+  }
+  return steps;
+}
+
+// Whether `pointer` was allocated from one of the blocks of `arena`
+bool inArena(const Arena *arena, const void *pointer) {
+  for (ArenaBlock *block = arena->first; block != NULL; block = block->next) {
+    const char *data = (const char*)block->data;
+    if ((const char*)pointer >= data && (const char*)pointer < data + block->used) {
+      return true;
+    }
+  }
+  return false;
+}
+
+typedef struct ValidateCase {
+  char *input;
+  ParseLimits limits;
+  bool allowTrailingCommas;
+  // The error of an invalid input, or NULL if it is valid
+  char *errorMsg;
+} ValidateCase;
+
+ValidateCase validateCases[] = {
+  { "{\"a\": [1, 2.5e-3, -0, true, false, null, \"\\u00e9\\ud83d\\ude00\"]}", { 0 }, false, NULL },
+  { "{\t\"a\":\r\n[1,\t2]\r\n}", { 0 }, false, NULL },
+  { "{\"x\": 1,\n}", { 0 }, false, "Trailing comma at 1:8" },
+  { "{\"x\": 1,\n}", { 0 }, true, NULL },
+  // A leading zero ends the number
+  { "[01]", { 0 }, false, "Expecting , or ] at 1:3" },
+  { "[1.]", { 0 }, false, "Invalid number at 1:2" },
+  { "[+1]", { 0 }, false, "Unexpected character '+' at 1:2" },
+  { "[tru]", { 0 }, false, "Expected \"true\" at 1:2" },
+  { "{\"a\" 1}", { 0 }, false, "Expecting : at 1:6" },
+  { "[1, 2", { 0 }, false, "Unexpected end of input, expecting , or ] at 1:6" },
+  { "[1] [2]", { 0 }, false, "Trailing characters after the value at 1:5" },
+  { "[\"a\\u0000b\"]", { 0 }, false, "Escaped NUL character in string literal at 1:4" },
+  { "[\"\xff\"]", { 0 }, false, "Invalid UTF-8 in string literal at 1:3" },
+  { "[\"a\tb\"]", { 0 }, false, "Unescaped control character in string literal at 1:4" },
+  { "[1, 2, 3]", { .maxInputBytes = 4 }, false, "Input is longer than the maximum of 4 bytes at 1:5" },
+  // The limits below are reported just as `parseWithOptions` does
+  { "[[[1]]]", { .maxDepth = 2 }, false, "Maximum nesting depth of 2 exceeded at 1:3" },
+  // Strings are measured once unescaped, here 5 bytes
+  { "[\"\\u00e9t\\u00e9\"]", { .maxStringLength = 5 }, false, NULL },
+  { "[\"\\u00e9t\\u00e9\"]", { .maxStringLength = 4 }, false, "String longer than the maximum of 4 bytes at 1:2" },
+  { "{\"a\": [1, 2, 3]}", { .maxContainerLength = 2 }, false, "More than the maximum of 2 elements in list at 1:7" },
+  { "[{\"a\": 1, \"b\": 2}]", { .maxContainerLength = 1 }, false, "More than the maximum of 1 elements in object at 1:2" },
+  { "[1, {\"a\": 2}]", { .maxNodes = 4 }, false, NULL },
+  // The key counts as a value until its colon is found
+  { "[1, {\"a\": 2}]", { .maxNodes = 3 }, false, "More than the maximum of 3 values at 1:6" },
+};
+
+typedef struct Sensor {
+  char name[8];
+  int readings[4];
+  int readingCount;
+} Sensor;
+
+bool decodeSensor(DecoderState *state, void *dest) {
+  Sensor *sensor = (Sensor*)dest;
+  return decodeFields(state, 2,
+    fixedStringField("name", sensor->name, OVERFLOW_FAIL),
+    fixedListField("readings", sensor->readings, &sensor->readingCount, decodeInt, OVERFLOW_FAIL)
+  );
+}
+
+bool decodeTruncatedSensor(DecoderState *state, void *dest) {
+  Sensor *sensor = (Sensor*)dest;
+  return decodeFields(state, 2,
+    fixedStringField("name", sensor->name, OVERFLOW_TRUNCATE),
+    fixedListField("readings", sensor->readings, &sensor->readingCount, decodeInt, OVERFLOW_TRUNCATE)
+  );
+}
+
+// Generated decoders of fixed fields always fail on overflow
+#define TRIANGLE_FIELDS(FIELD)\
+  FIELD(FIXED_STRING, name, 8)\
+  FIELD(FIXED_LIST, points, (Point, 3))
+
+CSON_STRUCT(Triangle, TRIANGLE_FIELDS)
+CSON_DECODER(Triangle, TRIANGLE_FIELDS)
+
+void printEachPoint(void *elem, void *ctx) {
+  int *count = (int*)ctx;
+  printf("%d: ", (*count)++);
+  printPoint(*(Point*)elem);
+}
+
+// `depth` lists or objects with a single member "a", nested around a 1
+char *nestedInput(size_t depth, bool objects) {
+  const char *open = objects ? "{\"a\": " : "[";
+  size_t openLength = strlen(open);
+  char *input = malloc(depth * (openLength + 1) + 2);
+  char *end = input;
+  for (size_t i = 0; i < depth; i++) {
+    memcpy(end, open, openLength);
+    end += openLength;
+  }
+  *end++ = '1';
+  memset(end, objects ? '}' : ']', depth);
+  end[depth] = '\0';
+  return input;
+}
+
+void writeFile(const char *path, const void *bytes, size_t size) {
+  FILE *file = fopen(path, "wb");
+  fwrite(bytes, 1, size, file);
+  fclose(file);
+}
+
+// Runs a batch over `paths`, returning what it printed
+char *runBatchOutput(char **paths, int count, BatchOptions options, BatchSummary *summary) {
+  char *output;
+  size_t outputLength;
+  options.out = open_memstream(&output, &outputLength);
+  *summary = runBatch(paths, count, &options);
+  fclose(options.out);
+  return output;
+}
+
+// A list of `count` records with every kind of token, escapes, non-ASCII characters and newlines, and now
+// and then a string longer than a window of the structural index, followed by `last`
+char *generateTokens(size_t count, const char *last) {
+  char *longString = malloc(STRUCTURAL_WINDOW_SIZE + 64);
+  memset(longString, 'x', STRUCTURAL_WINDOW_SIZE + 63);
+  longString[STRUCTURAL_WINDOW_SIZE + 63] = '\0';
+  memcpy(longString + STRUCTURAL_WINDOW_SIZE - 3, "\\\\\\\"", 4);
+  StringBuilder builder = StringBuilder_new();
+  StringBuilder_append(&builder, "[");
+  for (size_t i = 0; i < count; i++) {
+    StringBuilder_append(&builder, "%s{\"id\": %zu, \"name\": \"N\\u00e9 \\\"%zu\\\" \\\\\", \"caf\xc3\xa9\": -%zu.5e-3,%s"
+                         "\"flags\": [true, false, null, [], {}], \"text\": \"%s\"}",
+                         i > 0 ? ",\n" : "", i, i, i, i % 3 == 0 ? "\r\n\t" : i % 3 == 1 ? "\t" : " ", i % 500 == 0 ? longString : "\\t\\/");
+  }
+  StringBuilder_append(&builder, "%s]", last);
+  free(longString);
+  return StringBuilder_getString(&builder);
+}
+
+// Lexes a token at a time, as `lex` does for inputs too small for the structural index
+bool lexByToken(char *input, TokenList *list, char *errorMsg) {
+  LexerState state = LexerState_new(input, list, false);
+  while (!lexerAtEnd(&state)) {
+    if (!lexToken(&state)) {
+      strcpy(errorMsg, state.errorMsg);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool sameTokens(const TokenList *expected, const TokenList *actual) {
+  if (expected->length != actual->length) {
+    return false;
+  }
+  for (size_t i = 0; i < expected->length; i++) {
+    Token *a = &expected->tokens[i];
+    Token *b = &actual->tokens[i];
+    if (a->tokenType != b->tokenType || a->row != b->row || a->col != b->col) {
+      return false;
+    }
+    if ((a->tokenType == TOKEN_STRING_LITERAL
+         && strcmp(a->data.TOKEN_STRING_LITERAL.string, b->data.TOKEN_STRING_LITERAL.string) != 0)
+        || (a->tokenType == TOKEN_NUMBER_LITERAL && a->data.TOKEN_NUMBER_LITERAL.number != b->data.TOKEN_NUMBER_LITERAL.number)
+        || (a->tokenType == TOKEN_BOOL_LITERAL && a->data.TOKEN_BOOL_LITERAL.boolean != b->data.TOKEN_BOOL_LITERAL.boolean)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Lexes `input` against `limits`, a token at a time or with the structural index, until it fails with
+// `errorMsg`. Returns how many tokens were lexed by then, or SIZE_MAX if it did not fail.
+size_t tokensBeforeFailure(char *input, const ParseLimits *limits, bool indexed, const char *errorMsg) {
+  TokenList list = TokenList_new(TOKEN_START_CAPACITY, false);
+  LexerState state = LexerState_new(input, &list, false);
+  state.limits = limits;
+  bool success = true;
+  if (indexed) {
+    success = lexIndexedRange(&state, input + strlen(input), NULL);
+  } else {
+    while (success && !lexerAtEnd(&state)) {
+      success = lexToken(&state);
+    }
+  }
+  size_t tokens = success || strcmp(state.errorMsg, errorMsg) != 0 ? SIZE_MAX : list.length;
+  if (!success) {
+    printf("%s\n", state.errorMsg);
+  }
+  LexerState_free(&state);
+  TokenList_free(&list);
+  return tokens;
+}
+
+// Checks that the indexed lexer of `lex` and `lexParallel` give the same tokens or error as `lexByToken`
+void checkSameLexing(char *input, int line) {
+  TokenList expected = TokenList_new(TOKEN_START_CAPACITY, false);
+  char expectedError[MAX_ERR_SIZE] = "";
+  bool expectedSuccess = lexByToken(input, &expected, expectedError);
+  LexResult results[] = { lex(input), lexParallel(input, false, NULL, 4) };
+  for (int i = 0; i < 2; i++) {
+    bool same = expectedSuccess
+      ? results[i].status == LEXER_SUCCESS && sameTokens(&expected, &results[i].result.LEXER_SUCCESS.tokenList)
+      : results[i].status == LEXER_FAIL && strcmp(results[i].result.LEXER_FAIL.errorMsg, expectedError) == 0;
+    if (!same) {
+      printf("Check failed at line %d: %s differs from lexing a token at a time\n", line,
+             i == 0 ? "lex" : "lexParallel");
+      failures++;
+    }
+    if (results[i].status == LEXER_SUCCESS) {
+      TokenList_free(&results[i].result.LEXER_SUCCESS.tokenList);
+    }
+  }
+  if (!expectedSuccess) {
+    printf("%s\n", expectedError);
+  }
+  TokenList_free(&expected);
+}
+
 int main() {
   Point decodedPoint;
   DecodeResult pointRes = decode(pointStr, &decodedPoint, decodePoint);
@@ -115,6 +621,53 @@ int main() {
   printPerson(decodedPerson);
   printf("\n");
 
+  // --------------
+  Projection projection = Projection_new();
+  Projection_add(&projection, "firstName");
+  Projection_add(&projection, "lastName");
+  Projection_add(&projection, "age");
+
+  Person projectedPerson;
+  ParseOptions projectedOptions = { .projection = &projection };
+  DecodeResult projectedRes = decodeWithOptions(wideRecordStr, &projectedPerson, decodePerson, &projectedOptions);
+  Projection_free(&projection);
+
+  printf("Decoded person using a projection: \n");
+  printf("----------------------------\n");
+  CHECK(projectedRes.success);
+  if (projectedRes.success) {
+    printPerson(projectedPerson);
+    CHECK(strcmp(projectedPerson.firstName, "Jesse") == 0 && strcmp(projectedPerson.lastName, "Pinkman") == 0);
+    CHECK(projectedPerson.age == 24);
+  } else {
+    printDecoderError(projectedRes.error);
+    DecodeError_free(projectedRes.error);
+  }
+
+  // Only the members in the projection are kept, and the object only has room for those
+  Projection nameProjection = Projection_new();
+  Projection_add(&nameProjection, "firstName");
+  ParseOptions nameOptions = { .projection = &nameProjection };
+  ParserResult projectedTree = parseWithOptions(wideRecordStr, &nameOptions);
+  CHECK(projectedTree.status == PARSER_SUCCESS);
+  if (projectedTree.status == PARSER_SUCCESS) {
+    JSONNode *record = projectedTree.result.PARSER_SUCCESS.tree;
+    CHECK(record->tag == JSON_OBJECT && record->length == 1);
+    CHECK(strcmp(JSONNode_keys(record)[0], "firstName") == 0);
+    CHECK(strcmp(record->data.JSON_OBJECT.items[0].data.JSON_STRING.string, "Jesse") == 0);
+    JSONNode_free(record);
+    InternTable_free(projectedTree.result.PARSER_SUCCESS.keys);
+  }
+  // Values which are skipped are still checked for unterminated strings and brackets which do not add up
+  projectedTree = parseWithOptions("{\"id\": [1, \"x\n\"], \"firstName\": \"Jesse\"}", &nameOptions);
+  CHECK(projectedTree.status == PARSER_FAIL &&
+        strcmp(projectedTree.result.PARSER_ERROR.errorMsg, "Unterminated string literal at 1:12") == 0);
+  projectedTree = parseWithOptions("{\"id\": [1, [2}, \"firstName\": \"Jesse\"}", &nameOptions);
+  CHECK(projectedTree.status == PARSER_FAIL &&
+        strcmp(projectedTree.result.PARSER_ERROR.errorMsg, "Expecting } at end of input") == 0);
+  Projection_free(&nameProjection);
+  printf("\n");
+
   // --------------
   NumberList numberList;
   decode(numbersStr, &numberList, decodeNumberList);
@@ -124,6 +677,42 @@ int main() {
   printNumberList(numberList);
   printf("\n");
 
+  // --------------
+  NumberList numberArray;
+  decode(numbersStr, &numberArray, decodeNumberArray);
+
+  printf("Decoded list using decodeIntArray: \n");
+  printf("----------------------------\n");
+  printNumberList(numberArray);
+  printf("\n");
+  CHECK(numberList.length == 5 && numberArray.length == 5);
+  CHECK(memcmp(numberList.numbers, numberArray.numbers, 5 * sizeof(int)) == 0 && numberArray.numbers[4] == 5);
+  free(numberList.numbers);
+  free(numberArray.numbers);
+
+  // The other array decoders, and the errors of all of them
+  ParserResult arrayTree = parse("[-2, 0.5, 4e9, 1e300]");
+  JSONNode *arrayNode = arrayTree.result.PARSER_SUCCESS.tree;
+  double *doubles;
+  float *floats;
+  int64_t *int64s;
+  CHECK(decodeTree(arrayNode, NULL, &doubles, decodeDoubleList).success);
+  CHECK(doubles[0] == -2 && doubles[1] == 0.5 && doubles[2] == 4e9 && doubles[3] == 1e300);
+  free(doubles);
+  CHECK(decodeTree(arrayNode, NULL, &floats, decodeFloatList).success);
+  CHECK(floats[1] == 0.5f && floats[2] == 4e9f);
+  free(floats);
+  CHECK_ERROR(decodeTree(arrayNode, NULL, &int64s, decodeInt64List), "Expected integer, got 0.5");
+  JSONNode_free(arrayNode);
+  InternTable_free(arrayTree.result.PARSER_SUCCESS.keys);
+  CHECK(decode("[-2, 4e9]", &int64s, decodeInt64List).success && int64s[1] == 4000000000);
+  free(int64s);
+  // 4e9 does not fit an int, and 1e300 an int64_t
+  CHECK_ERROR(decode("[-2, 4e9]", &numberArray, decodeNumberArray), "Expected integer, got 4e+09");
+  CHECK_ERROR(decode("[-2, 1e300]", &int64s, decodeInt64List), "Expected integer, got 1e+300");
+  CHECK_ERROR(decode("[1, \"2\"]", &numberArray, decodeNumberArray), "Expecting number, got string");
+  CHECK_ERROR(decode("{}", &numberArray, decodeNumberArray), "Expecting list, got object");
+
   // --------------
   PointList pointList;
   decode(pointListStr, &pointList, decodePointList);
@@ -135,6 +724,127 @@ int main() {
   }
   printf("\n");
 
+  // --------------
+  PointColumns pointColumns;
+  CHECK(decode(pointListStr, &pointColumns, decodePointColumns).success);
+  CHECK(pointColumns.length == 3 && pointColumns.xs[0] == 19 && pointColumns.xs[1] == 4 && pointColumns.xs[2] == 18);
+  CHECK(pointColumns.ys[0] == 95 && pointColumns.ys[1] == 20 && pointColumns.ys[2] == 99);
+  PointColumns wrongColumns;
+  DecodeResult columnsRes = decode("[{\"x\": 1, \"y\": 2}, {\"y\": 4, \"x\": \"3\"}]", &wrongColumns, decodePointColumns);
+  CHECK(!columnsRes.success);
+  if (!columnsRes.success) {
+    char *message = buildDecoderError(columnsRes.error);
+    CHECK(strcmp(message, "At root[1][\"x\"]: Expecting number, got string") == 0);
+    free(message);
+    DecodeError_free(columnsRes.error);
+  }
+  CHECK_ERROR(decode("[{\"x\": 1}]", &wrongColumns, decodePointColumns), "No field with name \"y\" was found");
+  CHECK_ERROR(decode("[[1, 2]]", &wrongColumns, decodePointColumns), "Expecting object, got list");
+  // An empty list gives empty columns
+  CHECK(decode("[]", &wrongColumns, decodePointColumns).success && wrongColumns.length == 0);
+
+  printf("Decoded list of points column-wise: \n");
+  printf("----------------------------\n");
+  printf("xs:");
+  for (int i = 0; i < pointColumns.length; i++) {
+    printf(" %d", pointColumns.xs[i]);
+  }
+  printf("\nys:");
+  for (int i = 0; i < pointColumns.length; i++) {
+    printf(" %d", pointColumns.ys[i]);
+  }
+  printf("\n\n");
+
+  // --------------
+  shapeTable = TagTable_new(2, shapeCases);
+  ShapeList shapeList;
+  CHECK(decode(shapesStr, &shapeList, decodeShapeList).success);
+  CHECK(shapeList.length == 2 && shapeList.shapes[0].tag == SHAPE_POINT && shapeList.shapes[1].tag == SHAPE_CIRCLE);
+  CHECK(shapeList.shapes[0].data.point.x == 3 && shapeList.shapes[0].data.point.y == 4);
+  CHECK(shapeList.shapes[1].data.circle.radius == 2.5);
+  ShapeList wrongShapes;
+  DecodeResult shapesRes = decode("[{\"shape\": \"circle\", \"radius\": 1}, {\"shape\": \"triangle\"}]", &wrongShapes,
+                                  decodeShapeList);
+  CHECK(!shapesRes.success);
+  if (!shapesRes.success) {
+    char *message = buildDecoderError(shapesRes.error);
+    CHECK(strcmp(message, "At root[1][\"shape\"]: Unknown tag \"triangle\"") == 0);
+    free(message);
+    DecodeError_free(shapesRes.error);
+  }
+  // The case is decoded from the same object as the tag
+  shapesRes = decode("[{\"shape\": \"circle\", \"radius\": \"big\"}]", &wrongShapes, decodeShapeList);
+  CHECK(!shapesRes.success);
+  if (!shapesRes.success) {
+    char *message = buildDecoderError(shapesRes.error);
+    CHECK(strcmp(message, "At root[0][\"radius\"]: Expecting number, got string") == 0);
+    free(message);
+    DecodeError_free(shapesRes.error);
+  }
+  CHECK_ERROR(decode("[{\"radius\": 1}]", &wrongShapes, decodeShapeList), "No field with name \"shape\" was found");
+  CHECK_ERROR(decode("[{\"shape\": 1}]", &wrongShapes, decodeShapeList), "Expecting string, got number");
+  CHECK_ERROR(decode("[\"circle\"]", &wrongShapes, decodeShapeList), "Expecting object, got string");
+  TagTable_free(shapeTable);
+
+  printf("Decoded list of shapes: \n");
+  printf("----------------------------\n");
+  for (int i = 0; i < shapeList.length; i++) {
+    Shape shape = shapeList.shapes[i];
+    switch (shape.tag) {
+      case SHAPE_POINT:
+        printPoint(shape.data.point);
+        break;
+
+      case SHAPE_CIRCLE:
+        printf("Circle { .radius = %g }\n", shape.data.circle.radius);
+        break;
+    }
+  }
+  printf("\n");
+
+  // --------------
+  printf("Streamed list of points: \n");
+  printf("----------------------------\n");
+
+  int streamedCount = 0;
+  DecodeResult streamRes = decodeStream(pointListStr, sizeof(Point), decodePoint, printEachPoint, &streamedCount);
+  CHECK(streamRes.success && streamedCount == 3);
+  if (!streamRes.success) {
+    printDecoderError(streamRes.error);
+    DecodeError_free(streamRes.error);
+  }
+  Point streamedPoints[3];
+  PointList streamedList = { .points = streamedPoints, .len = 0 };
+  CHECK(decodeStream(pointListStr, sizeof(Point), decodePoint, appendEachPoint, &streamedList).success);
+  CHECK(streamedList.len == 3 && streamedPoints[0].x == 19 && streamedPoints[0].y == 95);
+  CHECK(streamedPoints[1].x == 4 && streamedPoints[1].y == 20 && streamedPoints[2].x == 18 && streamedPoints[2].y == 99);
+  // The elements before the one which fails are passed to the callback
+  streamedList.len = 0;
+  streamRes = decodeStream("[{\"x\": 1, \"y\": 2}, {\"x\": 3}, {\"x\": 5, \"y\": 6}]", sizeof(Point), decodePoint,
+                           appendEachPoint, &streamedList);
+  CHECK(!streamRes.success && streamedList.len == 1 && streamedPoints[0].y == 2);
+  if (!streamRes.success) {
+    char *message = buildDecoderError(streamRes.error);
+    CHECK(strcmp(message, "At root[1]: No field with name \"y\" was found") == 0);
+    free(message);
+    DecodeError_free(streamRes.error);
+  }
+  CHECK_ERROR(decodeStream("{\"x\": 1}", sizeof(Point), decodePoint, appendEachPoint, &streamedList),
+              "Parsing failed: Expecting [ at start of input");
+
+  int pointSum;
+  CHECK(decode(pointListStr, &pointSum, decodePointSum).success && pointSum == 19 + 95 + 4 + 20 + 18 + 99);
+  streamRes = decode("[{\"x\": 1, \"y\": 2}, {\"x\": 3, \"y\": \"4\"}]", &pointSum, decodePointSum);
+  CHECK(!streamRes.success && pointSum == 3);
+  if (!streamRes.success) {
+    char *message = buildDecoderError(streamRes.error);
+    CHECK(strcmp(message, "At root[1][\"y\"]: Expecting number, got string") == 0);
+    free(message);
+    DecodeError_free(streamRes.error);
+  }
+  CHECK_ERROR(decode("{}", &pointSum, decodePointSum), "Expecting list, got object");
+  printf("\n");
+
   // --------------
 
   Family family;
@@ -157,16 +867,738 @@ int main() {
 
   // --------------
 
+  Household household;
+  DecodeResult householdRes = decode(familyStr, &household, decodeHousehold);
+
+  printf("Decoded family using generated decoders, and encoded again: \n");
+  printf("----------------------------\n");
+  CHECK(householdRes.success);
+  if (householdRes.success) {
+    CHECK(strcmp(household.father.firstName, "Walter") == 0 && strcmp(household.father.lastName, "White") == 0);
+    CHECK(household.father.age == 52 && strcmp(household.mother.firstName, "Skyler") == 0 && household.mother.age == 40);
+    CHECK(household.childrenCount == 2 && strcmp(household.children[0].firstName, "Walter Jr.") == 0);
+    CHECK(strcmp(household.children[1].firstName, "Holly") == 0 && household.children[1].age == 1);
+    char *encoded = encode(&household, encodeHousehold);
+    CHECK(strcmp(encoded, familyStr) == 0);
+    printf("%s\n", encoded);
+    free(encoded);
+  } else {
+    printDecoderError(householdRes.error);
+    DecodeError_free(householdRes.error);
+  }
+  // The path of the error is that of the handwritten decoders
+  householdRes = decode(familyStrWrong, &household, decodeHousehold);
+  CHECK(!householdRes.success);
+  if (!householdRes.success) {
+    char *message = buildDecoderError(householdRes.error);
+    CHECK(strcmp(message, "At root[\"children\"][1][\"age\"]: Expecting number, got string") == 0);
+    free(message);
+    DecodeError_free(householdRes.error);
+  }
+  CHECK_ERROR(decode("{\"father\": {\"firstName\": \"Walter\", \"age\": 52}}", &household, decodeHousehold),
+              "No field with name \"lastName\" was found");
+  printf("\n");
+
+  // --------------
+
   printf("Error message example: \n");
   printf("----------------------------\n");
 
   Family wrongFam;
   DecodeResult wrongFamRes = decode(familyStrWrong, &wrongFam, decodeFamily);
 
+  CHECK(!wrongFamRes.success);
   if (!wrongFamRes.success) {
     printDecoderError(wrongFamRes.error);
     DecodeError_free(wrongFamRes.error);
   }
+  printf("\n");
+
+  // --------------
+
+  printf("Alternatives, optional and default fields: \n");
+  printf("----------------------------\n");
+
+  double numbers[2];
+  DecodeResult numberRes = decode("1.5", &numbers[0], decodeNumber);
+  CHECK(numberRes.success && numbers[0] == 1.5);
+  numberRes = decode("\"2.5\"", &numbers[1], decodeNumber);
+  CHECK(numberRes.success && numbers[1] == 2.5);
+  printf("Numbers: %g %g\n", numbers[0], numbers[1]);
+  double number = 0;
+  CHECK_ERROR(decode("true", &number, decodeNumber), "Expecting string, got bool");
+  CHECK(number == 0);
+  // Not the failure of the first alternative, since the last one fails without recording any
+  CHECK_ERROR(decode("\"2.5x\"", &number, decodeNumber), "Decoder failed");
+  // Nor a failure which an earlier `oneOf` recovered from
+  CHECK_ERROR(decode("[\"1\", \"two\"]", &numbers, decodeNumberPair), "Decoder failed");
+  CHECK_ERROR(decode("\"123456789012345678901234567890123\"", &number, decodeNumber),
+              "Expecting a string of at most 31 bytes, got 33");
+
+  // The string decoded by the failed alternative is freed and `first` is restored before the next one
+  Alias alias = { .first = NULL, .last = NULL };
+  DecodeResult aliasRes = decode("{\"first\": \"Walter\", \"nickname\": \"Heisenberg\"}", &alias, decodeAlias);
+  CHECK(aliasRes.success && strcmp(alias.first, "Heisenberg") == 0 && alias.last == NULL);
+  printf("Alias: %s\n", alias.first);
+  free(alias.first);
+  alias = (Alias) { .first = NULL, .last = NULL };
+  CHECK_ERROR(decode("{\"first\": \"Walter\"}", &alias, decodeAlias), "No field with name \"nickname\" was found");
+
+  Contact contacts[2];
+  decode("{\"name\": \"Saul\", \"email\": \"saul@example.com\", \"age\": 48}", &contacts[0], decodeContact);
+  contacts[1].email = NULL;
+  decode("{\"name\": \"Mike\"}", &contacts[1], decodeContact);
+  for (int i = 0; i < 2; i++) {
+    printf("%s, %s, %d\n", contacts[i].name, contacts[i].hasEmail ? contacts[i].email : "no email", contacts[i].age);
+  }
+  CHECK(contacts[0].hasEmail && strcmp(contacts[0].email, "saul@example.com") == 0 && contacts[0].age == 48);
+  CHECK(!contacts[1].hasEmail && contacts[1].email == NULL && contacts[1].age == defaultContactAge);
+  Contact wrongContact;
+  CHECK_ERROR(decode("{\"name\": \"Mike\", \"age\": \"old\"}", &wrongContact, decodeContact),
+              "Expecting number, got string");
+  printf("\n");
+
+  // --------------
+
+  printf("Decoded map of people: \n");
+  printf("----------------------------\n");
+
+  // "walt" occurs twice, and only its last value is decoded
+  char *peopleStr = "{\"walt\": {\"firstName\": \"Walter\", \"lastName\": \"White\", \"age\": 50},"
+                    " \"jesse\": {\"firstName\": \"Jesse\", \"lastName\": \"Pinkman\", \"age\": 24},"
+                    " \"walt\": {\"firstName\": \"Heisenberg\", \"lastName\": \"White\", \"age\": 52}}";
+  JSONMap people;
+  DecodeResult peopleRes = decode(peopleStr, &people, decodePersonMap);
+  CHECK(peopleRes.success);
+  if (peopleRes.success) {
+    for (size_t i = 0; i < people.capacity; i++) {
+      if (people.keys[i] != NULL) {
+        printf("%s: ", people.keys[i]); printPerson(*(Person*)JSONMap_valueAt(&people, i));
+      }
+    }
+    Person *walt = JSONMap_get(&people, "walt");
+    Person *jesse = JSONMap_get(&people, "jesse");
+    CHECK(people.length == 2);
+    CHECK(walt != NULL && strcmp(walt->firstName, "Heisenberg") == 0 && walt->age == 52);
+    CHECK(jesse != NULL && strcmp(jesse->lastName, "Pinkman") == 0);
+    CHECK(JSONMap_get(&people, "skyler") == NULL);
+    JSONMap_free(&people);
+  }
+
+  JSONMap wrongPeople;
+  DecodeResult wrongPeopleRes = decode("{\"walt\": {\"firstName\": \"Walter\"}}", &wrongPeople, decodePersonMap);
+  CHECK(!wrongPeopleRes.success);
+  if (!wrongPeopleRes.success) {
+    char *message = buildDecoderError(wrongPeopleRes.error);
+    CHECK(strcmp(message, "At root[\"walt\"]: No field with name \"lastName\" was found") == 0);
+    free(message);
+    DecodeError_free(wrongPeopleRes.error);
+    JSONMap_free(&wrongPeople);
+  }
+  CHECK_ERROR(decode("[]", &wrongPeople, decodePersonMap), "Expecting object, got list");
+  printf("\n");
+
+  // --------------
+
+  printf("Lists too long for an int length: \n");
+  printf("----------------------------\n");
+
+  // Parsing a list this long would take tens of gigabytes, but the length is checked before the items are
+  // read, so a node which only claims it is enough
+  JSONNode hugeList = { .tag = JSON_LIST, .length = (size_t)INT_MAX + 1, .data = { .JSON_LIST = { .items = NULL } } };
+  NumberList hugeNumbers;
+  DecodeResult hugeRes = decodeTree(&hugeList, NULL, &hugeNumbers, decodeNumberList);
+  if (!hugeRes.success) {
+    printDecoderError(hugeRes.error);
+  }
+  CHECK_ERROR(hugeRes, "List of 2147483648 elements is too long for an int length");
+  CHECK_ERROR(decodeTree(&hugeList, NULL, &hugeNumbers, decodeNumberArray),
+              "List of 2147483648 elements is too long for an int length");
+  // The largest length which still fits goes past the check, and fails on the items instead
+  JSONNode notNumbers[1] = { { .tag = JSON_NULL } };
+  JSONNode longestList = { .tag = JSON_LIST, .length = INT_MAX, .data = { .JSON_LIST = { .items = notNumbers } } };
+  CHECK_ERROR(decodeTree(&longestList, NULL, &hugeNumbers, decodeNumberArray), "Expecting number, got null");
+  printf("\n");
+
+  // --------------
+
+  printf("Decoded families in steps: \n");
+  printf("----------------------------\n");
+
+  // Lexing and parsing take several steps on a small budget, and each family is decoded in a step of its own
+  char *familiesStr = malloc(2 * strlen(familyStr) + 4);
+  sprintf(familiesStr, "[%s,%s]", familyStr, familyStr);
+  int childCount = 0;
+  DecodeTask *familyTask = DecodeTask_newEach(familiesStr, sizeof(Family), decodeFamily, countChildren, &childCount,
+                                              NULL);
+  int familySteps = runTask(familyTask, 4);
+  DecodeResult steppedRes = DecodeTask_finish(familyTask);
+  CHECK(steppedRes.success);
+  CHECK(familySteps > 2 && childCount == 4);
+  printf("%d steps, %d children\n", familySteps, childCount);
+
+  // The elements of a list are decoded a few at a time, and a large budget only takes a step per phase
+  int pointSums[2] = { 0, 0 };
+  DecodeTask *pointsTask = DecodeTask_newEach(pointListStr, sizeof(Point), decodePoint, sumEachPoint, &pointSums[0], NULL);
+  int pointSteps = runTask(pointsTask, 1);
+  CHECK(DecodeTask_finish(pointsTask).success);
+  pointsTask = DecodeTask_newEach(pointListStr, sizeof(Point), decodePoint, sumEachPoint, &pointSums[1], NULL);
+  int fewSteps = runTask(pointsTask, 1000);
+  CHECK(DecodeTask_finish(pointsTask).success);
+  printf("Sum of the points in %d steps: %d, in %d steps: %d\n", pointSteps, pointSums[0], fewSteps, pointSums[1]);
+  CHECK(fewSteps == 3 && pointSteps > fewSteps && pointSums[0] == 255 && pointSums[1] == 255);
+
+  sprintf(familiesStr, "[%s]", familyStrWrong);
+  familyTask = DecodeTask_newEach(familiesStr, sizeof(Family), decodeFamily, countChildren, &childCount, NULL);
+  runTask(familyTask, 4);
+  steppedRes = DecodeTask_finish(familyTask);
+  CHECK(!steppedRes.success);
+  if (!steppedRes.success) {
+    char *message = buildDecoderError(steppedRes.error);
+    CHECK(strcmp(message, "At root[0][\"children\"][1][\"age\"]: Expecting number, got string") == 0);
+    free(message);
+    DecodeError_free(steppedRes.error);
+  }
+  familyTask = DecodeTask_newEach(familyStr, sizeof(Family), decodeFamily, countChildren, &childCount, NULL);
+  runTask(familyTask, 4);
+  CHECK_ERROR(DecodeTask_finish(familyTask), "Expecting list, got object");
+  pointsTask = DecodeTask_newEach("[1, 2]", sizeof(Point), decodePoint, sumEachPoint, &pointSums[0], NULL);
+  runTask(pointsTask, 1);
+  CHECK_ERROR(DecodeTask_finish(pointsTask), "Expecting object, got number");
+  pointsTask = DecodeTask_newEach("[{\"x\": 1, \"y\": 2}", sizeof(Point), decodePoint, sumEachPoint, &pointSums[0], NULL);
+  runTask(pointsTask, 1);
+  CHECK_ERROR(DecodeTask_finish(pointsTask), "Parsing failed: Expecting ] at end of input");
+
+  // A task given up half way fails
+  sprintf(familiesStr, "[%s]", familyStr);
+  familyTask = DecodeTask_newEach(familiesStr, sizeof(Family), decodeFamily, countChildren, &childCount, NULL);
+  CHECK(decodeStep(familyTask, 1) == DECODE_IN_PROGRESS);
+  CHECK_ERROR(DecodeTask_finish(familyTask), "Decoding was not finished");
+  free(familiesStr);
+  printf("\n");
+
+  // --------------
+
+  printf("Decoding on %d threads with a context each: \n", DECODE_THREADS);
+  printf("----------------------------\n");
+
+  pthread_t threads[DECODE_THREADS];
+  int wrong[DECODE_THREADS] = { 0 };
+  for (int i = 0; i < DECODE_THREADS; i++) {
+    CHECK(pthread_create(&threads[i], NULL, decodeConcurrently, &wrong[i]) == 0);
+  }
+  for (int i = 0; i < DECODE_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    printf("Thread %d: %d wrong results out of %d\n", i, wrong[i], 2 * DECODES_PER_THREAD);
+    CHECK(wrong[i] == 0);
+  }
+  printf("\n");
+
+  // --------------
+
+  printf("Decoded family into an arena: \n");
+  printf("----------------------------\n");
+
+  Arena arena = Arena_new();
+  ParseOptions arenaOptions = { .outputArena = &arena };
+  Family arenaFamily;
+  DecodeResult arenaRes = decodeWithOptions(familyStr, &arenaFamily, decodeFamily, &arenaOptions);
+  CHECK(arenaRes.success);
+  if (arenaRes.success) {
+    printf("Father: "); printPerson(arenaFamily.father);
+    CHECK(inArena(&arena, arenaFamily.father.firstName) && inArena(&arena, arenaFamily.children));
+    CHECK(inArena(&arena, arenaFamily.children[1].lastName) && strcmp(arenaFamily.children[1].firstName, "Holly") == 0);
+    CHECK(arenaFamily.father.lastName != arenaFamily.mother.lastName);
+  }
+
+  // Once reset, the arena decodes the next document into the same block
+  ArenaBlock *firstBlock = arena.first;
+  Arena_reset(&arena);
+  CHECK(arena.first == firstBlock && arena.first->used == 0);
+  arenaRes = decodeWithOptions(familyStr, &arenaFamily, decodeFamily, &arenaOptions);
+  CHECK(arenaRes.success && arena.first == firstBlock && inArena(&arena, arenaFamily.mother.firstName));
+  Arena_free(&arena);
+
+  // Equal strings are stored once, also when decoding with a context
+  Arena deduplicating = Arena_newDeduplicating();
+  arenaOptions.outputArena = &deduplicating;
+  DecodeContext arenaContext = DecodeContext_new();
+  arenaRes = decodeWithContext(&arenaContext, familyStr, &arenaFamily, decodeFamily, &arenaOptions);
+  CHECK(arenaRes.success);
+  if (arenaRes.success) {
+    printf("Mother: "); printPerson(arenaFamily.mother);
+    CHECK(arenaFamily.father.lastName == arenaFamily.mother.lastName);
+    CHECK(arenaFamily.children[0].lastName == arenaFamily.mother.lastName && inArena(&deduplicating, arenaFamily.children));
+  }
+
+  // So are the maps decoded into it, which are not freed with `JSONMap_free`
+  JSONMap arenaPeople;
+  arenaRes = decodeWithContext(&arenaContext, peopleStr, &arenaPeople, decodePersonMap, &arenaOptions);
+  CHECK(arenaRes.success && inArena(&deduplicating, arenaPeople.keys));
+  if (arenaRes.success) {
+    Person *walt = JSONMap_get(&arenaPeople, "walt");
+    CHECK(walt != NULL && walt->lastName == arenaFamily.father.lastName);
+  }
+  DecodeContext_free(&arenaContext);
+  Arena_free(&deduplicating);
+  printf("\n");
+
+  // --------------
+
+  printf("Validated inputs: \n");
+  printf("----------------------------\n");
+
+  for (size_t i = 0; i < sizeof(validateCases) / sizeof(validateCases[0]); i++) {
+    ValidateCase test = validateCases[i];
+    ValidateResult validated = validate(test.input, strlen(test.input), &test.limits, test.allowTrailingCommas);
+    printf("%s\n", validated.valid ? "Valid" : validated.errorMsg);
+    if (test.errorMsg == NULL) {
+      CHECK(validated.valid);
+    } else if (validated.valid || strcmp(validated.errorMsg, test.errorMsg) != 0) {
+      printf("Check failed for validate case %zu: expecting \"%s\"\n", i, test.errorMsg);
+      failures++;
+    }
+
+    // Validating and parsing agree on the limits and on whitespace
+    ParseLimits limits = test.limits;
+    if (limits.maxDepth > 0 || limits.maxStringLength > 0 || limits.maxContainerLength > 0 || limits.maxNodes > 0
+        || strchr(test.input, '\t') != NULL) {
+      ParseOptions limitOptions = { .limits = limits };
+      ParserResult limited = parseWithOptions(test.input, &limitOptions);
+      if (limited.status == PARSER_SUCCESS) {
+        CHECK(validated.valid);
+        JSONNode_free(limited.result.PARSER_SUCCESS.tree);
+        InternTable_free(limited.result.PARSER_SUCCESS.keys);
+      } else {
+        CHECK(!validated.valid && strcmp(limited.result.PARSER_ERROR.errorMsg, validated.errorMsg) == 0);
+      }
+    }
+  }
+  // The input need not be NUL-terminated, and what follows it is not looked at
+  CHECK(validate("[1]garbage", 3, NULL, false).valid);
+  CHECK(!validate("[1]garbage", 4, NULL, false).valid);
+  // The documents decoded above are valid, except for the point with its trailing comma
+  CHECK(validate(familyStr, strlen(familyStr), NULL, false).valid);
+  CHECK(!validate(pointStr, strlen(pointStr), NULL, false).valid);
+  printf("\n");
+
+  // --------------
+
+  printf("Decoded fixed fields: \n");
+  printf("----------------------------\n");
+
+  Sensor sensor;
+  DecodeResult sensorRes = decode("{\"name\": \"temp\", \"readings\": [1, 2, 3]}", &sensor, decodeSensor);
+  CHECK(sensorRes.success && strcmp(sensor.name, "temp") == 0 && sensor.readingCount == 3 && sensor.readings[2] == 3);
+  // Exactly as long as the storage
+  sensorRes = decode("{\"name\": \"pressure\", \"readings\": [1, 2, 3, 4]}", &sensor, decodeSensor);
+  CHECK(!sensorRes.success);
+  if (!sensorRes.success) {
+    printDecoderError(sensorRes.error);
+    CHECK(strcmp(sensorRes.error.errorMsg, "Expecting a string of at most 7 bytes, got 8") == 0);
+    DecodeError_free(sensorRes.error);
+  }
+  sensorRes = decode("{\"name\": \"wind\", \"readings\": [1, 2, 3, 4, 5, 6]}", &sensor, decodeSensor);
+  CHECK(!sensorRes.success);
+  if (!sensorRes.success) {
+    char *message = buildDecoderError(sensorRes.error);
+    printf("%s\n", message);
+    CHECK(strcmp(message, "At root[\"readings\"]: Expecting at most 4 elements, got 6") == 0);
+    free(message);
+    DecodeError_free(sensorRes.error);
+  }
+  sensorRes = decode("{\"name\": \"wind\", \"readings\": [1, 2, 3, 4]}", &sensor, decodeSensor);
+  CHECK(sensorRes.success && sensor.readingCount == 4 && sensor.readings[3] == 4);
+
+  sensorRes = decode("{\"name\": \"pressure\", \"readings\": [1, 2, 3, 4, 5, 6]}", &sensor, decodeTruncatedSensor);
+  CHECK(sensorRes.success);
+  printf("Truncated: %s, %d readings\n", sensor.name, sensor.readingCount);
+  CHECK(strcmp(sensor.name, "pressur") == 0 && sensor.readingCount == 4 && sensor.readings[3] == 4);
+  // "é" takes two bytes, and would be cut in half
+  sensorRes = decode("{\"name\": \"sensé\u00e9\", \"readings\": []}", &sensor, decodeTruncatedSensor);
+  CHECK(sensorRes.success && strcmp(sensor.name, "sensé") == 0 && sensor.readingCount == 0);
+  CHECK_ERROR(decode("{\"name\": 1, \"readings\": []}", &sensor, decodeTruncatedSensor), "Expecting string, got number");
+
+  Triangle triangle;
+  DecodeResult triangleRes = decode("{\"name\": \"tri\", \"points\": [{\"x\": 0, \"y\": 0}, {\"x\": 1, \"y\": 0},"
+                                    " {\"x\": 0, \"y\": 1}]}", &triangle, decodeTriangle);
+  CHECK(triangleRes.success && strcmp(triangle.name, "tri") == 0 && triangle.pointsCount == 3 && triangle.points[2].y == 1);
+  CHECK_ERROR(decode("{\"name\": \"triangles\", \"points\": []}", &triangle, decodeTriangle),
+              "Expecting a string of at most 7 bytes, got 9");
+  CHECK_ERROR(decode("{\"name\": \"quad\", \"points\": [{\"x\": 0, \"y\": 0}, {\"x\": 1, \"y\": 0},"
+                     " {\"x\": 0, \"y\": 1}, {\"x\": 1, \"y\": 1}]}", &triangle, decodeTriangle),
+              "Expecting at most 3 elements, got 4");
+  printf("\n");
+
+  // --------------
+  printf("Streamed list within limits: \n");
+  printf("----------------------------\n");
+
+  char *streamStr = "[{\"x\": 1, \"y\": 2}, {\"x\": 3, \"y\": 4}, {\"x\": 5, \"y\": 6}]";
+  int streamSum = 0;
+  ParseOptions streamOptions = { .limits = { .maxDepth = 2, .maxContainerLength = 3, .maxNodes = 16 } };
+  DecodeResult limitedRes = decodeStreamWithOptions(streamStr, sizeof(Point), decodePoint, sumEachPoint, &streamSum,
+                                                    &streamOptions);
+  CHECK(limitedRes.success && streamSum == 21);
+
+  streamOptions = (ParseOptions) { .limits = { .maxInputBytes = 16 } };
+  CHECK_ERROR(decodeStreamWithOptions(streamStr, sizeof(Point), decodePoint, sumEachPoint, &streamSum, &streamOptions),
+              "Parsing failed: Input is longer than the maximum of 16 bytes");
+  streamOptions = (ParseOptions) { .limits = { .maxDepth = 2 } };
+  CHECK_ERROR(decodeStreamWithOptions("[{\"x\": [1], \"y\": 2}]", sizeof(Point), decodePoint, sumEachPoint,
+                                      &streamSum, &streamOptions),
+              "Parsing failed: Maximum nesting depth of 2 exceeded at 1:8");
+  streamOptions = (ParseOptions) { .limits = { .maxStringLength = 4 } };
+  CHECK_ERROR(decodeStreamWithOptions("[{\"x\": 1, \"y\": 2}, {\"x\": 3, \"y\": \"faraway\"}]", sizeof(Point),
+                                      decodePoint, sumEachPoint, &streamSum, &streamOptions),
+              "Parsing failed: String longer than the maximum of 4 bytes at 1:34");
+  // Only the elements before the one over the limit are decoded
+  streamSum = 0;
+  streamOptions = (ParseOptions) { .limits = { .maxContainerLength = 2 } };
+  CHECK_ERROR(decodeStreamWithOptions(streamStr, sizeof(Point), decodePoint, sumEachPoint, &streamSum, &streamOptions),
+              "Parsing failed: More than the maximum of 2 elements in list at 1:1");
+  CHECK(streamSum == 10);
+  streamOptions = (ParseOptions) { .limits = { .maxNodes = 8 } };
+  CHECK_ERROR(decodeStreamWithOptions(streamStr, sizeof(Point), decodePoint, sumEachPoint, &streamSum, &streamOptions),
+              "Parsing failed: More than the maximum of 8 values at 1:39");
+  printf("\n");
+
+  // --------------
+  printf("Deep nesting: \n");
+  printf("----------------------------\n");
+
+  // Far deeper than the C stack would allow a recursive parser to go
+  size_t nesting = 200000;
+  for (int objects = 0; objects <= 1; objects++) {
+    char *deepStr = nestedInput(nesting, objects);
+    ParserResult deepTree = parse(deepStr);
+    CHECK(deepTree.status == PARSER_SUCCESS);
+    if (deepTree.status == PARSER_SUCCESS) {
+      JSONNode *deepNode = deepTree.result.PARSER_SUCCESS.tree;
+      size_t levels = 0;
+      while ((deepNode->tag == JSON_LIST || deepNode->tag == JSON_OBJECT) && deepNode->length == 1) {
+        deepNode = deepNode->data.JSON_LIST.items;
+        levels++;
+      }
+      CHECK(levels == nesting && deepNode->tag == JSON_NUMBER && deepNode->data.JSON_NUMBER.number == 1);
+      JSONNode_free(deepTree.result.PARSER_SUCCESS.tree);
+      InternTable_free(deepTree.result.PARSER_SUCCESS.keys);
+    }
+
+    ParseOptions deepOptions = { .limits = { .maxDepth = nesting } };
+    deepTree = parseWithOptions(deepStr, &deepOptions);
+    CHECK(deepTree.status == PARSER_SUCCESS);
+    if (deepTree.status == PARSER_SUCCESS) {
+      JSONNode_free(deepTree.result.PARSER_SUCCESS.tree);
+      InternTable_free(deepTree.result.PARSER_SUCCESS.keys);
+    }
+    deepOptions.limits.maxDepth = nesting - 1;
+    deepTree = parseWithOptions(deepStr, &deepOptions);
+    char deepError[64];
+    snprintf(deepError, sizeof(deepError), "Maximum nesting depth of %zu exceeded at 1:%zu", nesting - 1,
+             objects ? (nesting - 1) * 6 + 1 : nesting);
+    CHECK(deepTree.status == PARSER_FAIL && strcmp(deepTree.result.PARSER_ERROR.errorMsg, deepError) == 0);
+    printf("%s\n", deepTree.result.PARSER_ERROR.errorMsg);
+
+    // Validating has no limit of its own either, and fails at the same place as parsing
+    CHECK(validate(deepStr, strlen(deepStr), NULL, false).valid);
+    ValidateResult deepValidated = validate(deepStr, strlen(deepStr), &deepOptions.limits, false);
+    CHECK(!deepValidated.valid && strcmp(deepValidated.errorMsg, deepError) == 0);
+    free(deepStr);
+  }
+  printf("\n");
+
+  // --------------
+  printf("Compiled document: \n");
+  printf("----------------------------\n");
+
+  const char *binaryPath = "decodeTest.csonb";
+  const char *corruptPath = "decodeTestCorrupt.csonb";
+  char binaryError[BINARY_ERROR_MAX_SIZE];
+  ParserResult familyTree = parse(familyStr);
+  JSONNode *familyNode = familyTree.result.PARSER_SUCCESS.tree;
+  CHECK(Binary_write(familyNode, binaryPath, binaryError));
+  JSONNode_free(familyNode);
+  InternTable_free(familyTree.result.PARSER_SUCCESS.keys);
+
+  BinaryDocument document;
+  CHECK(BinaryDocument_load(binaryPath, &document, binaryError));
+  CHECK(BinaryDocument_verify(&document, binaryError));
+  Family compiledFamily;
+  CHECK(BinaryDocument_decode(&document, &compiledFamily, decodeFamily).success);
+  CHECK(strcmp(compiledFamily.mother.firstName, "Skyler") == 0 && compiledFamily.mother.age == 40);
+  CHECK(compiledFamily.childCount == 2 && strcmp(compiledFamily.children[1].firstName, "Holly") == 0);
+  // Generated decoders use the length of the keys stored in the file
+  Household compiledHousehold;
+  CHECK(BinaryDocument_decode(&document, &compiledHousehold, decodeHousehold).success);
+  CHECK(strcmp(compiledHousehold.father.firstName, "Walter") == 0 && compiledHousehold.children[0].age == 17);
+  printPerson(compiledFamily.children[0]);
+
+  // Corrupt copies of the file
+  char *bytes = malloc(document.size);
+  size_t byteCount = document.size;
+  memcpy(bytes, document.base, byteCount);
+  BinaryDocument_close(&document);
+  BinaryHeader *header = (BinaryHeader*)bytes;
+
+  writeFile(corruptPath, bytes, byteCount / 2);
+  CHECK(!BinaryDocument_load(corruptPath, &document, binaryError));
+  CHECK(strcmp(binaryError, "Compiled document is truncated or corrupt") == 0);
+
+  bytes[0] = 'X';
+  writeFile(corruptPath, bytes, byteCount);
+  CHECK(!BinaryDocument_load(corruptPath, &document, binaryError));
+  CHECK(strcmp(binaryError, "Not a compiled document") == 0);
+  bytes[0] = BINARY_MAGIC[0];
+
+  // The items of the root point back at the root itself, which only `BinaryDocument_verify` notices
+  JSONNode *root = (JSONNode*)(bytes + header->nodesOffset);
+  root->data.JSON_OBJECT.items = (JSONNode*)(uintptr_t)header->nodesOffset;
+  writeFile(corruptPath, bytes, byteCount);
+  CHECK(BinaryDocument_load(corruptPath, &document, binaryError));
+  CHECK(!BinaryDocument_verify(&document, binaryError));
+  CHECK(strcmp(binaryError, "Compiled document is corrupt: items out of bounds") == 0);
+  printf("%s\n", binaryError);
+  BinaryDocument_close(&document);
+
+  free(bytes);
+  remove(binaryPath);
+  remove(corruptPath);
+  printf("\n");
+
+  // --------------
+  printf("Escapes and UTF-8: \n");
+  printf("----------------------------\n");
+
+  char *escaped;
+  CHECK(decode("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", &escaped, decodeString).success);
+  CHECK(strcmp(escaped, "\"\\/\b\f\n\r\t") == 0);
+  // Each escape decodes to the UTF-8 of its code point, pairs of surrogates to a single one
+  CHECK(decode("\"caf\\u00e9 \\u00E9 \\u20ac \\ud83d\\ude00\"", &escaped, decodeString).success);
+  CHECK(strcmp(escaped, "caf\xc3\xa9 \xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80") == 0);
+  printf("%s\n", escaped);
+  // Valid UTF-8 is kept as it is
+  CHECK(decode("\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"", &escaped, decodeString).success);
+  CHECK(strcmp(escaped, "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80") == 0);
+  Point escapedPoint;
+  CHECK(decode("{\"\\u0078\": 1, \"\\u0079\": 2}", &escapedPoint, decodePoint).success);
+  CHECK(escapedPoint.x == 1 && escapedPoint.y == 2);
+
+  CHECK_ERROR(decode("\"a\\u0000b\"", &escaped, decodeString),
+              "Parsing failed: Escaped NUL character in string literal at 1:3");
+  CHECK_ERROR(decode("\"a\\x\"", &escaped, decodeString), "Parsing failed: Invalid escape sequence at 1:3");
+  CHECK_ERROR(decode("\"a\\u00g0\"", &escaped, decodeString), "Parsing failed: Invalid escape sequence at 1:3");
+  // Surrogates which are not part of a pair
+  CHECK_ERROR(decode("\"\\ud83d\"", &escaped, decodeString), "Parsing failed: Invalid escape sequence at 1:2");
+  CHECK_ERROR(decode("\"\\ude00\\ud83d\"", &escaped, decodeString), "Parsing failed: Invalid escape sequence at 1:2");
+  CHECK_ERROR(decode("\"\\ud83d\\u0041\"", &escaped, decodeString), "Parsing failed: Invalid escape sequence at 1:2");
+  // Overlong encodings, encoded surrogates, code points above U+10FFFF and stray continuation bytes
+  char *invalidUtf8[] = { "\"a\xc0\xaf\"", "\"a\xe0\x80\xaf\"", "\"a\xf0\x80\x80\xaf\"", "\"a\xed\xa0\x80\"",
+                          "\"a\xf4\x90\x80\x80\"", "\"a\x80\"", "\"a\xc3\"" };
+  for (size_t i = 0; i < sizeof(invalidUtf8) / sizeof(invalidUtf8[0]); i++) {
+    CHECK_ERROR(decode(invalidUtf8[i], &escaped, decodeString), "Parsing failed: Invalid UTF-8 in string literal at 1:3");
+    LexResult invalidTokens = lex(invalidUtf8[i]);
+    CHECK(invalidTokens.status == LEXER_FAIL
+          && strcmp(invalidTokens.result.LEXER_FAIL.errorMsg, "Invalid UTF-8 in string literal at 1:3") == 0);
+  }
+  printf("\n");
+
+  // --------------
+  printf("In situ: \n");
+  printf("----------------------------\n");
+
+  // Strings are unescaped within the input and point there
+  char inSituStr[] = "{\"firstName\": \"J\\u00e9sse\", \"lastName\": \"Pink\\nman\", \"age\": 24}";
+  char *inSituEnd = inSituStr + sizeof(inSituStr);
+  ParseOptions inSituOptions = { .inSitu = true };
+  ParserResult inSituTree = parseWithOptions(inSituStr, &inSituOptions);
+  CHECK(inSituTree.status == PARSER_SUCCESS);
+  if (inSituTree.status == PARSER_SUCCESS) {
+    JSONNode *inSituNode = inSituTree.result.PARSER_SUCCESS.tree;
+    char *firstName = inSituNode->data.JSON_OBJECT.items[0].data.JSON_STRING.string;
+    char *lastName = inSituNode->data.JSON_OBJECT.items[1].data.JSON_STRING.string;
+    CHECK(firstName > inSituStr && firstName < inSituEnd && strcmp(firstName, "J\xc3\xa9sse") == 0);
+    CHECK(lastName > inSituStr && lastName < inSituEnd && strcmp(lastName, "Pink\nman") == 0);
+    JSONNode_freeInSitu(inSituNode);
+    InternTable_free(inSituTree.result.PARSER_SUCCESS.keys);
+  }
+
+  char inSituPersonStr[] = "{\"firstName\": \"Jesse\", \"lastName\": \"Pinkman\", \"age\": 24}";
+  Person inSituPerson;
+  CHECK(decodeWithOptions(inSituPersonStr, &inSituPerson, decodePerson, &inSituOptions).success);
+  CHECK(inSituPerson.firstName > inSituPersonStr && inSituPerson.firstName < inSituPersonStr + sizeof(inSituPersonStr));
+  CHECK(strcmp(inSituPerson.firstName, "Jesse") == 0 && strcmp(inSituPerson.lastName, "Pinkman") == 0);
+  CHECK(inSituPerson.age == 24);
+  printPerson(inSituPerson);
+
+  char inSituTokensStr[] = "[\"a\\tb\", \"\\ud83d\\ude00\", 1]";
+  LexResult inSituTokens = lexInSitu(inSituTokensStr);
+  CHECK(inSituTokens.status == LEXER_SUCCESS);
+  if (inSituTokens.status == LEXER_SUCCESS) {
+    TokenList tokenList = inSituTokens.result.LEXER_SUCCESS.tokenList;
+    CHECK(tokenList.length == 7 && tokenList.borrowsStrings);
+    char *tab = tokenList.tokens[1].data.TOKEN_STRING_LITERAL.string;
+    char *emoji = tokenList.tokens[3].data.TOKEN_STRING_LITERAL.string;
+    CHECK(tab == inSituTokensStr + 2 && strcmp(tab, "a\tb") == 0);
+    CHECK(emoji > tab && strcmp(emoji, "\xf0\x9f\x98\x80") == 0);
+    TokenList_free(&tokenList);
+  }
+
+  char inSituWrongStr[] = "{\"firstName\": \"Jesse\", \"lastName\": \"Pink\\qman\", \"age\": 24}";
+  CHECK_ERROR(decodeWithOptions(inSituWrongStr, &inSituPerson, decodePerson, &inSituOptions),
+              "Parsing failed: Invalid escape sequence at 1:41");
+  printf("\n");
+
+  // --------------
+  printf("Lexing large inputs: \n");
+  printf("----------------------------\n");
+
+  // Several chunks of `lexParallel` and many windows of the structural index
+  size_t records = 4 * PARALLEL_MIN_CHUNK_SIZE / 100;
+  char *lexerLast[] = { "", ", \"a\\qb\"", ", \"a\xc0\xaf\"", ", {\"a\": tru}", ", \"unterminated" };
+  for (size_t i = 0; i < sizeof(lexerLast) / sizeof(lexerLast[0]); i++) {
+    char *largeStr = generateTokens(records, lexerLast[i]);
+    CHECK(strlen(largeStr) > 4 * PARALLEL_MIN_CHUNK_SIZE);
+    checkSameLexing(largeStr, __LINE__);
+    free(largeStr);
+  }
+  printf("\n");
+
+  // --------------
+  printf("Limits: \n");
+  printf("----------------------------\n");
+
+  // Each limit just above what the family needs, and just below
+  typedef struct LimitCase {
+    ParseLimits within;
+    ParseLimits exceeded;
+    char *errorMsg;
+  } LimitCase;
+  LimitCase limitCases[] = {
+    { { .maxInputBytes = 238 }, { .maxInputBytes = 237 }, "Input is longer than the maximum of 237 bytes" },
+    { { .maxDepth = 3 }, { .maxDepth = 2 }, "Maximum nesting depth of 2 exceeded at 1:134" },
+    { { .maxStringLength = 10 }, { .maxStringLength = 9 }, "String longer than the maximum of 9 bytes at 1:147" },
+    // The members of the father come before those of the family
+    { { .maxContainerLength = 3 }, { .maxContainerLength = 2 },
+      "More than the maximum of 2 elements in object at 1:11" },
+    // The key of the last member counts as a value until its colon is found
+    { { .maxNodes = 18 }, { .maxNodes = 17 }, "More than the maximum of 17 values at 1:229" },
+  };
+  Arena limitArena = Arena_new();
+  for (size_t i = 0; i < sizeof(limitCases) / sizeof(limitCases[0]); i++) {
+    LimitCase test = limitCases[i];
+    ParseOptions limitOptions = { .limits = test.within, .outputArena = &limitArena };
+    ParserResult limited = parseWithOptions(familyStr, &limitOptions);
+    CHECK(limited.status == PARSER_SUCCESS);
+    if (limited.status == PARSER_SUCCESS) {
+      JSONNode_free(limited.result.PARSER_SUCCESS.tree);
+      InternTable_free(limited.result.PARSER_SUCCESS.keys);
+    }
+    Family limitFamily;
+    DecodeResult limitRes = decodeWithOptions(familyStr, &limitFamily, decodeFamily, &limitOptions);
+    CHECK(limitRes.success && limitFamily.childCount == 2
+          && strcmp(limitFamily.children[0].firstName, "Walter Jr.") == 0);
+    Arena_reset(&limitArena);
+
+    limitOptions.limits = test.exceeded;
+    limited = parseWithOptions(familyStr, &limitOptions);
+    printf("%s\n", limited.status == PARSER_FAIL ? limited.result.PARSER_ERROR.errorMsg : "Parsed");
+    CHECK(limited.status == PARSER_FAIL && strcmp(limited.result.PARSER_ERROR.errorMsg, test.errorMsg) == 0);
+    char limitError[MAX_ERR_SIZE + 32];
+    snprintf(limitError, sizeof(limitError), "Parsing failed: %s", test.errorMsg);
+    CHECK_ERROR(decodeWithOptions(familyStr, &limitFamily, decodeFamily, &limitOptions), limitError);
+    Arena_reset(&limitArena);
+  }
+  Arena_free(&limitArena);
+
+  // The lexer fails at the token which exceeds a limit, long before the end of the input, whether it lexes
+  // a token at a time or, for large inputs, with the structural index
+  StringBuilder limitBuilder = StringBuilder_new();
+  StringBuilder_append(&limitBuilder, "[[[1]], [\"");
+  for (int i = 0; i < STRUCTURAL_INDEX_MIN_LENGTH / 8; i++) {
+    StringBuilder_append(&limitBuilder, "abcdefgh");
+  }
+  StringBuilder_append(&limitBuilder, "\"]");
+  for (int i = 0; i < STRUCTURAL_INDEX_MIN_LENGTH / 4; i++) {
+    StringBuilder_append(&limitBuilder, ", %d", i % 10);
+  }
+  StringBuilder_append(&limitBuilder, "]");
+  char *limitStr = StringBuilder_getString(&limitBuilder);
+  typedef struct EarlyCase {
+    ParseLimits limits;
+    // Tokens lexed when the lexer fails, the last of which exceeds the limit
+    size_t tokens;
+    char *errorMsg;
+  } EarlyCase;
+  EarlyCase earlyCases[] = {
+    { { .maxDepth = 2 }, 3, "Maximum nesting depth of 2 exceeded at 1:3" },
+    { { .maxStringLength = 64 }, 9, "String longer than the maximum of 64 bytes at 1:10" },
+    { { .maxContainerLength = 2 }, 12, "More than the maximum of 2 elements in list at 1:1" },
+    { { .maxNodes = 4 }, 8, "More than the maximum of 4 values at 1:9" },
+  };
+  for (size_t i = 0; i < sizeof(earlyCases) / sizeof(earlyCases[0]); i++) {
+    EarlyCase test = earlyCases[i];
+    for (int indexed = 0; indexed <= 1; indexed++) {
+      CHECK(tokensBeforeFailure(limitStr, &test.limits, indexed, test.errorMsg) == test.tokens);
+    }
+  }
+  free(limitStr);
+  printf("\n");
+
+  // --------------
+  printf("Batches: \n");
+  printf("----------------------------\n");
+
+  mkdir("decodeTestBatch", 0700);
+  mkdir("decodeTestBatch/sub", 0700);
+  writeFile("decodeTestBatch/b.json", "[1, 2]", 6);
+  writeFile("decodeTestBatch/a.json", "{\"x\": 1,}", 9);
+  writeFile("decodeTestBatch/sub/c.json", "[1, ", 4);
+  writeFile("decodeTestBatch/notes.txt", "[", 1);
+  // The files of a directory come sorted, and the other paths in the order given, even when repeated
+  char *batchPaths[] = { "decodeTestBatch", "decodeTestMissing.json", "decodeTestBatch/b.json" };
+
+  BatchSummary batchSummary;
+  BatchOptions batchOptions = { .validateOnly = true, .threads = 4 };
+  char *batchOutput = runBatchOutput(batchPaths, 3, batchOptions, &batchSummary);
+  printf("%s", batchOutput);
+  CHECK(strcmp(batchOutput,
+    "decodeTestBatch/a.json: Invalid: Trailing comma at 1:8\n"
+    "decodeTestBatch/b.json: Valid\n"
+    "decodeTestBatch/sub/c.json: Invalid: Unexpected end of input, expecting value at 1:5\n"
+    "decodeTestMissing.json: Could not read file\n"
+    "decodeTestBatch/b.json: Valid\n") == 0);
+  CHECK(batchSummary.files == 5 && batchSummary.failed == 3 && batchSummary.bytes == 25);
+  free(batchOutput);
+
+  batchOptions.allowTrailingCommas = true;
+  batchOutput = runBatchOutput(batchPaths, 3, batchOptions, &batchSummary);
+  CHECK(strncmp(batchOutput, "decodeTestBatch/a.json: Valid\n", 30) == 0);
+  CHECK(batchSummary.files == 5 && batchSummary.failed == 2);
+  free(batchOutput);
+
+  // Parsing prints the same whatever the number of threads
+  batchOptions = (BatchOptions) { .validateOnly = false, .threads = 1 };
+  char *serialOutput = runBatchOutput(batchPaths, 3, batchOptions, &batchSummary);
+  CHECK(strncmp(serialOutput, "decodeTestBatch/a.json:\n", 24) == 0);
+  CHECK(strstr(serialOutput, "decodeTestBatch/sub/c.json: Parsing failed: ") != NULL);
+  CHECK(batchSummary.files == 5 && batchSummary.failed == 2);
+  for (int threads = 2; threads <= 8; threads *= 2) {
+    batchOptions.threads = threads;
+    batchOutput = runBatchOutput(batchPaths, 3, batchOptions, &batchSummary);
+    CHECK(strcmp(batchOutput, serialOutput) == 0);
+    CHECK(batchSummary.files == 5 && batchSummary.failed == 2);
+    free(batchOutput);
+  }
+  free(serialOutput);
+
+  remove("decodeTestBatch/b.json");
+  remove("decodeTestBatch/a.json");
+  remove("decodeTestBatch/sub/c.json");
+  remove("decodeTestBatch/notes.txt");
+  remove("decodeTestBatch/sub");
+  remove("decodeTestBatch");
+  printf("\n");
 
-  return 1;
+  return failures > 0;
 }
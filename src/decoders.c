@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,10 +7,18 @@
 
 #include "decoders.h"
 #include "parser.h"
-#include "nodelist.h"
 #include "stringbuilder.h"
+#include "tagtable.h"
 
-void setDecoderPath(DecoderError *error, int depth, JSONPath jPath);
+void setDecoderPath(DecoderError *error, size_t depth, JSONPath jPath);
+static DecodeResult runDecoder(JSONNode *tree, InternTable *keys, const void *base, const ParseOptions *options, void *dest,
+                               decodeFun decoder);
+static bool decodeFieldAt(DecoderState *state, const FieldDef *field);
+static DecoderState newDecoderState(JSONNode *tree, InternTable *keys, const ParseOptions *options);
+static void formatFailure(DecoderState *state);
+static DecodeResult parsingFailed(const char *parserErrorMsg);
+
+#define DECODER_ERROR_START_CAPACITY 5
 
 #define allocsprintf(ptr, args...) do {\
   size_t nbytes = snprintf(NULL, 0, args) + 1;\
@@ -18,18 +27,19 @@ void setDecoderPath(DecoderError *error, int depth, JSONPath jPath);
   ptr = str;\
 } while(0);
 
-#define FAIL(state, args...) do {\
-  allocsprintf(state->error.errorMsg, args);\
+// Records a failure with the given code of `DecodeFailure` and the values of its message, see `formatFailure`
+#define FAIL(state, failureCode, args...) do {\
+  (state)->failure = (DecodeFailure) { .code = failureCode, .data.failureCode = { args } };\
   return false;\
 } while(0)
 
 bool decodeInt(DecoderState *state, void *dest) {
   if (state->currentNode->tag != JSON_NUMBER) {
-    FAIL(state, "Expecting number, got %s", nodeTagToString(state->currentNode->tag));
+    FAIL(state, FAILURE_WRONG_TAG, JSON_NUMBER, state->currentNode->tag);
   }
   double num = state->currentNode->data.JSON_NUMBER.number;
   if(ceil(num) != num) {
-    FAIL(state, "Expected integer, got float");
+    FAIL(state, FAILURE_NOT_INTEGER, num);
   }
   int *numDest = (int*)dest;
   *numDest = (int)num;
@@ -38,7 +48,7 @@ bool decodeInt(DecoderState *state, void *dest) {
 
 bool decodeFloat(DecoderState *state, void *dest) {
   if (state->currentNode->tag != JSON_NUMBER) {
-    FAIL(state, "Expecting number, got %s", nodeTagToString(state->currentNode->tag));
+    FAIL(state, FAILURE_WRONG_TAG, JSON_NUMBER, state->currentNode->tag);
   }
   double num = state->currentNode->data.JSON_NUMBER.number;
   double *doubleDest = (double*)dest;
@@ -48,38 +58,153 @@ bool decodeFloat(DecoderState *state, void *dest) {
 
 bool decodeString(DecoderState *state, void *dest) {
   if (state->currentNode->tag != JSON_STRING) {
-    FAIL(state, "Expecting string, got %s", nodeTagToString(state->currentNode->tag));
+    FAIL(state, FAILURE_WRONG_TAG, JSON_STRING, state->currentNode->tag);
   }
-  char *str = state->currentNode->data.JSON_STRING.string;
+  char *str = JSONNode_string(state->currentNode, state->base);
   char **strDest = (char**)dest;
-  *strDest = strdup(str);
+  *strDest = state->inSitu ? str : decodeStrdup(state, str);
   return true;
 }
 
-JSONNode *findField(NodeList *list, char *name) {
-  for (int i = 0; i < list->length; i++) {
-    JSONNode *node = &list->items[i];
-    if (strcmp(node->fieldName, name) == 0) {
-      return node;
+JSONNode *findField(JSONNode *object, char *name, const void *base) {
+  for (size_t i = 0; i < object->length; i++) {
+    if (strcmp(JSONNode_key(object, i, base), name) == 0) {
+      return &JSONNode_items(object, base)[i];
+    }
+  }
+  return NULL;
+}
+
+// `name` must be interned in the same table as the keys of `object`
+JSONNode *findInternedField(JSONNode *object, char *name) {
+  char **keys = JSONNode_keys(object);
+  for (size_t i = 0; i < object->length; i++) {
+    if (keys[i] == name) {
+      return &object->data.JSON_OBJECT.items[i];
     }
   }
   return NULL;
 }
 
+static char *cacheName(DecoderState *state, const char *name, uint32_t slot) {
+  FieldNameCache *cache = &state->names;
+  cache->entries[slot].name = name;
+  cache->entries[slot].interned = InternTable_find(state->keys, name);
+  return cache->entries[slot].interned;
+}
+
+// Returns the copy of `name` interned in `state->keys`, or NULL if it was never interned, in which case
+// it does not occur anywhere in the document. Small enough to be inlined into the decoders of fields,
+// which matters to them as much as the lookup itself.
+static char *internedName(DecoderState *state, const char *name) {
+  // The top bits of the product depend on all of the address, unlike its low bits which are often 0
+  uint32_t slot = (uint32_t)((uintptr_t)name * 2654435761u) >> (32 - FIELD_NAME_CACHE_BITS);
+  if (state->names.entries[slot].name != name) {
+    return cacheName(state, name, slot);
+  }
+  return state->names.entries[slot].interned;
+}
+
+// Finds the member `name` of the current object, or returns NULL if there is none.
+static JSONNode *findMember(DecoderState *state, char *name) {
+  JSONNode *object = state->currentNode;
+  if (state->keys != NULL) {
+    char *interned = internedName(state, name);
+    return interned != NULL ? findInternedField(object, interned) : NULL;
+  }
+  return findField(object, name, state->base);
+}
+
 bool decodeField(DecoderState *state, FieldDef field) {
-  JSONNode *current = state->currentNode;
-  JSONNode *node = findField(current->data.JSON_OBJECT.nodes, field.name);
+  return decodeFieldAt(state, &field);
+}
 
+// Same as `decodeField`. Passing the field by reference saves the compiler from taking it apart into
+// registers only to copy it back to the stack for `decodeFieldNode`.
+static bool decodeFieldAt(DecoderState *state, const FieldDef *field) {
+  JSONNode *node = findMember(state, field->name);
   if (node == NULL) {
-    FAIL(state, "No field with name \"%s\" was found", field.name);
+    switch (field->type) {
+      case OPTIONAL_FIELD: {
+        struct OPTIONAL_FIELD data = field->data.OPTIONAL_FIELD;
+        if (data.present != NULL) {
+          *data.present = false;
+        }
+        return true;
+      }
+
+      case DEFAULT_FIELD: {
+        struct DEFAULT_FIELD data = field->data.DEFAULT_FIELD;
+        memcpy(data.dest, data.defaultValue, data.size);
+        return true;
+      }
+
+      default:
+        return failMissingField(state, field->name);
+    }
+  }
+  return decodeFieldNode(state, node, *field);
+}
+
+bool failMissingField(DecoderState *state, char *name) {
+  FAIL(state, FAILURE_MISSING_FIELD, name);
+}
+
+// Lists an allocation made while `oneOf` tries alternatives, so that it can be freed if they fail
+static void *logAllocation(DecoderState *state, void *allocation) {
+  if (state->speculating == 0) {
+    return allocation;
   }
+  if (state->allocationCount == state->allocationCapacity) {
+    state->allocationCapacity = state->allocationCapacity > 0 ? state->allocationCapacity * 2 : 16;
+    state->allocations = reallocarray(state->allocations, state->allocationCapacity, sizeof(void*));
+  }
+  state->allocations[state->allocationCount++] = allocation;
+  return allocation;
+}
 
+void *decodeAlloc(DecoderState *state, size_t size) {
+  return state->arena != NULL ? Arena_alloc(state->arena, size) : logAllocation(state, malloc(size));
+}
+
+char *decodeStrdup(DecoderState *state, const char *string) {
+  return state->arena != NULL ? Arena_strdup(state->arena, string) : logAllocation(state, strdup(string));
+}
+
+// Frees the last allocation of `decodeAlloc` right away, rather than leaving it to the arena or to `oneOf`
+static void decodeFreeLast(DecoderState *state, void *allocation) {
+  if (state->arena != NULL) {
+    return;
+  }
+  if (state->speculating > 0) {
+    state->allocationCount--;
+  }
+  free(allocation);
+}
+
+bool expectTag(DecoderState *state, enum JSONNode_Tag tag) {
+  if (state->currentNode->tag != tag) {
+    FAIL(state, FAILURE_WRONG_TAG, tag, state->currentNode->tag);
+  }
+  return true;
+}
+
+void enterField(DecoderState *state, JSONNode *node, char *name) {
   setDecoderPath(&state->error, state->error.depth++, (JSONPath) {
     .tag = JSON_FIELD,
-    .data = { .JSON_FIELD = { .fieldName = field.name } }
+    .data = { .JSON_FIELD = { .fieldName = name } }
   });
-
   state->currentNode = node;
+}
+
+void leaveField(DecoderState *state, JSONNode *object) {
+  state->currentNode = object;
+  state->error.depth--;
+}
+
+bool decodeFieldNode(DecoderState *state, JSONNode *node, FieldDef field) {
+  JSONNode *current = state->currentNode;
+  enterField(state, node, field.name);
 
   switch (field.type) {
     case NORMAL_FIELD: {
@@ -99,10 +224,48 @@ bool decodeField(DecoderState *state, FieldDef field) {
       }
       break;
     }
+
+    case OPTIONAL_FIELD: {
+      struct OPTIONAL_FIELD data = field.data.OPTIONAL_FIELD;
+      if (data.present != NULL) {
+        *data.present = true;
+      }
+      bool result = data.decoder(state, data.dest);
+      if (!result) {
+        return false;
+      }
+      break;
+    }
+
+    case DEFAULT_FIELD: {
+      struct DEFAULT_FIELD data = field.data.DEFAULT_FIELD;
+      bool result = data.decoder(state, data.dest);
+      if (!result) {
+        return false;
+      }
+      break;
+    }
+
+    case FIXED_LIST_FIELD: {
+      struct FIXED_LIST_FIELD data = field.data.FIXED_LIST_FIELD;
+      bool result = decodeFixedList(state, data.dest, data.lengthDest, data.capacity, data.size, data.decoder, data.overflow);
+      if (!result) {
+        return false;
+      }
+      break;
+    }
+
+    case FIXED_STRING_FIELD: {
+      struct FIXED_STRING_FIELD data = field.data.FIXED_STRING_FIELD;
+      bool result = decodeFixedString(state, data.dest, data.capacity, data.overflow);
+      if (!result) {
+        return false;
+      }
+      break;
+    }
   }
 
-  state->currentNode = current;
-  state->error.depth--;
+  leaveField(state, current);
   return true;
 }
 
@@ -130,16 +293,69 @@ FieldDef makeListField(char *name, void *dest, int *lengthDest, size_t size, dec
   };
 }
 
+FieldDef optionalField(char *name, void *dest, decodeFun decoder, bool *present) {
+  return (FieldDef) {
+    .type = OPTIONAL_FIELD,
+    .name = name,
+    .data = { .OPTIONAL_FIELD = {
+      .dest = dest,
+      .decoder = decoder,
+      .present = present,
+    } }
+  };
+}
+
+FieldDef defaultField(char *name, void *dest, decodeFun decoder, const void *defaultValue, size_t size) {
+  return (FieldDef) {
+    .type = DEFAULT_FIELD,
+    .name = name,
+    .data = { .DEFAULT_FIELD = {
+      .dest = dest,
+      .decoder = decoder,
+      .defaultValue = defaultValue,
+      .size = size,
+    } }
+  };
+}
+
+FieldDef makeFixedListField(char *name, void *dest, int *lengthDest, size_t capacity, size_t size, decodeFun decoder,
+                            OverflowPolicy overflow) {
+  return (FieldDef) {
+    .type = FIXED_LIST_FIELD,
+    .name = name,
+    .data = { .FIXED_LIST_FIELD = {
+      .dest = dest,
+      .lengthDest = lengthDest,
+      .capacity = capacity,
+      .size = size,
+      .decoder = decoder,
+      .overflow = overflow,
+    } }
+  };
+}
+
+FieldDef makeFixedStringField(char *name, char *dest, size_t capacity, OverflowPolicy overflow) {
+  return (FieldDef) {
+    .type = FIXED_STRING_FIELD,
+    .name = name,
+    .data = { .FIXED_STRING_FIELD = {
+      .dest = dest,
+      .capacity = capacity,
+      .overflow = overflow,
+    } }
+  };
+}
+
 bool decodeFields(DecoderState *state, int count, ...) {
   if (state->currentNode->tag != JSON_OBJECT) {
-    FAIL(state, "Expecting object, got %s", nodeTagToString(state->currentNode->tag));
+    FAIL(state, FAILURE_WRONG_TAG, JSON_OBJECT, state->currentNode->tag);
   }
 
   va_list ap;
   va_start(ap, count);
   for (int i = 0; i < count; i++) {
     FieldDef field = va_arg(ap, FieldDef);
-    bool result = decodeField(state, field);
+    bool result = decodeFieldAt(state, &field);
     if (!result) {
       return false;
     }
@@ -148,22 +364,94 @@ bool decodeFields(DecoderState *state, int count, ...) {
   return true;
 }
 
-bool decodeList(DecoderState *state, void *dest, int *length, size_t size, decodeFun decoder) {
-  if (state->currentNode->tag != JSON_LIST) {
-    FAIL(state, "Expecting list, got %s", nodeTagToString(state->currentNode->tag));
+// Size of the values `oneOf` saves on the stack rather than in an allocation
+#define ONE_OF_INLINE_SIZE 64
+
+bool oneOf(DecoderState *state, void *dest, size_t size, int count, ...) {
+  if (count == 0) {
+    FAIL(state, FAILURE_NO_DECODER, count);
   }
 
   JSONNode *currentNode = state->currentNode;
-  int currentDepth = state->error.depth;
-  NodeList *nodeList = currentNode->data.JSON_LIST.nodes;
+  size_t currentDepth = state->error.depth;
+  size_t firstAllocation = state->allocationCount;
+  char inlineCopy[ONE_OF_INLINE_SIZE];
+  void *copy = size <= ONE_OF_INLINE_SIZE ? inlineCopy : malloc(size);
+  memcpy(copy, dest, size);
 
-  void **listDest = (void**)dest;
-  *listDest = malloc(nodeList->length * size),
+  va_list ap;
+  va_start(ap, count);
+  state->speculating++;
+  bool success = false;
+  for (int i = 0; i < count && !success; i++) {
+    decodeFun decoder = va_arg(ap, decodeFun);
+    // The failure of an earlier alternative must not be reported for one which records none
+    state->failure = (DecodeFailure) { .code = FAILURE_NONE };
+    success = decoder(state, dest);
+    // The last alternative fails like any other decoder, and its error path may point into what it allocated
+    if (!success && i < count - 1) {
+      for (size_t j = firstAllocation; j < state->allocationCount; j++) {
+        free(state->allocations[j]);
+      }
+      state->allocationCount = firstAllocation;
+      memcpy(dest, copy, size);
+      // Decoders that fail may leave the state anywhere within the current node
+      state->currentNode = currentNode;
+      state->error.depth = currentDepth;
+    }
+  }
+  va_end(ap);
+  state->speculating--;
+  if (success) {
+    state->failure = (DecodeFailure) { .code = FAILURE_NONE };
+  }
 
-  *length = nodeList->length;
-  
-  for (int i = 0; i < *length; i++) {
-    JSONNode *item = &nodeList->items[i];
+  // Once no alternative can be undone any more, what they allocated belongs to the decoded value
+  if (state->speculating == 0) {
+    free(state->allocations);
+    state->allocations = NULL;
+    state->allocationCount = 0;
+    state->allocationCapacity = 0;
+  }
+  if (copy != inlineCopy) {
+    free(copy);
+  }
+  return success;
+}
+
+void Projection_addFields(Projection *projection, int count, FieldDef *fields) {
+  for (int i = 0; i < count; i++) {
+    Projection_add(projection, fields[i].name);
+  }
+}
+
+// For the decoders which report the length of the current list as an `int`
+static bool expectIntLength(DecoderState *state) {
+  JSONNode *node = state->currentNode;
+  if (node->tag == JSON_LIST && node->length > INT_MAX) {
+    FAIL(state, FAILURE_INT_LENGTH, node->length);
+  }
+  return true;
+}
+
+bool decodeList(DecoderState *state, void *dest, int *length, size_t size, decodeFun decoder) {
+  if (!expectIntLength(state)) {
+    return false;
+  }
+  size_t sizedLength = 0;
+  bool result = decodeListSized(state, dest, &sizedLength, size, decoder);
+  *length = (int)sizedLength;
+  return result;
+}
+
+// Decodes the first `count` elements of the current list into the array at `dest`
+static bool decodeItems(DecoderState *state, char *dest, size_t count, size_t size, decodeFun decoder) {
+  JSONNode *currentNode = state->currentNode;
+  size_t currentDepth = state->error.depth;
+  JSONNode *items = JSONNode_items(currentNode, state->base);
+
+  for (size_t i = 0; i < count; i++) {
+    JSONNode *item = &items[i];
     state->currentNode = item;
 
     state->error.depth = currentDepth + 1;
@@ -172,7 +460,7 @@ bool decodeList(DecoderState *state, void *dest, int *length, size_t size, decod
       .data = { .JSON_INDEX = { .index = i } }
     });
 
-    bool result = decoder(state, *listDest + (size * i));
+    bool result = decoder(state, dest + (size * i));
     if (!result) {
       return false;
     }
@@ -182,11 +470,773 @@ bool decodeList(DecoderState *state, void *dest, int *length, size_t size, decod
   return true;
 }
 
+bool decodeListSized(DecoderState *state, void *dest, size_t *length, size_t size, decodeFun decoder) {
+  if (state->currentNode->tag != JSON_LIST) {
+    FAIL(state, FAILURE_WRONG_TAG, JSON_LIST, state->currentNode->tag);
+  }
+
+  JSONNode *currentNode = state->currentNode;
+  void **listDest = (void**)dest;
+  *listDest = decodeAlloc(state, currentNode->length * size);
+
+  *length = currentNode->length;
+  return decodeItems(state, *listDest, *length, size, decoder);
+}
+
+bool decodeFixedList(DecoderState *state, void *dest, int *length, size_t capacity, size_t size, decodeFun decoder,
+                     OverflowPolicy overflow) {
+  if (state->currentNode->tag != JSON_LIST) {
+    FAIL(state, FAILURE_WRONG_TAG, JSON_LIST, state->currentNode->tag);
+  }
+
+  size_t count = state->currentNode->length;
+  if (count > capacity) {
+    if (overflow != OVERFLOW_TRUNCATE) {
+      FAIL(state, FAILURE_LIST_CAPACITY, capacity, count);
+    }
+    count = capacity;
+  }
+  if (count > INT_MAX) {
+    FAIL(state, FAILURE_INT_LENGTH, count);
+  }
+
+  *length = (int)count;
+  return decodeItems(state, dest, count, size, decoder);
+}
+
+bool decodeFixedString(DecoderState *state, char *dest, size_t capacity, OverflowPolicy overflow) {
+  if (state->currentNode->tag != JSON_STRING) {
+    FAIL(state, FAILURE_WRONG_TAG, JSON_STRING, state->currentNode->tag);
+  }
+
+  const char *str = JSONNode_string(state->currentNode, state->base);
+  size_t length = strlen(str);
+  if (length >= capacity) {
+    if (overflow != OVERFLOW_TRUNCATE || capacity == 0) {
+      FAIL(state, FAILURE_STRING_CAPACITY, capacity > 0 ? capacity - 1 : 0, length);
+    }
+    // Cutting before a continuation byte would split a character
+    length = capacity - 1;
+    while (length > 0 && ((unsigned char)str[length] & 0xC0) == 0x80) {
+      length--;
+    }
+  }
+  memcpy(dest, str, length);
+  dest[length] = '\0';
+  return true;
+}
+
+// Sets the error path to the field `name` of the current object, leaving the error message to the caller.
+static void setFieldPath(DecoderState *state, char *name) {
+  setDecoderPath(&state->error, state->error.depth++, (JSONPath) {
+    .tag = JSON_FIELD,
+    .data = { .JSON_FIELD = { .fieldName = name } }
+  });
+}
+
+// Sets the error path to `index` of the current list, leaving the error message to the caller.
+static void setIndexPath(DecoderState *state, size_t index) {
+  setDecoderPath(&state->error, state->error.depth++, (JSONPath) {
+    .tag = JSON_INDEX,
+    .data = { .JSON_INDEX = { .index = index } }
+  });
+}
+
+bool decodeTagged(DecoderState *state, char *tagField, const TagTable *table, int *tagDest, void *dest) {
+  if (!expectTag(state, JSON_OBJECT)) {
+    return false;
+  }
+  JSONNode *node = findMember(state, tagField);
+  if (node == NULL) {
+    return failMissingField(state, tagField);
+  }
+  if (node->tag != JSON_STRING) {
+    setFieldPath(state, tagField);
+    FAIL(state, FAILURE_WRONG_TAG, JSON_STRING, node->tag);
+  }
+
+  char *tag = JSONNode_string(node, state->base);
+  int index = TagTable_find(table, tag);
+  if (index == -1) {
+    setFieldPath(state, tagField);
+    FAIL(state, FAILURE_UNKNOWN_TAG, tag);
+  }
+  *tagDest = index;
+  return table->cases[index].decoder(state, dest);
+}
+
+bool decodeMap(DecoderState *state, void *dest, size_t size, decodeFun decoder) {
+  if (!expectTag(state, JSON_OBJECT)) {
+    return false;
+  }
+
+  JSONNode *currentNode = state->currentNode;
+  JSONNode *members = JSONNode_items(currentNode, state->base);
+  bool interned = state->keys != NULL;
+
+  // Interned keys know their length and hash already
+  size_t keyBytes = 0;
+  for (size_t i = 0; i < currentNode->length; i++) {
+    char *key = JSONNode_key(currentNode, i, state->base);
+    keyBytes += (interned ? InternedKey_of(key)->length : strlen(key)) + 1;
+  }
+
+  JSONMap *map = (JSONMap*)dest;
+  *map = JSONMap_newIn(state->arena, currentNode->length, keyBytes, size);
+  if (state->arena == NULL) {
+    logAllocation(state, map->keys);
+    logAllocation(state, map->hashes);
+    logAllocation(state, map->values);
+    logAllocation(state, map->keyData);
+  }
+
+  // Backwards, so that only the last occurrence of a key is decoded: decoding the earlier ones into the
+  // same value would leak what they allocated
+  for (size_t i = currentNode->length; i-- > 0;) {
+    JSONNode *member = &members[i];
+    char *key = JSONNode_key(currentNode, i, state->base);
+    size_t length;
+    uint32_t hash;
+    if (interned) {
+      InternedKey *header = InternedKey_of(key);
+      length = header->length;
+      hash = header->hash;
+    } else {
+      length = strlen(key);
+      hash = InternTable_hash(key, length);
+    }
+
+    size_t entries = map->length;
+    size_t slot = JSONMap_insert(map, key, length, hash);
+    if (map->length == entries) {
+      continue;
+    }
+    // The error path must not point into the tree, which is freed before the error is reported
+    FieldDef field = makeField(map->keys[slot], JSONMap_valueAt(map, slot), decoder);
+    if (!decodeFieldNode(state, member, field)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+ColumnDef makeColumn(char *name, void *dest, size_t size, decodeFun decoder) {
+  return (ColumnDef) {
+    .name = name,
+    .dest = dest,
+    .size = size,
+    .decoder = decoder,
+  };
+}
+
+// Records of a list usually have their fields in the same order, so the position a column was found
+// at in the previous record is tried first. `name` must be interned if `interned` is set.
+static JSONNode *findColumnField(JSONNode *object, char *name, bool interned, size_t *hint, const void *base) {
+  JSONNode *members = JSONNode_items(object, base);
+  if (*hint < object->length) {
+    char *key = JSONNode_key(object, *hint, base);
+    if (interned ? key == name : strcmp(key, name) == 0) {
+      return &members[*hint];
+    }
+  }
+  JSONNode *node = interned ? findInternedField(object, name) : findField(object, name, base);
+  if (node != NULL) {
+    *hint = node - members;
+  }
+  return node;
+}
+
+static bool decodeColumnList(DecoderState *state, int *length, int count, ColumnDef *columns) {
+  if (state->currentNode->tag != JSON_LIST) {
+    FAIL(state, FAILURE_WRONG_TAG, JSON_LIST, state->currentNode->tag);
+  }
+  if (!expectIntLength(state)) {
+    return false;
+  }
+
+  JSONNode *currentNode = state->currentNode;
+  size_t currentDepth = state->error.depth;
+  JSONNode *items = JSONNode_items(currentNode, state->base);
+  bool interned = state->keys != NULL;
+
+  char *names[count];
+  char *arrays[count];
+  size_t hints[count];
+  for (int c = 0; c < count; c++) {
+    // A name that was never interned does not occur anywhere in the document, which `findColumnField`
+    // reports as missing since no field name is NULL.
+    names[c] = interned ? internedName(state, columns[c].name) : columns[c].name;
+    arrays[c] = decodeAlloc(state, currentNode->length * columns[c].size);
+    *(void**)columns[c].dest = arrays[c];
+    hints[c] = c;
+  }
+  *length = (int)currentNode->length;
+
+  for (size_t i = 0; i < currentNode->length; i++) {
+    state->currentNode = &items[i];
+    state->error.depth = currentDepth;
+    setIndexPath(state, i);
+    if (!expectTag(state, JSON_OBJECT)) {
+      return false;
+    }
+
+    for (int c = 0; c < count; c++) {
+      JSONNode *node = findColumnField(state->currentNode, names[c], interned, &hints[c], state->base);
+      if (node == NULL) {
+        return failMissingField(state, columns[c].name);
+      }
+      FieldDef field = makeField(columns[c].name, arrays[c] + i * columns[c].size, columns[c].decoder);
+      if (!decodeFieldNode(state, node, field)) {
+        return false;
+      }
+    }
+  }
+
+  state->currentNode = currentNode;
+  state->error.depth = currentDepth;
+  return true;
+}
+
+bool decodeColumns(DecoderState *state, int *length, int count, ...) {
+  ColumnDef columns[count];
+  va_list ap;
+  va_start(ap, count);
+  for (int i = 0; i < count; i++) {
+    columns[i] = va_arg(ap, ColumnDef);
+  }
+  va_end(ap);
+  return decodeColumnList(state, length, count, columns);
+}
+
+// Checks that the current node is a list of numbers, so that the array decoders can convert the
+// items in a loop without any further checks.
+static bool expectNumberList(DecoderState *state, JSONNode **dest) {
+  if (state->currentNode->tag != JSON_LIST) {
+    FAIL(state, FAILURE_WRONG_TAG, JSON_LIST, state->currentNode->tag);
+  }
+  if (!expectIntLength(state)) {
+    return false;
+  }
+  JSONNode *list = state->currentNode;
+  JSONNode *items = JSONNode_items(list, state->base);
+  for (size_t i = 0; i < list->length; i++) {
+    if (items[i].tag != JSON_NUMBER) {
+      setIndexPath(state, i);
+      FAIL(state, FAILURE_WRONG_TAG, JSON_NUMBER, items[i].tag);
+    }
+  }
+  *dest = list;
+  return true;
+}
+
+// `min` is inclusive, `maxExclusive` is the first value too large for `type`
+#define DEFINE_INTEGER_ARRAY_DECODER(name, type, min, maxExclusive)\
+  bool name(DecoderState *state, void *dest, int *length) {\
+    JSONNode *list;\
+    if (!expectNumberList(state, &list)) return false;\
+    int count = (int)list->length;\
+    JSONNode *items = JSONNode_items(list, state->base);\
+    type *array = decodeAlloc(state, count * sizeof(type));\
+    for (int i = 0; i < count; i++) {\
+      double num = items[i].data.JSON_NUMBER.number;\
+      if (!(num >= (min) && num < (maxExclusive)) || (double)(type)num != num) {\
+        decodeFreeLast(state, array);\
+        setIndexPath(state, i);\
+        FAIL(state, FAILURE_NOT_INTEGER, num);\
+      }\
+      array[i] = (type)num;\
+    }\
+    *(type**)dest = array;\
+    *length = count;\
+    return true;\
+  }
+
+#define DEFINE_FLOATING_ARRAY_DECODER(name, type)\
+  bool name(DecoderState *state, void *dest, int *length) {\
+    JSONNode *list;\
+    if (!expectNumberList(state, &list)) return false;\
+    int count = (int)list->length;\
+    JSONNode *items = JSONNode_items(list, state->base);\
+    type *array = decodeAlloc(state, count * sizeof(type));\
+    for (int i = 0; i < count; i++) {\
+      array[i] = (type)items[i].data.JSON_NUMBER.number;\
+    }\
+    *(type**)dest = array;\
+    *length = count;\
+    return true;\
+  }
+
+DEFINE_INTEGER_ARRAY_DECODER(decodeIntArray, int, (double)INT_MIN, (double)INT_MAX + 1)
+DEFINE_INTEGER_ARRAY_DECODER(decodeInt64Array, int64_t, (double)INT64_MIN, 9223372036854775808.0)
+DEFINE_FLOATING_ARRAY_DECODER(decodeDoubleArray, double)
+DEFINE_FLOATING_ARRAY_DECODER(decodeFloatArray, float)
+
+bool decodeEach(DecoderState *state, size_t size, decodeFun decoder, eachFun callback, void *ctx) {
+  if (state->currentNode->tag != JSON_LIST) {
+    FAIL(state, FAILURE_WRONG_TAG, JSON_LIST, state->currentNode->tag);
+  }
+
+  JSONNode *currentNode = state->currentNode;
+  size_t currentDepth = state->error.depth;
+  JSONNode *items = JSONNode_items(currentNode, state->base);
+  void *scratch = malloc(size);
+
+  for (size_t i = 0; i < currentNode->length; i++) {
+    state->currentNode = &items[i];
+    state->error.depth = currentDepth;
+    setIndexPath(state, i);
+
+    memset(scratch, 0, size);
+    if (!decoder(state, scratch)) {
+      free(scratch);
+      return false;
+    }
+    callback(scratch, ctx);
+  }
+
+  free(scratch);
+  state->currentNode = currentNode;
+  state->error.depth = currentDepth;
+  return true;
+}
+
+// Fails with an error which, like those of `decode`, is not located within the decoded value. It comes
+// from the entry point rather than from a decoder, so its message is formatted right away.
+static bool failParsing(DecoderState *state, const char *errorMsg) {
+  state->error.depth = 0;
+  allocsprintf(state->error.errorMsg, "Parsing failed: %s", errorMsg);
+  return false;
+}
+
+static TokenType lastTokenType(TokenList *tokens) {
+  return tokens->tokens[tokens->length - 1].tokenType;
+}
+
+// Lexes the tokens of the next element of the list into `tokens`, which is empty beforehand. At the
+// end of the list, this is just the closing bracket.
+static bool lexElement(DecoderState *state, LexerState *lexer) {
+  int depth = 0;
+  do {
+    if (lexerAtEnd(lexer)) {
+      return failParsing(state, "Expecting ] at end of input");
+    }
+    if (!lexToken(lexer)) {
+      return failParsing(state, lexer->errorMsg);
+    }
+    switch (lastTokenType(lexer->tokenList)) {
+      case TOKEN_OPEN_CURLY:
+      case TOKEN_OPEN_SQUARE:
+        depth++;
+        break;
+
+      case TOKEN_CLOSE_CURLY:
+      case TOKEN_CLOSE_SQUARE:
+        depth--;
+        break;
+
+      default:
+        break;
+    }
+  } while (depth > 0);
+  return true;
+}
+
+static bool streamElements(DecoderState *state, LexerState *lexer, const ParseOptions *options, void *scratch,
+                           size_t size, decodeFun decoder, eachFun callback, void *ctx) {
+  TokenList *tokens = lexer->tokenList;
+
+  if (lexerAtEnd(lexer)) {
+    return failParsing(state, "Expecting [ at start of input");
+  }
+  if (!lexToken(lexer)) {
+    return failParsing(state, lexer->errorMsg);
+  }
+  if (lastTokenType(tokens) != TOKEN_OPEN_SQUARE) {
+    return failParsing(state, "Expecting [ at start of input");
+  }
+  TokenList_clear(tokens);
+
+  for (size_t i = 0;; i++) {
+    if (!lexElement(state, lexer)) {
+      return false;
+    }
+    // Also accepts a trailing comma, like the parser
+    if (tokens->length == 1 && tokens->tokens[0].tokenType == TOKEN_CLOSE_SQUARE) {
+      TokenList_clear(tokens);
+      break;
+    }
+    ParserResult parsed = parseTokens(tokens->tokens, tokens->length, options);
+    TokenList_clear(tokens);
+    if (parsed.status != PARSER_SUCCESS) {
+      return failParsing(state, parsed.result.PARSER_ERROR.errorMsg);
+    }
+
+    JSONNode *tree = parsed.result.PARSER_SUCCESS.tree;
+    state->currentNode = tree;
+    state->keys = parsed.result.PARSER_SUCCESS.keys;
+    state->error.depth = 0;
+    setIndexPath(state, i);
+
+    memset(scratch, 0, size);
+    bool success = decoder(state, scratch);
+    if (!success) {
+      formatFailure(state);
+    }
+    if (options->inSitu) {
+      JSONNode_freeInSitu(tree);
+    } else {
+      JSONNode_free(tree);
+    }
+    InternTable_free(state->keys);
+    state->currentNode = NULL;
+    state->keys = NULL;
+    state->names = (FieldNameCache) { 0 };
+    if (!success) {
+      return false;
+    }
+    callback(scratch, ctx);
+
+    if (lexerAtEnd(lexer)) {
+      return failParsing(state, "Expecting ] at end of input");
+    }
+    if (!lexToken(lexer)) {
+      return failParsing(state, lexer->errorMsg);
+    }
+    Token separator = tokens->tokens[0];
+    TokenList_clear(tokens);
+    if (separator.tokenType == TOKEN_CLOSE_SQUARE) {
+      break;
+    }
+    if (separator.tokenType != TOKEN_COMMA) {
+      char errorMsg[MAX_ERR_SIZE];
+      snprintf(errorMsg, MAX_ERR_SIZE, "Expecting , at %zu:%zu", separator.row, separator.col);
+      return failParsing(state, errorMsg);
+    }
+  }
+
+  if (!lexerAtEnd(lexer)) {
+    char errorMsg[MAX_ERR_SIZE];
+    snprintf(errorMsg, MAX_ERR_SIZE, "Trailing tokens at %zu:%zu, missmatched braces?", lexer->row, lexer->col);
+    return failParsing(state, errorMsg);
+  }
+  return true;
+}
+
+DecodeResult decodeStream(char *input, size_t size, decodeFun decoder, eachFun callback, void *ctx) {
+  return decodeStreamWithOptions(input, size, decoder, callback, ctx, NULL);
+}
+
+DecodeResult decodeStreamWithOptions(char *input, size_t size, decodeFun decoder, eachFun callback, void *ctx,
+                                     const ParseOptions *options) {
+  ParseOptions streamOptions = options != NULL ? *options : (ParseOptions) { .projection = NULL, .inSitu = false };
+  char errorMsg[MAX_ERR_SIZE];
+  size_t length;
+  if (!measureInput(input, &streamOptions.limits, &length, errorMsg)) {
+    return parsingFailed(errorMsg);
+  }
+
+  TokenList tokens = TokenList_new(TOKEN_START_CAPACITY, streamOptions.inSitu);
+  LexerState lexer = LexerState_new(input, &tokens, streamOptions.inSitu);
+  // The depth, the values and the elements of the list are counted across the whole list, as when decoding
+  // it at once
+  lexer.limits = &streamOptions.limits;
+  lexer.projection = streamOptions.projection;
+  DecoderState state = newDecoderState(NULL, NULL, &streamOptions);
+  void *scratch = malloc(size);
+
+  bool success = streamElements(&state, &lexer, &streamOptions, scratch, size, decoder, callback, ctx);
+
+  free(scratch);
+  LexerState_free(&lexer);
+  TokenList_free(&tokens);
+  if (success) {
+    DecodeError_free(state.error);
+  }
+  return (DecodeResult) {
+    .success = success,
+    .error = state.error,
+  };
+}
+
+struct DecodeTask {
+  enum { TASK_LEXING, TASK_PARSING, TASK_DECODING, TASK_DONE } phase;
+  ParseOptions options;
+  // The element of the list which is being decoded, which is passed to `callback`
+  decodeFun decoder;
+  void *dest;
+  eachFun callback;
+  void *ctx;
+  size_t size;
+  size_t nextElement;
+
+  // Start of the input, to check its length against the limits as it is lexed
+  char *input;
+  TokenList tokens;
+  LexerState lexer;
+  ContainerCounter counter;
+  ParserTask parser;
+  // Number of parsed tokens whose strings have been freed
+  size_t freedTokens;
+  JSONNode *tree;
+  InternTable *keys;
+  DecoderState state;
+  bool success;
+};
+
+DecodeTask *DecodeTask_newEach(char *input, size_t size, decodeFun decoder, eachFun callback, void *ctx,
+                               const ParseOptions *options) {
+  DecodeTask *task = calloc(1, sizeof(DecodeTask));
+  if (options != NULL) {
+    task->options = *options;
+  }
+  task->phase = TASK_LEXING;
+  task->tokens = TokenList_new(TOKEN_START_CAPACITY, task->options.inSitu);
+  task->lexer = LexerState_new(input, &task->tokens, task->options.inSitu);
+  task->lexer.limits = &task->options.limits;
+  task->lexer.projection = task->options.projection;
+  task->input = input;
+  task->counter = ContainerCounter_new();
+  task->state = newDecoderState(NULL, NULL, &task->options);
+  task->dest = malloc(size);
+  task->size = size;
+  task->decoder = decoder;
+  task->callback = callback;
+  task->ctx = ctx;
+  return task;
+}
+
+// Ends the task with the outcome of the last step
+static DecodeStatus finishTask(DecodeTask *task, bool success) {
+  task->success = success;
+  task->phase = TASK_DONE;
+  return DECODE_DONE;
+}
+
+static DecodeStatus failLexing(DecodeTask *task, const char *errorMsg) {
+  LexerState_free(&task->lexer);
+  ContainerCounter_free(&task->counter);
+  TokenList_free(&task->tokens);
+  return finishTask(task, failParsing(&task->state, errorMsg));
+}
+
+static DecodeStatus lexStep(DecodeTask *task, size_t budget) {
+  LexerState *lexer = &task->lexer;
+  size_t bytes = budget < SIZE_MAX / TOKEN_BYTES_ESTIMATE ? budget * TOKEN_BYTES_ESTIMATE : SIZE_MAX;
+  // Looking for the end of the input as we go keeps each step bounded
+  char *end = memchr(lexer->input, '\0', bytes);
+  char *stop = end != NULL ? end : lexer->input + bytes;
+
+  size_t maxInputBytes = task->options.limits.maxInputBytes;
+  if (maxInputBytes > 0 && (size_t)(stop - task->input) > maxInputBytes) {
+    char errorMsg[MAX_ERR_SIZE];
+    sprintf(errorMsg, "Input is longer than the maximum of %zu bytes", maxInputBytes);
+    return failLexing(task, errorMsg);
+  }
+  if (!lexIndexedRange(lexer, stop, NULL)) {
+    return failLexing(task, lexer->errorMsg);
+  }
+  ContainerCounter_scan(&task->counter, task->tokens.tokens, task->tokens.length);
+  if (end == NULL) {
+    return DECODE_IN_PROGRESS;
+  }
+
+  LexerState_free(lexer);
+  ContainerCounter_free(&task->counter);
+  task->parser = ParserTask_new(task->tokens.tokens, task->tokens.length, &task->options);
+  task->phase = TASK_PARSING;
+  return DECODE_IN_PROGRESS;
+}
+
+// Frees the strings of the tokens which have been parsed, as the parser copies them, so that freeing the
+// token list at the end is cheap
+static void freeParsedStrings(DecodeTask *task) {
+  Token *parsed = task->parser.state.current_token;
+  if (!task->tokens.borrowsStrings) {
+    for (Token *token = task->tokens.tokens + task->freedTokens; token < parsed; token++) {
+      if (token->tokenType == TOKEN_STRING_LITERAL) {
+        free(token->data.TOKEN_STRING_LITERAL.string);
+      }
+    }
+  }
+  task->freedTokens = parsed - task->tokens.tokens;
+}
+
+static void freeTokens(DecodeTask *task) {
+  TokenList unparsed = task->tokens;
+  unparsed.tokens += task->freedTokens;
+  unparsed.length -= task->freedTokens;
+  TokenList_clear(&unparsed);
+  free(task->tokens.tokens);
+}
+
+static DecodeStatus parseStep(DecodeTask *task, size_t budget) {
+  bool done = ParserTask_step(&task->parser, budget);
+  freeParsedStrings(task);
+  if (!done) {
+    return DECODE_IN_PROGRESS;
+  }
+
+  ParserResult parsed = ParserTask_finish(&task->parser);
+  freeTokens(task);
+  if (parsed.status != PARSER_SUCCESS) {
+    return finishTask(task, failParsing(&task->state, parsed.result.PARSER_ERROR.errorMsg));
+  }
+  task->tree = parsed.result.PARSER_SUCCESS.tree;
+  task->keys = parsed.result.PARSER_SUCCESS.keys;
+  task->state.currentNode = task->tree;
+  task->state.keys = task->keys;
+  task->phase = TASK_DECODING;
+  return DECODE_IN_PROGRESS;
+}
+
+// The elements of the list are decoded a few at a time, each of which counts for the number of its items
+static DecodeStatus decodeElementsStep(DecodeTask *task, size_t budget) {
+  DecoderState *state = &task->state;
+  if (!expectTag(state, JSON_LIST)) {
+    return finishTask(task, false);
+  }
+
+  JSONNode *items = task->tree->data.JSON_LIST.items;
+  size_t spent = 0;
+  while (task->nextElement < task->tree->length && spent < budget) {
+    size_t i = task->nextElement++;
+    state->currentNode = &items[i];
+    state->error.depth = 0;
+    setIndexPath(state, i);
+
+    memset(task->dest, 0, task->size);
+    if (!task->decoder(state, task->dest)) {
+      return finishTask(task, false);
+    }
+    task->callback(task->dest, task->ctx);
+    spent += 1 + items[i].length;
+  }
+
+  state->currentNode = task->tree;
+  state->error.depth = 0;
+  if (task->nextElement < task->tree->length) {
+    return DECODE_IN_PROGRESS;
+  }
+  return finishTask(task, true);
+}
+
+DecodeStatus decodeStep(DecodeTask *task, size_t budget) {
+  if (budget == 0) {
+    budget = 1;
+  }
+  switch (task->phase) {
+    case TASK_LEXING:   return lexStep(task, budget);
+    case TASK_PARSING:  return parseStep(task, budget);
+    case TASK_DECODING: return decodeElementsStep(task, budget);
+    case TASK_DONE:     return DECODE_DONE;
+  }
+  return DECODE_DONE;
+}
+
+DecodeResult DecodeTask_finish(DecodeTask *task) {
+  switch (task->phase) {
+    case TASK_LEXING:
+      LexerState_free(&task->lexer);
+      ContainerCounter_free(&task->counter);
+      TokenList_free(&task->tokens);
+      break;
+
+    case TASK_PARSING:
+      ParserTask_finish(&task->parser);
+      freeTokens(task);
+      break;
+
+    default:
+      break;
+  }
+
+  if (task->phase == TASK_DONE && !task->success) {
+    formatFailure(&task->state);
+  }
+  if (task->tree != NULL) {
+    if (task->options.inSitu) {
+      JSONNode_freeInSitu(task->tree);
+    } else {
+      JSONNode_free(task->tree);
+    }
+    InternTable_free(task->keys);
+  }
+
+  bool success = task->phase == TASK_DONE && task->success;
+  if (task->phase != TASK_DONE) {
+    DecoderState *state = &task->state;
+    state->error.depth = 0;
+    allocsprintf(state->error.errorMsg, "Decoding was not finished");
+  }
+  if (success) {
+    DecodeError_free(task->state.error);
+  }
+  DecodeResult result = {
+    .success = success,
+    .error = task->state.error,
+  };
+
+  free(task->dest);
+  free(task);
+  return result;
+}
+
+// Formats the message of the failure recorded by the last decoder, unless the entry point failed with a
+// message of its own. The strings of the failure may point into the tree, so this must be done before the
+// tree is freed.
+static void formatFailure(DecoderState *state) {
+  if (state->error.errorMsg != NULL) {
+    return;
+  }
+  DecodeFailure failure = state->failure;
+  switch (failure.code) {
+    case FAILURE_NONE:
+      allocsprintf(state->error.errorMsg, "Decoder failed");
+      break;
+
+    case FAILURE_WRONG_TAG:
+      allocsprintf(state->error.errorMsg, "Expecting %s, got %s", nodeTagToString(failure.data.FAILURE_WRONG_TAG.expected),
+                   nodeTagToString(failure.data.FAILURE_WRONG_TAG.got));
+      break;
+
+    case FAILURE_NOT_INTEGER:
+      allocsprintf(state->error.errorMsg, "Expected integer, got %g", failure.data.FAILURE_NOT_INTEGER.number);
+      break;
+
+    case FAILURE_MISSING_FIELD:
+      allocsprintf(state->error.errorMsg, "No field with name \"%s\" was found", failure.data.FAILURE_MISSING_FIELD.name);
+      break;
+
+    case FAILURE_NO_DECODER:
+      allocsprintf(state->error.errorMsg, "No decoder to try");
+      break;
+
+    case FAILURE_INT_LENGTH:
+      allocsprintf(state->error.errorMsg, "List of %zu elements is too long for an int length",
+                   failure.data.FAILURE_INT_LENGTH.length);
+      break;
+
+    case FAILURE_LIST_CAPACITY:
+      allocsprintf(state->error.errorMsg, "Expecting at most %zu elements, got %zu",
+                   failure.data.FAILURE_LIST_CAPACITY.capacity, failure.data.FAILURE_LIST_CAPACITY.length);
+      break;
+
+    case FAILURE_STRING_CAPACITY:
+      allocsprintf(state->error.errorMsg, "Expecting a string of at most %zu bytes, got %zu",
+                   failure.data.FAILURE_STRING_CAPACITY.capacity, failure.data.FAILURE_STRING_CAPACITY.length);
+      break;
+
+    case FAILURE_UNKNOWN_TAG:
+      allocsprintf(state->error.errorMsg, "Unknown tag \"%s\"", failure.data.FAILURE_UNKNOWN_TAG.tag);
+      break;
+  }
+}
+
 char *buildDecoderError(DecoderError err) {
   StringBuilder builder = StringBuilder_new();
 
   StringBuilder_append(&builder, "At root");
-  for (int i = 0; i < err.depth; i++) {
+  for (size_t i = 0; i < err.depth; i++) {
     JSONPath path = err.path[i];
     switch (path.tag) {
       case JSON_FIELD:
@@ -194,7 +1244,7 @@ char *buildDecoderError(DecoderError err) {
         break;
 
       case JSON_INDEX:
-        StringBuilder_append(&builder, "[%d]", path.data.JSON_INDEX.index);
+        StringBuilder_append(&builder, "[%zu]", path.data.JSON_INDEX.index);
         break;
     }
   }
@@ -210,54 +1260,184 @@ void printDecoderError(DecoderError err) {
 }
 
 DecodeResult decode(char *input, void *dest, decodeFun decoder) {
+  return decodeWithOptions(input, dest, decoder, NULL);
+}
+
+static DecodeResult parsingFailed(const char *parserErrorMsg) {
+  char *errorMsg;
+  allocsprintf(errorMsg, "Parsing failed: %s", parserErrorMsg);
+
+  return (DecodeResult) {
+    .error = (DecoderError) {
+      .path = NULL,
+      .depth = 0,
+      .errorMsg = errorMsg,
+    },
+    .success = false,
+  };
+}
+
+DecodeResult decodeWithOptions(char *input, void *dest, decodeFun decoder, const ParseOptions *options) {
   DecodeResult result;
 
-  ParserResult parseResult = parse(input);
+  ParserResult parseResult = parseWithOptions(input, options);
 
   if (parseResult.status != PARSER_SUCCESS) {
-    char *errorMsg;
-    allocsprintf(errorMsg, "Parsing failed: %s", parseResult.result.PARSER_ERROR.errorMsg);
+    return parsingFailed(parseResult.result.PARSER_ERROR.errorMsg);
+  }
+
+  JSONNode *node = parseResult.result.PARSER_SUCCESS.tree;
+  InternTable *keys = parseResult.result.PARSER_SUCCESS.keys;
+
+  result = runDecoder(node, keys, NULL, options, dest, decoder);
+
+  if (options != NULL && options->inSitu) {
+    JSONNode_freeInSitu(node);
+  } else {
+    JSONNode_free(node);
+  }
+  InternTable_free(keys);
+  return result;
+}
 
-    result = (DecodeResult) {
-      .error = (DecoderError) {
-        .path = NULL,
-        .depth = 0,
-        .errorMsg = errorMsg,
-      },
-      .success = false,
-    };
-    return result;
+DecodeResult decodeWithContext(DecodeContext *context, char *input, void *dest, decodeFun decoder,
+                               const ParseOptions *options) {
+  bool inSitu = options != NULL && options->inSitu;
+  ParseOptions parseOptions = options != NULL ? *options : (ParseOptions) { .projection = NULL, .inSitu = false };
+  char errorMsg[MAX_ERR_SIZE];
+  size_t length;
+  if (!measureInput(input, &parseOptions.limits, &length, errorMsg)) {
+    return parsingFailed(errorMsg);
+  }
+  // Lexing a copy of the input in situ saves allocating every string, which the decoders copy anyway
+  if (!inSitu) {
+    size_t size = length + 1;
+    if (size > context->inputCapacity) {
+      free(context->input);
+      context->input = malloc(size);
+      context->inputCapacity = size;
+    }
+    input = memcpy(context->input, input, size);
+    parseOptions.inSitu = true;
   }
 
-  #define DECODER_ERROR_START_CAPACITY 5
+  if (!lexInto(input, true, &parseOptions.limits, parseOptions.projection, &context->tokens, errorMsg)) {
+    return parsingFailed(errorMsg);
+  }
+
+  // Documents with keys that are never the same, like maps keyed by id, would otherwise grow the table forever
+  if (context->parser.keys->length > DECODE_CONTEXT_MAX_KEYS) {
+    InternTable_clear(context->parser.keys);
+  }
+  ParserResult parseResult = parseTokensWith(context->tokens.tokens, context->tokens.length, &parseOptions, &context->parser);
+  TokenList_clear(&context->tokens);
+  if (parseResult.status != PARSER_SUCCESS) {
+    return parsingFailed(parseResult.result.PARSER_ERROR.errorMsg);
+  }
 
-  JSONNode *node = parseResult.result.PARSER_SUCCESS.tree;
   DecoderState state = {
-    .currentNode = node,
+    .currentNode = parseResult.result.PARSER_SUCCESS.tree,
+    .keys = parseResult.result.PARSER_SUCCESS.keys,
+    .inSitu = inSitu,
+    .arena = parseOptions.outputArena,
+    .error = (DecoderError) {
+      .errorMsg = NULL,
+      .depth = 0,
+      .pathCapacity = context->pathCapacity,
+      .path = context->path,
+    },
+  };
+  if (state.error.path == NULL) {
+    state.error.pathCapacity = DECODER_ERROR_START_CAPACITY;
+    state.error.path = calloc(DECODER_ERROR_START_CAPACITY, sizeof(JSONPath));
+  }
+  bool success = decoder(&state, dest);
+  if (!success) {
+    formatFailure(&state);
+  }
+
+  // The path of a failed decode belongs to the caller along with the rest of the error
+  context->path = success ? state.error.path : NULL;
+  context->pathCapacity = success ? state.error.pathCapacity : 0;
+  return (DecodeResult) {
+    .success = success,
+    .error = success ? (DecoderError) { .path = NULL, .depth = 0, .pathCapacity = 0, .errorMsg = NULL } : state.error,
+  };
+}
+
+DecodeContext DecodeContext_new() {
+  return (DecodeContext) {
+    .input = NULL,
+    .inputCapacity = 0,
+    .tokens = TokenList_new(TOKEN_START_CAPACITY, true),
+    .parser = ParserScratch_new(),
+    .path = NULL,
+    .pathCapacity = 0,
+  };
+}
+
+void DecodeContext_free(DecodeContext *context) {
+  free(context->input);
+  context->input = NULL;
+  TokenList_free(&context->tokens);
+  ParserScratch_free(&context->parser);
+  free(context->path);
+  context->path = NULL;
+}
+
+DecodeResult decodeTree(JSONNode *tree, InternTable *keys, void *dest, decodeFun decoder) {
+  return runDecoder(tree, keys, NULL, NULL, dest, decoder);
+}
+
+DecodeResult decodeTreeAt(JSONNode *tree, const void *base, void *dest, decodeFun decoder) {
+  return runDecoder(tree, NULL, base, NULL, dest, decoder);
+}
+
+static DecoderState newDecoderState(JSONNode *tree, InternTable *keys, const ParseOptions *options) {
+
+  return (DecoderState) {
+    .currentNode = tree,
+    .keys = keys,
+    .inSitu = options != NULL && options->inSitu,
+    .arena = options != NULL ? options->outputArena : NULL,
     .error = (DecoderError) {
       .errorMsg = NULL,
+      .depth = 0,
       .pathCapacity = DECODER_ERROR_START_CAPACITY,
       .path = calloc(DECODER_ERROR_START_CAPACITY, sizeof(JSONPath))
     }
   };
+}
+
+static DecodeResult runDecoder(JSONNode *tree, InternTable *keys, const void *base, const ParseOptions *options, void *dest,
+                               decodeFun decoder) {
+  DecodeResult result;
+  DecoderState state = newDecoderState(tree, keys, options);
+  state.base = base;
 
   bool success = decoder(&state, dest);
 
   if (success) {
     DecodeError_free(state.error);
+  } else {
+    formatFailure(&state);
   }
 
-  JSONNode_free(node);
-
   result.error = state.error;
   result.success = success;
   return result;
 }
 
-void setDecoderPath(DecoderError *error, int depth, JSONPath jPath) {
-  if (depth > error->pathCapacity) {
-    int newCapacity = error->pathCapacity * 2;
-    JSONPath *newPath = reallocarray(error->path, newCapacity, sizeof(JSONPath)) ;
+void setDecoderPath(DecoderError *error, size_t depth, JSONPath jPath) {
+  if (depth >= error->pathCapacity) {
+    // The path is never deeper than the tree, so only a capacity which cannot be allocated anyway stops doubling
+    size_t newCapacity = error->pathCapacity == 0 ? DECODER_ERROR_START_CAPACITY
+      : error->pathCapacity <= SIZE_MAX / 2 / sizeof(JSONPath) ? error->pathCapacity * 2
+      : SIZE_MAX / sizeof(JSONPath);
+    if (newCapacity <= depth) {
+      newCapacity = depth + 1;
+    }
+    JSONPath *newPath = reallocarray(error->path, newCapacity, sizeof(JSONPath));
     error->path = newPath;
     error->pathCapacity = newCapacity;
   }
@@ -0,0 +1,79 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "encoders.h"
+
+void encodeInt(StringBuilder *builder, const void *src) {
+  StringBuilder_append(builder, "%d", *(const int*)src);
+}
+
+void encodeFloat(StringBuilder *builder, const void *src) {
+  double num = *(const double*)src;
+  if (isfinite(num)) {
+    StringBuilder_append(builder, "%.17g", num);
+  } else {
+    // JSON has no representation for these
+    StringBuilder_append(builder, "null");
+  }
+}
+
+static const char *escapeOf(char c) {
+  switch (c) {
+    case '"':  return "\\\"";
+    case '\\': return "\\\\";
+    case '\b': return "\\b";
+    case '\f': return "\\f";
+    case '\n': return "\\n";
+    case '\r': return "\\r";
+    case '\t': return "\\t";
+    default:   return NULL;
+  }
+}
+
+void encodeString(StringBuilder *builder, const void *src) {
+  const char *str = *(char* const*)src;
+  if (str == NULL) {
+    StringBuilder_append(builder, "null");
+    return;
+  }
+
+  StringBuilder_append(builder, "\"");
+  while (*str != '\0') {
+    // Append runs of characters which need no escaping at once
+    size_t run = 0;
+    while (str[run] != '\0' && str[run] != '"' && str[run] != '\\' && (unsigned char)str[run] >= 0x20) {
+      run++;
+    }
+    if (run > 0) {
+      StringBuilder_append(builder, "%.*s", (int)run, str);
+      str += run;
+      continue;
+    }
+
+    const char *escape = escapeOf(*str);
+    if (escape != NULL) {
+      StringBuilder_append(builder, "%s", escape);
+    } else {
+      StringBuilder_append(builder, "\\u%04x", (unsigned char)*str);
+    }
+    str++;
+  }
+  StringBuilder_append(builder, "\"");
+}
+
+void encodeList(StringBuilder *builder, const void *list, size_t length, size_t size, encodeFun encoder) {
+  StringBuilder_append(builder, "[");
+  for (size_t i = 0; i < length; i++) {
+    if (i > 0) StringBuilder_append(builder, ",");
+    encoder(builder, (const char*)list + (size * i));
+  }
+  StringBuilder_append(builder, "]");
+}
+
+char *encode(const void *src, encodeFun encoder) {
+  StringBuilder builder = StringBuilder_new();
+  builder.contents[0] = '\0';
+  encoder(&builder, src);
+  return StringBuilder_getString(&builder);
+}
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "interntable.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+uint32_t InternTable_hash(const char *string, size_t length) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)string[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+InternTable *InternTable_new() {
+  InternTable *table = calloc(1, sizeof(InternTable));
+  table->slots = calloc(INTERNTABLE_START_CAPACITY, sizeof(InternedKey*));
+  table->capacity = INTERNTABLE_START_CAPACITY;
+  table->length = 0;
+  return table;
+}
+
+// Returns the slot where `string` is stored, or the empty slot where it would be inserted.
+static InternedKey **findSlot(const InternTable *table, const char *string, size_t length, uint32_t hash) {
+  size_t mask = table->capacity - 1;
+  size_t i = hash & mask;
+  while (table->slots[i] != NULL) {
+    InternedKey *key = table->slots[i];
+    if (key->hash == hash && key->length == length && memcmp(key->string, string, length) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return &table->slots[i];
+}
+
+static void resize(InternTable *table) {
+  InternedKey **oldSlots = table->slots;
+  size_t oldCapacity = table->capacity;
+
+  table->capacity = oldCapacity * 2;
+  table->slots = calloc(table->capacity, sizeof(InternedKey*));
+
+  for (size_t i = 0; i < oldCapacity; i++) {
+    InternedKey *key = oldSlots[i];
+    if (key != NULL) {
+      *findSlot(table, key->string, key->length, key->hash) = key;
+    }
+  }
+  free(oldSlots);
+}
+
+char *InternTable_intern(InternTable *table, const char *string) {
+  size_t length = strlen(string);
+  uint32_t hash = InternTable_hash(string, length);
+
+  InternedKey **slot = findSlot(table, string, length, hash);
+  if (*slot != NULL) {
+    return (*slot)->string;
+  }
+
+  InternedKey *key = malloc(sizeof(InternedKey) + length + 1);
+  key->hash = hash;
+  key->length = length;
+  memcpy(key->string, string, length + 1);
+  *slot = key;
+
+  // Keep the load factor at or below 1/2
+  if (++table->length * 2 > table->capacity) {
+    resize(table);
+  }
+  return key->string;
+}
+
+char *InternTable_find(const InternTable *table, const char *string) {
+  size_t length = strlen(string);
+  InternedKey *key = *findSlot(table, string, length, InternTable_hash(string, length));
+  return key != NULL ? key->string : NULL;
+}
+
+void InternTable_clear(InternTable *table) {
+  for (size_t i = 0; i < table->capacity; i++) {
+    free(table->slots[i]);
+    table->slots[i] = NULL;
+  }
+  table->length = 0;
+}
+
+void InternTable_free(InternTable *table) {
+  if (table == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < table->capacity; i++) {
+    free(table->slots[i]);
+  }
+  free(table->slots);
+  free(table);
+}
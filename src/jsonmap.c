@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "interntable.h"
+#include "jsonmap.h"
+
+JSONMap JSONMap_new(size_t count, size_t keyBytes, size_t valueSize) {
+  return JSONMap_newIn(NULL, count, keyBytes, valueSize);
+}
+
+static void *allocZeroed(Arena *arena, size_t count, size_t size) {
+  return arena != NULL ? memset(Arena_alloc(arena, count * size), 0, count * size) : calloc(count, size);
+}
+
+JSONMap JSONMap_newIn(Arena *arena, size_t count, size_t keyBytes, size_t valueSize) {
+  // At most half full, so that probe sequences stay short
+  size_t capacity = 2;
+  while (capacity < 2 * count) {
+    capacity *= 2;
+  }
+
+  return (JSONMap) {
+    .keys = allocZeroed(arena, capacity, sizeof(char*)),
+    .hashes = arena != NULL ? Arena_alloc(arena, capacity * sizeof(uint32_t)) : malloc(capacity * sizeof(uint32_t)),
+    .values = allocZeroed(arena, capacity, valueSize),
+    .valueSize = valueSize,
+    .length = 0,
+    .capacity = capacity,
+    .keyData = arena != NULL ? Arena_alloc(arena, keyBytes) : malloc(keyBytes),
+    .keyDataLength = 0,
+  };
+}
+
+// Returns the slot holding `key`, or the empty slot where it would be inserted.
+static size_t findSlot(const JSONMap *map, const char *key, uint32_t hash) {
+  size_t mask = map->capacity - 1;
+  size_t i = hash & mask;
+  while (map->keys[i] != NULL) {
+    if (map->hashes[i] == hash && strcmp(map->keys[i], key) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+size_t JSONMap_insert(JSONMap *map, const char *key, size_t length, uint32_t hash) {
+  size_t slot = findSlot(map, key, hash);
+  if (map->keys[slot] == NULL) {
+    char *copy = map->keyData + map->keyDataLength;
+    memcpy(copy, key, length + 1);
+    map->keyDataLength += length + 1;
+
+    map->keys[slot] = copy;
+    map->hashes[slot] = hash;
+    map->length++;
+  }
+  return slot;
+}
+
+void *JSONMap_get(const JSONMap *map, const char *key) {
+  size_t slot = findSlot(map, key, InternTable_hash(key, strlen(key)));
+  return map->keys[slot] != NULL ? JSONMap_valueAt(map, slot) : NULL;
+}
+
+void JSONMap_free(JSONMap *map) {
+  free(map->keys);
+  free(map->hashes);
+  free(map->values);
+  free(map->keyData);
+}
@@ -0,0 +1,67 @@
+#include "decoders.h"
+#include "stdio.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decodes a generated document of more than INT_MAX bytes, so that any length or position which is
+// still kept in an `int` overflows. It needs over 2 GB of memory, which is why it is not part of
+// decodeTest.
+
+static int failures = 0;
+
+#define CHECK(condition) do {\
+  if (!(condition)) {\
+    printf("Check failed at line %d: %s\n", __LINE__, #condition);\
+    failures++;\
+  }\
+} while(0)
+
+typedef struct NumberList {
+  int *numbers;
+  int length;
+} NumberList;
+
+bool decodeNumberList(DecoderState *state, void *dest) {
+  NumberList *numberList = (NumberList*)dest;
+  return decodeList(state, &numberList->numbers, &numberList->length, sizeof(int), decodeInt);
+}
+
+int main() {
+  // The value starts on the first line, past column INT_MAX
+  size_t padding = (size_t)INT_MAX + 1000;
+  const char *value = "[1, 2, 3]";
+  size_t length = padding + strlen(value);
+  char *input = malloc(length + 1);
+  if (input == NULL) {
+    printf("Not enough memory for a document of %zu bytes\n", length);
+    return 1;
+  }
+  memset(input, ' ', padding);
+  strcpy(input + padding, value);
+
+  NumberList numberList;
+  DecodeResult res = decode(input, &numberList, decodeNumberList);
+  CHECK(res.success);
+  if (res.success) {
+    CHECK(numberList.length == 3 && numberList.numbers[0] == 1 && numberList.numbers[2] == 3);
+    free(numberList.numbers);
+  } else {
+    printf("%s\n", res.error.errorMsg);
+    DecodeError_free(res.error);
+  }
+
+  // The position of an error is not truncated either
+  input[length - 2] = '"';
+  res = decode(input, &numberList, decodeNumberList);
+  char expected[64];
+  snprintf(expected, sizeof(expected), "Parsing failed: Unterminated string literal at 1:%zu", length - 1);
+  CHECK(!res.success && strcmp(res.error.errorMsg, expected) == 0);
+  if (!res.success) {
+    printf("%s\n", res.error.errorMsg);
+    DecodeError_free(res.error);
+  }
+
+  free(input);
+  return failures > 0;
+}
@@ -1,8 +1,12 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "lexer.h"
+#include "parser.h"
+#include "structural.h"
+#include "unicode.h"
 
 #define FAIL(state, args...) do {\
   sprintf(state->errorMsg, args);\
@@ -13,82 +17,318 @@
   if (!cmd) return false;\
 } while(0)
 
+#define OPEN_CONTAINERS_START_CAPACITY 16
+
+// A list or object which is open, with where it starts to report it like the parser does
+typedef struct OpenContainer {
+  size_t length;
+  size_t row;
+  size_t col;
+  bool isObject;
+} OpenContainer;
+
 bool _lex(LexerState *state);
+static bool lexTokenUnchecked(LexerState *state);
+char isWhitespace(char n);
 static char eof(LexerState *state);
 void skipWhitespace(LexerState *state);
 char isDigit(char n);
 char next(LexerState *state);
 char peek(LexerState *state);
-void lexNumber(LexerState *state);
+bool lexNumber(LexerState *state);
 void lexSingleChar(LexerState *state, TokenType type);
 bool lexString(LexerState *state);
+static bool skipMember(LexerState *state);
 bool lexFalse(LexerState *state);
 bool lexTrue(LexerState *state);
 bool lexWord(LexerState *state, char *word, TokenType type);
 
 LexResult lex(char *input) {
-  TokenList list = {
-    .length = 0,
-    .capacity = TOKEN_START_CAPACITY,
-    .tokens = calloc(TOKEN_START_CAPACITY, sizeof(Token))
-  };
-
-  LexerState state = {
-    .input = input,
-    .tokenList = &list,
-    .col = 1,
-    .row = 1,
-    .errorMsg = "",
-  };
+  return lexWithLimits(input, false, NULL);
+}
 
-  bool status = _lex(&state);
+LexResult lexInSitu(char *input) {
+  return lexWithLimits(input, true, NULL);
+}
 
+LexResult lexWithLimits(char *input, bool inSitu, const ParseLimits *limits) {
+  TokenList list = TokenList_new(0, inSitu);
   LexResult res;
-  if (status) {
+  if (lexInto(input, inSitu, limits, NULL, &list, res.result.LEXER_FAIL.errorMsg)) {
     res.status = LEXER_SUCCESS;
     res.result.LEXER_SUCCESS.tokenList = list;
   } else {
     res.status = LEXER_FAIL;
-    strcpy(res.result.LEXER_FAIL.errorMsg, state.errorMsg);
     TokenList_free(&list);
   }
-
   return res;
 }
 
+bool measureInput(const char *input, const ParseLimits *limits, size_t *length, char *errorMsg) {
+  if (limits == NULL || limits->maxInputBytes == 0) {
+    *length = strlen(input);
+    return true;
+  }
+  *length = strnlen(input, limits->maxInputBytes + 1);
+  if (*length > limits->maxInputBytes) {
+    sprintf(errorMsg, "Input is longer than the maximum of %zu bytes", limits->maxInputBytes);
+    return false;
+  }
+  return true;
+}
+
+bool lexInto(char *input, bool inSitu, const ParseLimits *limits, const struct Projection *projection, TokenList *list,
+             char *errorMsg) {
+  size_t length;
+  if (!measureInput(input, limits, &length, errorMsg)) {
+    return false;
+  }
+  bool indexed = length >= STRUCTURAL_INDEX_MIN_LENGTH;
+  size_t estimate = length / TOKEN_BYTES_ESTIMATE;
+  if (indexed) {
+    // Counting the tokens up front is cheap next to growing the list, since it is what the index does anyway
+    estimate = StructuralIndex_count(input, input + length);
+  } else if (estimate > TOKEN_ESTIMATE_MAX_CAPACITY) {
+    estimate = TOKEN_ESTIMATE_MAX_CAPACITY;
+  }
+  TokenList_reserve(list, estimate > TOKEN_START_CAPACITY ? estimate : TOKEN_START_CAPACITY);
+  list->borrowsStrings = inSitu;
+  LexerState state = LexerState_new(input, list, inSitu);
+  state.limits = limits;
+  state.projection = projection;
+
+  bool status = indexed ? lexIndexedRange(&state, input + length, NULL) : _lex(&state);
+  LexerState_free(&state);
+  if (!status) {
+    strcpy(errorMsg, state.errorMsg);
+    TokenList_clear(list);
+  }
+  return status;
+}
+
+LexerState LexerState_new(char *input, TokenList *tokenList, bool inSitu) {
+  return (LexerState) {
+    .input = input,
+    .tokenList = tokenList,
+    .inSitu = inSitu,
+    .limits = NULL,
+    .depth = 0,
+    .nodes = 0,
+    .containers = NULL,
+    .containersCapacity = 0,
+    .projection = NULL,
+    .col = 1,
+    .row = 1,
+    .errorMsg = "",
+  };
+}
+
+void LexerState_free(LexerState *state) {
+  free(state->containers);
+  state->containers = NULL;
+  state->containersCapacity = 0;
+}
+
 bool _lex(LexerState *state) {
   while (!eof(state)) {
-    skipWhitespace(state);
-    char next = peek(state);
-
-    if (isDigit(next) || next == '-' || next == '+') {
-      lexNumber(state);
-    } else if (next == '"') {
-      TRY(lexString(state));
-    } else if (next == 't') {
-      TRY(lexTrue(state));
-    } else if (next == 'f') {
-      TRY(lexFalse(state));
-    } else if (next == 'n') {
-      TRY(lexWord(state, "null", TOKEN_NULL_LITERAL));
-    } else if (next == '{') {
-      lexSingleChar(state, TOKEN_OPEN_CURLY);
-    } else if (next == '}') {
-      lexSingleChar(state, TOKEN_CLOSE_CURLY);
-    } else if (next == '[') {
-      lexSingleChar(state, TOKEN_OPEN_SQUARE);
-    } else if (next == ']') {
-      lexSingleChar(state, TOKEN_CLOSE_SQUARE);
-    } else if (next == ',') {
-      lexSingleChar(state, TOKEN_COMMA);
-    } else if (next == ':') {
-      lexSingleChar(state, TOKEN_COLON);
-    } else if (eof(state)) {
-      return true;
+    TRY(lexToken(state));
+  }
+  return true;
+}
+
+// Moves to `target` across whitespace, which only needs to be checked for newlines
+static void skipWhitespaceTo(LexerState *state, char *target) {
+  for (char *pos = state->input; pos < target; pos++) {
+    if (*pos == '\n') {
+      state->row++;
+      state->col = 1;
+    } else {
+      state->col++;
+    }
+  }
+  state->input = target;
+}
+
+// Counts a value, or a key until its colon, as an element of the innermost container
+static bool countElement(LexerState *state, const ParseLimits *limits) {
+  if (state->containers == NULL || state->depth == 0) {
+    return true;
+  }
+  OpenContainer *container = &state->containers[state->depth - 1];
+  if (++container->length > limits->maxContainerLength) {
+    FAIL(state, "More than the maximum of %zu elements in %s at %zu:%zu", limits->maxContainerLength,
+         container->isObject ? "object" : "list", container->row, container->col);
+  }
+  return true;
+}
+
+static void openContainer(LexerState *state, Token *token) {
+  if (state->depth == state->containersCapacity) {
+    size_t capacity = state->containersCapacity > 0 ? state->containersCapacity * 2 : OPEN_CONTAINERS_START_CAPACITY;
+    state->containers = reallocarray(state->containers, capacity, sizeof(OpenContainer));
+    state->containersCapacity = capacity;
+  }
+  state->containers[state->depth] = (OpenContainer) {
+    .length = 0,
+    .row = token->row,
+    .col = token->col,
+    .isObject = token->tokenType == TOKEN_OPEN_CURLY,
+  };
+}
+
+// Counts the token which was just added against `state->limits`. The key of a member is counted as a
+// value, and as an element of its object, until its colon is found, which never rejects a document within
+// the limits, since every key is followed by a value.
+static bool checkLimits(LexerState *state) {
+  const ParseLimits *limits = state->limits;
+  Token *token = &state->tokenList->tokens[state->tokenList->length - 1];
+
+  switch (token->tokenType) {
+    case TOKEN_OPEN_CURLY:
+    case TOKEN_OPEN_SQUARE:
+      TRY(countElement(state, limits));
+      if (limits->maxDepth > 0 && state->depth >= limits->maxDepth) {
+        FAIL(state, "Maximum nesting depth of %zu exceeded at %zu:%zu", limits->maxDepth, token->row, token->col);
+      }
+      if (limits->maxContainerLength > 0) {
+        openContainer(state, token);
+      }
+      state->depth++;
+      if (limits->maxNodes > 0 && ++state->nodes > limits->maxNodes) {
+        FAIL(state, "More than the maximum of %zu values at %zu:%zu", limits->maxNodes, token->row, token->col);
+      }
+      break;
+
+    case TOKEN_STRING_LITERAL:
+    case TOKEN_NUMBER_LITERAL:
+    case TOKEN_BOOL_LITERAL:
+    case TOKEN_NULL_LITERAL:
+      TRY(countElement(state, limits));
+      if (limits->maxNodes > 0 && ++state->nodes > limits->maxNodes) {
+        FAIL(state, "More than the maximum of %zu values at %zu:%zu", limits->maxNodes, token->row, token->col);
+      }
+      break;
+
+    case TOKEN_CLOSE_CURLY:
+    case TOKEN_CLOSE_SQUARE:
+      if (state->depth > 0) state->depth--;
+      break;
+
+    case TOKEN_COLON:
+      if (state->nodes > 0) state->nodes--;
+      if (state->containers != NULL && state->depth > 0 && state->containers[state->depth - 1].length > 0) {
+        state->containers[state->depth - 1].length--;
+      }
+      break;
+
+    case TOKEN_COMMA:
+      break;
+  }
+  return true;
+}
+
+// Same as `lexToken`, at a position where the index found a token, without checking the limits
+static bool lexIndexedToken(LexerState *state) {
+  switch (*state->input) {
+    case '"': return lexString(state);
+    case '{': lexSingleChar(state, TOKEN_OPEN_CURLY);  return true;
+    case '}': lexSingleChar(state, TOKEN_CLOSE_CURLY); return true;
+    case '[': lexSingleChar(state, TOKEN_OPEN_SQUARE);  return true;
+    case ']': lexSingleChar(state, TOKEN_CLOSE_SQUARE); return true;
+    case ',': lexSingleChar(state, TOKEN_COMMA); return true;
+    case ':': lexSingleChar(state, TOKEN_COLON); return true;
+    default:  return lexTokenUnchecked(state);
+  }
+}
+
+// Lexes the tokens at the positions found by a `StructuralIndex`, one window at a time. Everything
+// between the end of a token and the next position is whitespace, except for bytes which directly
+// follow a token without being one themselves, like the `x` in `1x`, which are lexed as they come so
+// that they are reported just as `_lex` would. The errors are thus the same as those of `_lex`.
+bool lexIndexedRange(LexerState *state, char *stop, TokenList *overflow) {
+  StructuralIndex index = StructuralIndex_new();
+  StructuralIndex_build(&index, state->input, stop);
+  size_t next = 0;
+  bool success = true;
+
+  while (success) {
+    // Tokens may have been lexed already as part of an earlier one, like the quotes inside a string
+    // which runs past the end of the window
+    while (next < index.length && index.start + index.positions[next] < state->input) {
+      next++;
+    }
+    // Each call below adds exactly one token, as there is no projection when lexing in chunks
+    if (overflow != NULL && state->tokenList->length == state->tokenList->capacity) {
+      state->tokenList = overflow;
+    }
+
+    char *target = next < index.length ? (char*)index.start + index.positions[next] : (char*)index.end;
+    if (state->input < target && !isWhitespace(*state->input)) {
+      success = lexTokenUnchecked(state) && (state->limits == NULL || checkLimits(state));
+    } else if (next < index.length) {
+      skipWhitespaceTo(state, target);
+      success = lexIndexedToken(state) && (state->limits == NULL || checkLimits(state));
+      next++;
     } else {
-      FAIL(state, "Unkown character '%c' at %d:%d", next, state->row, state->col);
+      // A window always starts outside of a string, right after a token or whitespace
+      if (index.end >= stop || state->input >= stop) {
+        break;
+      }
+      if (state->input < index.end) {
+        skipWhitespaceTo(state, (char*)index.end);
+      }
+      StructuralIndex_build(&index, state->input, stop);
+      next = 0;
     }
   }
+
+  StructuralIndex_free(&index);
+  return success;
+}
+
+bool lexerAtEnd(LexerState *state) {
+  skipWhitespace(state);
+  return eof(state);
+}
+
+bool lexToken(LexerState *state) {
+  size_t length = state->tokenList->length;
+  TRY(lexTokenUnchecked(state));
+  // Nothing is added at the end of the input
+  return state->limits == NULL || state->tokenList->length == length || checkLimits(state);
+}
+
+static bool lexTokenUnchecked(LexerState *state) {
+  skipWhitespace(state);
+  char next = peek(state);
+
+  if (isDigit(next) || next == '-' || next == '+') {
+    TRY(lexNumber(state));
+  } else if (next == '"') {
+    TRY(lexString(state));
+  } else if (next == 't') {
+    TRY(lexTrue(state));
+  } else if (next == 'f') {
+    TRY(lexFalse(state));
+  } else if (next == 'n') {
+    TRY(lexWord(state, "null", TOKEN_NULL_LITERAL));
+  } else if (next == '{') {
+    lexSingleChar(state, TOKEN_OPEN_CURLY);
+  } else if (next == '}') {
+    lexSingleChar(state, TOKEN_CLOSE_CURLY);
+  } else if (next == '[') {
+    lexSingleChar(state, TOKEN_OPEN_SQUARE);
+  } else if (next == ']') {
+    lexSingleChar(state, TOKEN_CLOSE_SQUARE);
+  } else if (next == ',') {
+    lexSingleChar(state, TOKEN_COMMA);
+  } else if (next == ':') {
+    lexSingleChar(state, TOKEN_COLON);
+  } else if (eof(state)) {
+    return true;
+  } else {
+    FAIL(state, "Unkown character '%c' at %zu:%zu", next, state->row, state->col);
+  }
   return true;
 }
 
@@ -96,8 +336,9 @@ char isDigit(char n) {
   return n >= '0' && n <= '9';
 }
 
+// The whitespace of RFC 8259, of which only newlines move to the next row
 char isWhitespace(char n) {
-  return n == ' ' || n == '\n';
+  return n == ' ' || n == '\n' || n == '\t' || n == '\r';
 }
 
 char peek(LexerState *state) {
@@ -131,24 +372,16 @@ void skipWhitespace(LexerState *state) {
 }
 
 bool lexWord(LexerState *state, char *word, TokenType type) {
-  int startRow = state->row;
-  int startCol = state->col;
-
-  long len = strlen(word);
-  char localStr[len + 1];
-  char nextChar;
-  for (int i = 0; i < len; i++) {
-    nextChar = next(state);
-    if (nextChar == '\0') {
-      FAIL(state, "Expected \"%s\" at %d:%d", word, startRow, startCol);
-    }
-    localStr[i] = nextChar;
-  }
-  localStr[len] = '\0';
+  size_t startRow = state->row;
+  size_t startCol = state->col;
 
-  if (strcmp(localStr, word) != 0) {
-    FAIL(state, "Expected \"%s\" at %d:%d", word, startRow, startCol);
+  // Stops at the end of the input, which never matches
+  size_t len = strlen(word);
+  if (strncmp(state->input, word, len) != 0) {
+    FAIL(state, "Expected \"%s\" at %zu:%zu", word, startRow, startCol);
   }
+  state->input += len;
+  state->col += len;
 
   Token *token = TokenList_insertNew(state->tokenList);
   token->tokenType = type;
@@ -172,8 +405,8 @@ bool lexFalse(LexerState *state) {
 }
 
 void lexSingleChar(LexerState *state, TokenType type) {
-  int startRow = state->row;
-  int startCol = state->col;
+  size_t startRow = state->row;
+  size_t startCol = state->col;
 
   next(state);
   Token *token = TokenList_insertNew(state->tokenList);
@@ -182,53 +415,333 @@ void lexSingleChar(LexerState *state, TokenType type) {
   token->col = startCol;
 }
 
-void lexNumber(LexerState *state) {
-  int startRow = state->row;
-  int startCol = state->col;
+// Integers of up to 15 digits are exact as doubles, so they are converted directly. Returns false for
+// anything else that `strtod` accepts, such as fractions, exponents and hexadecimal numbers.
+static bool lexSmallInteger(char *input, char **end, double *dest) {
+  char *pos = input + (*input == '-');
+  uint64_t value = 0;
+  char *digits = pos;
+  while (isDigit(*pos) && pos - digits < 15) {
+    value = value * 10 + (*pos - '0');
+    pos++;
+  }
+  char c = *pos;
+  if (pos == digits || isDigit(c) || c == '.' || c == 'e' || c == 'E' || c == 'x' || c == 'X') {
+    return false;
+  }
+  // Negating keeps the sign of -0
+  *dest = *input == '-' ? -(double)value : (double)value;
+  *end = pos;
+  return true;
+}
+
+bool lexNumber(LexerState *state) {
+  size_t startRow = state->row;
+  size_t startCol = state->col;
   char *input = state->input;
   char *input_end = input;
 
-  double res = strtod(input, &input_end);
-  int length = input_end - input;
-
-  for (int i = 0; i < length; i++) {
-    next(state);
+  double res;
+  if (!lexSmallInteger(input, &input_end, &res)) {
+    res = strtod(input, &input_end);
   }
+  // Such as a lone `-`, which would otherwise be lexed as an empty number over and over
+  if (input_end == input) {
+    FAIL(state, "Invalid number at %zu:%zu", startRow, startCol);
+  }
+  // Numbers never span lines
+  state->input = input_end;
+  state->col += input_end - input;
   Token *token = TokenList_insertNew(state->tokenList);
   token->tokenType = TOKEN_NUMBER_LITERAL;
   token->data.TOKEN_NUMBER_LITERAL.number = res;
   token->row = startRow;
   token->col = startCol;
+  return true;
+}
+
+// Buffer for the decoded contents of a string literal. When lexing in situ, `contents` is the start of
+// the literal in the input itself, which works since decoding never makes a string longer.
+typedef struct StringBuffer {
+  char *contents;
+  size_t length;
+  size_t capacity;
+  bool inPlace;
+} StringBuffer;
+
+static void StringBuffer_append(StringBuffer *buffer, const char *bytes, size_t length) {
+  if (buffer->inPlace) {
+    memmove(buffer->contents + buffer->length, bytes, length);
+    buffer->length += length;
+    return;
+  }
+  if (buffer->length + length + 1 > buffer->capacity) {
+    while (buffer->length + length + 1 > buffer->capacity) {
+      buffer->capacity *= 2;
+    }
+    buffer->contents = realloc(buffer->contents, buffer->capacity);
+  }
+  memcpy(buffer->contents + buffer->length, bytes, length);
+  buffer->length += length;
+}
+
+static void StringBuffer_free(StringBuffer *buffer) {
+  if (!buffer->inPlace) {
+    free(buffer->contents);
+  }
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Reads the 4 hex digits of a \u escape starting at `str`, returning -1 if they are invalid
+static long readHex4(const char *str) {
+  long value = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hexValue(str[i]);
+    if (digit < 0) return -1;
+    value = (value << 4) | digit;
+  }
+  return value;
+}
+
+// Decodes the escape sequence at `str`, which starts with a backslash, appending the result to `buffer`.
+// Returns the length of the escape sequence, 0 if it is invalid, or -1 if it is \u0000: the strings of
+// tokens are NUL-terminated, so a NUL character would silently cut them short.
+static int lexEscape(const char *str, StringBuffer *buffer) {
+  char simple;
+  switch (str[1]) {
+    case '"':  simple = '"';  break;
+    case '\\': simple = '\\'; break;
+    case '/':  simple = '/';  break;
+    case 'b':  simple = '\b'; break;
+    case 'f':  simple = '\f'; break;
+    case 'n':  simple = '\n'; break;
+    case 'r':  simple = '\r'; break;
+    case 't':  simple = '\t'; break;
+
+    case 'u': {
+      long codepoint = readHex4(str + 2);
+      int length = 6;
+      if (codepoint < 0 || (codepoint >= 0xDC00 && codepoint <= 0xDFFF)) {
+        return 0;
+      }
+      if (codepoint == 0) {
+        return -1;
+      }
+      // Characters outside the BMP are written as a surrogate pair
+      if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+        if (str[6] != '\\' || str[7] != 'u') return 0;
+        long low = readHex4(str + 8);
+        if (low < 0xDC00 || low > 0xDFFF) return 0;
+        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+        length = 12;
+      }
+      char utf8[UNICODE_MAX_UTF8_LENGTH];
+      StringBuffer_append(buffer, utf8, Unicode_encodeUtf8(codepoint, utf8));
+      return length;
+    }
+
+    default:
+      return 0;
+  }
+  StringBuffer_append(buffer, &simple, 1);
+  return 2;
 }
 
-// TODO This does not handle escape characters (\n, \" etc)
+static bool checkStringLength(LexerState *state, size_t length, size_t row, size_t col) {
+  size_t maxLength = state->limits != NULL ? state->limits->maxStringLength : 0;
+  if (maxLength > 0 && length > maxLength) {
+    FAIL(state, "String longer than the maximum of %zu bytes at %zu:%zu", maxLength, row, col);
+  }
+  return true;
+}
+
+// Whether the string which ended right before `pos` is the key of a member
+static bool isKey(const char *pos) {
+  while (isWhitespace(*pos)) pos++;
+  return *pos == ':';
+}
+
+// Moves past the string literal starting at `pos`, returning NULL if it is not terminated. Escapes are
+// only skipped, not checked.
+static char *skipRawString(char *pos) {
+  for (pos++; *pos != '"'; pos++) {
+    if (*pos == '\\') pos++;
+    if (*pos == '\0' || *pos == '\n') return NULL;
+  }
+  return pos + 1;
+}
+
+// Moves past the next value, which is only checked for unterminated strings and for its brackets adding
+// up, whichever they are. A value with nothing to skip, like the one in `{"a":}`, is left to the parser.
+static bool skipRawValue(LexerState *state) {
+  char *pos = state->input;
+  char *lineStart = pos - (state->col - 1);
+  size_t depth = 0;
+
+  while (true) {
+    char c = *pos;
+    if (c == '\0') {
+      if (depth > 0) {
+        FAIL(state, "Unexpected end of input while skipping value at %zu:%zu", state->row, state->col);
+      }
+      break;
+    }
+    if (depth == 0 && (c == ',' || c == '}' || c == ']' || isWhitespace(c))) {
+      break;
+    }
+
+    if (c == '"') {
+      char *end = skipRawString(pos);
+      if (end == NULL) {
+        FAIL(state, "Unterminated string literal at %zu:%zu", state->row, (size_t)(pos - lineStart) + 1);
+      }
+      pos = end;
+      continue;
+    }
+    if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      pos++;
+      if (--depth == 0) break;
+      continue;
+    } else if (c == '\n') {
+      state->row++;
+      lineStart = pos + 1;
+    }
+    pos++;
+  }
+
+  state->input = pos;
+  state->col = (pos - lineStart) + 1;
+  return true;
+}
+
+// Lexes the colon of a member whose key was left out by the projection, and skips its value, which
+// is replaced by a null token. The key token has no string, which tells the parser to skip the member.
+static bool skipMember(LexerState *state) {
+  skipWhitespace(state);
+  lexSingleChar(state, TOKEN_COLON);
+  skipWhitespace(state);
+
+  size_t row = state->row;
+  size_t col = state->col;
+  char *start = state->input;
+  TRY(skipRawValue(state));
+  if (state->input != start) {
+    Token *token = TokenList_insertNew(state->tokenList);
+    token->tokenType = TOKEN_NULL_LITERAL;
+    token->row = row;
+    token->col = col;
+  }
+  return true;
+}
+
+// Strings consisting only of printable ASCII are found with a single call to `Unicode_plainAsciiLength`
+// and copied at once. Otherwise, the string is decoded into a buffer one plain run at a time, and only
+// escapes and non-ASCII characters are handled byte by byte. In situ, the string is instead decoded
+// into the input and terminated there, without copying plain strings at all. The length is checked
+// against the limits before anything is copied, and then after each run as the string is decoded.
 bool lexString(LexerState *state) {
-  int startRow = state->row;
-  int startCol = state->col;
+  size_t startRow = state->row;
+  size_t startCol = state->col;
 
   next(state); // skip initial "
- 
+
   Token *token = TokenList_insertNew(state->tokenList);
   token->tokenType = TOKEN_STRING_LITERAL;
+  token->data.TOKEN_STRING_LITERAL.string = NULL;
+  token->row = startRow;
+  token->col = startCol;
 
   char *strStart = state->input;
-  int strLen = 0;
-  char next_char;
-  while ((next_char = next(state)) != '"' && !eof(state) && next_char != '\n') {
-    strLen++;
+  char *pos = strStart + Unicode_plainAsciiLength(strStart);
+  TRY(checkStringLength(state, pos - strStart, startRow, startCol));
+
+  StringBuffer buffer = { .contents = NULL, .length = 0, .capacity = 0, .inPlace = false };
+  if (state->inSitu) {
+    buffer = (StringBuffer) { .contents = strStart, .length = pos - strStart, .capacity = 0, .inPlace = true };
+  } else if (*pos != '"') {
+    buffer.capacity = (pos - strStart) + 16;
+    buffer.contents = malloc(buffer.capacity);
+    StringBuffer_append(&buffer, strStart, pos - strStart);
+  }
+
+  while (*pos != '"') {
+    // Strings cannot contain raw newlines, so the column is simply the offset on this line
+    state->col = startCol + 1 + (pos - strStart);
+
+    unsigned char c = *pos;
+    if (c == '\0' || c == '\n') {
+      StringBuffer_free(&buffer);
+      FAIL(state, "Unterminated string literal at %zu:%zu", startRow, startCol);
+    } else if (c == '\\') {
+      int length = lexEscape(pos, &buffer);
+      if (length == 0) {
+        StringBuffer_free(&buffer);
+        FAIL(state, "Invalid escape sequence at %zu:%zu", state->row, state->col);
+      } else if (length < 0) {
+        StringBuffer_free(&buffer);
+        FAIL(state, "Escaped NUL character in string literal at %zu:%zu", state->row, state->col);
+      }
+      pos += length;
+    } else if (c < 0x20) {
+      StringBuffer_free(&buffer);
+      FAIL(state, "Unescaped control character in string literal at %zu:%zu", state->row, state->col);
+    } else {
+      int length = Unicode_utf8SequenceLength(pos);
+      if (length == 0) {
+        StringBuffer_free(&buffer);
+        FAIL(state, "Invalid UTF-8 in string literal at %zu:%zu", state->row, state->col);
+      }
+      StringBuffer_append(&buffer, pos, length);
+      pos += length;
+    }
+
+    size_t run = Unicode_plainAsciiLength(pos);
+    if (!checkStringLength(state, buffer.length + run, startRow, startCol)) {
+      StringBuffer_free(&buffer);
+      return false;
+    }
+    StringBuffer_append(&buffer, pos, run);
+    pos += run;
+  }
+
+  if (state->projection != NULL && isKey(pos + 1)) {
+    const char *key = buffer.contents != NULL ? buffer.contents : strStart;
+    size_t keyLength = buffer.contents != NULL ? buffer.length : (size_t)(pos - strStart);
+    if (!Projection_containsLength(state->projection, key, keyLength)) {
+      StringBuffer_free(&buffer);
+      state->input = pos + 1;
+      state->col = startCol + 1 + (pos - strStart) + 1;
+      return skipMember(state);
+    }
   }
 
-  if (eof(state) || next_char == '\n') {
-    FAIL(state, "Unterminated string literal at %d:%d", startRow, startCol);
+  char *copiedStr;
+  if (buffer.inPlace) {
+    buffer.contents[buffer.length] = '\0';
+    copiedStr = buffer.contents;
+  } else if (buffer.contents == NULL) {
+    size_t strLen = pos - strStart;
+    copiedStr = malloc(strLen + 1);
+    memcpy(copiedStr, strStart, strLen);
+    copiedStr[strLen] = '\0';
+  } else {
+    buffer.contents[buffer.length] = '\0';
+    copiedStr = buffer.contents;
   }
 
-  char *copiedStr = malloc(strLen + 1);
-  memcpy(copiedStr, strStart, strLen);
-  copiedStr[strLen] = '\0';
+  // Skip the contents and the closing "
+  state->input = pos + 1;
+  state->col = startCol + 1 + (pos - strStart) + 1;
 
   token->data.TOKEN_STRING_LITERAL.string = copiedStr;
-  token->row = startRow;
-  token->col = startCol;
   return true;
 }
 
@@ -254,43 +767,43 @@ void printTokenType(TokenType type) {
 void printToken(Token *token) {
   switch (token->tokenType) {
     case TOKEN_NUMBER_LITERAL:
-      printf("%d:%d numberLiteral(%f)", token->row, token->col, token->data.TOKEN_NUMBER_LITERAL.number);
+      printf("%zu:%zu numberLiteral(%f)", token->row, token->col, token->data.TOKEN_NUMBER_LITERAL.number);
       break;
 
     case TOKEN_STRING_LITERAL:
-      printf("%d:%d stringLiteral(\"%s\")", token->row, token->col, token->data.TOKEN_STRING_LITERAL.string);
+      printf("%zu:%zu stringLiteral(\"%s\")", token->row, token->col, token->data.TOKEN_STRING_LITERAL.string);
       break;
 
     case TOKEN_BOOL_LITERAL:
-      printf("%d:%d boolLiteral(%s)", token->row, token->col, (token->data.TOKEN_BOOL_LITERAL.boolean ? "true" : "false"));
+      printf("%zu:%zu boolLiteral(%s)", token->row, token->col, (token->data.TOKEN_BOOL_LITERAL.boolean ? "true" : "false"));
       break;
 
     case TOKEN_NULL_LITERAL:
-      printf("%d:%d nullLiteral(null)", token->row, token->col);
+      printf("%zu:%zu nullLiteral(null)", token->row, token->col);
       break;
 
     case TOKEN_OPEN_CURLY:
-      printf("%d:%d openCurly( { )", token->row, token->col);
+      printf("%zu:%zu openCurly( { )", token->row, token->col);
       break;
 
     case TOKEN_CLOSE_CURLY:
-      printf("%d:%d closeCurly( } )", token->row, token->col);
+      printf("%zu:%zu closeCurly( } )", token->row, token->col);
       break;
 
     case TOKEN_OPEN_SQUARE:
-      printf("%d:%d openSquare( [ )", token->row, token->col);
+      printf("%zu:%zu openSquare( [ )", token->row, token->col);
       break;
 
     case TOKEN_CLOSE_SQUARE:
-      printf("%d:%d closeSquare( ] )", token->row, token->col);
+      printf("%zu:%zu closeSquare( ] )", token->row, token->col);
       break;
 
     case TOKEN_COMMA:
-      printf("%d:%d comma( , )", token->row, token->col);
+      printf("%zu:%zu comma( , )", token->row, token->col);
       break;
 
     case TOKEN_COLON:
-      printf("%d:%d colon( : )", token->row, token->col);
+      printf("%zu:%zu colon( : )", token->row, token->col);
       break;
   }
 }
@@ -0,0 +1,224 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "structural.h"
+
+typedef struct Chunk {
+  char *start;
+  char *stop;
+  bool inSitu;
+  // Only those limits which do not depend on what comes before the chunk
+  ParseLimits limits;
+  StructuralChunk summary;
+  // Known once the chunks before this one have been summarized
+  bool inString;
+  size_t row;
+  size_t col;
+  // Part of the token list of the whole input, with room for the number of tokens that was counted
+  TokenList tokens;
+  // Any tokens beyond that, which only happens for malformed input like `1-2`
+  TokenList overflow;
+  bool success;
+  char errorMsg[MAX_ERR_SIZE];
+} Chunk;
+
+// Chunks end after whitespace or an operator, so that they never split a number, a literal or an escape
+static bool isChunkBoundary(char previous) {
+  switch (previous) {
+    case ' ':
+    case '\n':
+    case '\t':
+    case '\r':
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ',':
+    case ':':
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void *summarizeChunk(void *arg) {
+  Chunk *chunk = (Chunk*)arg;
+  chunk->summary = StructuralIndex_summarize(chunk->start, chunk->stop);
+  return NULL;
+}
+
+static void *lexChunk(void *arg) {
+  Chunk *chunk = (Chunk*)arg;
+  char *start = chunk->start;
+  if (chunk->inString) {
+    // The string is lexed by the chunk it started in, which may still be unescaping it in place
+    start = chunk->summary.firstQuote != NULL ? (char*)chunk->summary.firstQuote + 1 : chunk->stop;
+  }
+
+  LexerState state = LexerState_new(start, &chunk->tokens, chunk->inSitu);
+  state.limits = &chunk->limits;
+  // Strings cannot contain newlines, or else the chunk the string started in fails first
+  state.row = chunk->row;
+  state.col = chunk->col + (start - chunk->start);
+  chunk->success = start >= chunk->stop || lexIndexedRange(&state, chunk->stop, &chunk->overflow);
+  strcpy(chunk->errorMsg, state.errorMsg);
+  return NULL;
+}
+
+// Runs `fun` on every chunk, each on its own thread except for the first, which uses the calling thread
+static void runChunks(Chunk *chunks, int count, void *(*fun)(void*)) {
+  pthread_t threads[count];
+  bool started[count];
+  for (int i = 1; i < count; i++) {
+    started[i] = pthread_create(&threads[i], NULL, fun, &chunks[i]) == 0;
+    if (!started[i]) {
+      fun(&chunks[i]);
+    }
+  }
+  fun(&chunks[0]);
+  for (int i = 1; i < count; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+}
+
+// Splits the input into at most `threads` chunks, returning their number
+static int splitChunks(char *input, size_t length, bool inSitu, const ParseLimits *limits, int threads, Chunk *chunks) {
+  char *end = input + length;
+  char *start = input;
+  int count = 0;
+
+  for (int i = 1; i <= threads; i++) {
+    char *stop = i == threads ? end : input + length / threads * i;
+    while (stop < end && !isChunkBoundary(stop[-1])) {
+      stop++;
+    }
+    if (stop <= start) {
+      continue;
+    }
+    memset(&chunks[count], 0, sizeof(Chunk));
+    chunks[count].start = start;
+    chunks[count].stop = stop;
+    chunks[count].inSitu = inSitu;
+    chunks[count].limits = (ParseLimits) { .maxStringLength = limits != NULL ? limits->maxStringLength : 0 };
+    count++;
+    start = stop;
+  }
+  return count;
+}
+
+// Puts the tokens of all chunks into one list. Unless some chunk ended up with a different number of
+// tokens than was counted, they already are.
+static TokenList joinChunks(Chunk *chunks, int count, Token *tokens, size_t total, bool inSitu) {
+  bool exact = true;
+  size_t length = 0;
+  for (int i = 0; i < count; i++) {
+    exact = exact && chunks[i].tokens.length == chunks[i].tokens.capacity && chunks[i].overflow.length == 0;
+    length += chunks[i].tokens.length + chunks[i].overflow.length;
+  }
+
+  TokenList list = { .tokens = tokens, .length = length, .capacity = total, .borrowsStrings = inSitu };
+  if (!exact) {
+    list = TokenList_new(length > 0 ? length : 1, inSitu);
+    for (int i = 0; i < count; i++) {
+      memcpy(list.tokens + list.length, chunks[i].tokens.tokens, chunks[i].tokens.length * sizeof(Token));
+      list.length += chunks[i].tokens.length;
+      memcpy(list.tokens + list.length, chunks[i].overflow.tokens, chunks[i].overflow.length * sizeof(Token));
+      list.length += chunks[i].overflow.length;
+    }
+    free(tokens);
+  }
+
+  // The strings now belong to `list`
+  for (int i = 0; i < count; i++) {
+    free(chunks[i].overflow.tokens);
+  }
+  return list;
+}
+
+LexResult lexParallel(char *input, bool inSitu, const ParseLimits *limits, int threads) {
+  LexResult res;
+  size_t length;
+  if (!measureInput(input, limits, &length, res.result.LEXER_FAIL.errorMsg)) {
+    res.status = LEXER_FAIL;
+    return res;
+  }
+  if (threads > 0 && (size_t)threads > length / PARALLEL_MIN_CHUNK_SIZE) {
+    threads = length / PARALLEL_MIN_CHUNK_SIZE;
+  }
+  if (threads <= 1) {
+    return lexWithLimits(input, inSitu, limits);
+  }
+
+  Chunk *chunks = malloc(threads * sizeof(Chunk));
+  int count = splitChunks(input, length, inSitu, limits, threads, chunks);
+  runChunks(chunks, count, summarizeChunk);
+
+  // Whether each chunk starts inside of a string follows from the quotes before it, and with it the
+  // number of tokens of the chunk and thus where they go
+  bool inString = false;
+  size_t row = 1;
+  char *lineStart = input;
+  size_t total = 0;
+  for (int i = 0; i < count; i++) {
+    Chunk *chunk = &chunks[i];
+    chunk->inString = inString;
+    chunk->row = row;
+    chunk->col = chunk->start - lineStart + 1;
+    total += chunk->summary.tokens[inString];
+
+    inString ^= chunk->summary.flipsString;
+    row += chunk->summary.newlines;
+    if (chunk->summary.lastNewline != NULL) {
+      lineStart = (char*)chunk->summary.lastNewline + 1;
+    }
+  }
+
+  Token *tokens = malloc((total > 0 ? total : 1) * sizeof(Token));
+  size_t offset = 0;
+  for (int i = 0; i < count; i++) {
+    size_t chunkTokens = chunks[i].summary.tokens[chunks[i].inString];
+    chunks[i].tokens = (TokenList) { .tokens = tokens + offset, .length = 0, .capacity = chunkTokens, .borrowsStrings = inSitu };
+    chunks[i].overflow = TokenList_new(TOKEN_START_CAPACITY, inSitu);
+    offset += chunkTokens;
+  }
+  runChunks(chunks, count, lexChunk);
+
+  res.status = LEXER_SUCCESS;
+  TokenList list = joinChunks(chunks, count, tokens, total, inSitu);
+  for (int i = 0; i < count; i++) {
+    // Everything up to the first error lexes the same as it would on a single thread
+    if (!chunks[i].success) {
+      res.status = LEXER_FAIL;
+      strcpy(res.result.LEXER_FAIL.errorMsg, chunks[i].errorMsg);
+      TokenList_free(&list);
+      break;
+    }
+  }
+  if (res.status == LEXER_SUCCESS) {
+    res.result.LEXER_SUCCESS.tokenList = list;
+  }
+
+  free(chunks);
+  return res;
+}
+
+ParserResult parseParallel(char *input, const ParseOptions *options, int threads) {
+  bool inSitu = options != NULL && options->inSitu;
+  LexResult lexed = lexParallel(input, inSitu, options != NULL ? &options->limits : NULL, threads);
+  ParserResult result;
+
+  if (lexed.status == LEXER_FAIL) {
+    result.status = PARSER_FAIL;
+    strcpy(result.result.PARSER_ERROR.errorMsg, lexed.result.LEXER_FAIL.errorMsg);
+    return result;
+  }
+
+  TokenList tokenList = lexed.result.LEXER_SUCCESS.tokenList;
+  result = parseTokens(tokenList.tokens, tokenList.length, options);
+  TokenList_free(&tokenList);
+  return result;
+}
@@ -3,16 +3,31 @@
 #include <string.h>
 
 #include "parser.h"
-#include "nodelist.h"
 #include "lexer.h"
 
-static bool _parse(ParserState *state);
+// A list or object which is being parsed. Its items are allocated up front with the length found by
+// the pre-scan as `capacity`, and the keys of an object are kept after all of them until it is closed.
+typedef struct ParserFrame {
+  JSONNode *node;
+  size_t capacity;
+} ParserFrame;
+
+static bool _parse(ParserState *state, bool *needValue, Token *stop);
+static ParserTask newParserTask(Token *tokens, size_t length, const ParseOptions *options, ParserScratch *scratch);
+bool parseValue(ParserState *state, bool *needValue);
 void parseNull(ParserState *state);
 void parseBool(ParserState *state);
 void parseNumber(ParserState *state);
 void parseString(ParserState *state);
-bool parseList(ParserState *state);
-bool parseObject(ParserState *state);
+bool pushContainer(ParserState *state, JSONNode *node, enum JSONNode_Tag tag, size_t capacity);
+static JSONNode *addElement(ParserState *state);
+static void closeContainer(ParserState *state);
+bool openList(ParserState *state, bool *needValue);
+bool openObject(ParserState *state, bool *needValue);
+bool parseMemberKey(ParserState *state, bool *needValue);
+bool parseNextElement(ParserState *state, bool *needValue);
+bool skipValue(ParserState *state);
+void countContainerLengths(Token *tokens, Token *tokensEnd);
 bool eof(ParserState *state);
 bool consume(ParserState *state, TokenType type);
 bool expect(ParserState *state, TokenType type);
@@ -31,45 +46,182 @@ Token peekToken(ParserState *state);
 } while(0);
 
 ParserResult parse(char *input) {
-  LexResult lexed = lex(input);
+  return parseWithOptions(input, NULL);
+}
+
+ParserResult parseWithOptions(char *input, const ParseOptions *options) {
+  bool inSitu = options != NULL && options->inSitu;
+  TokenList tokenList = TokenList_new(0, inSitu);
   ParserResult result;
 
-  if (lexed.status == LEXER_FAIL) {
+  if (!lexInto(input, inSitu, options != NULL ? &options->limits : NULL, options != NULL ? options->projection : NULL,
+               &tokenList, result.result.PARSER_ERROR.errorMsg)) {
+    TokenList_free(&tokenList);
     result.status = PARSER_FAIL;
-    strcpy(result.result.PARSER_ERROR.errorMsg, lexed.result.LEXER_FAIL.errorMsg);
     return result;
   }
 
-  TokenList tokenList = lexed.result.LEXER_SUCCESS.tokenList;
+  result = parseTokens(tokenList.tokens, tokenList.length, options);
+  TokenList_free(&tokenList);
+  return result;
+}
+
+ParserResult parseTokens(Token *tokens, size_t length, const ParseOptions *options) {
+  countContainerLengths(tokens, tokens + length);
+  ParserTask task = ParserTask_new(tokens, length, options);
+  ParserTask_step(&task, SIZE_MAX);
+  return ParserTask_finish(&task);
+}
+
+ParserResult parseTokensWith(Token *tokens, size_t length, const ParseOptions *options, ParserScratch *scratch) {
+  ContainerCounter *counter = &scratch->counter;
+  counter->depth = 0;
+  counter->scanned = 0;
+  ContainerCounter_scan(counter, tokens, length);
+
+  // The tree from the last call is not needed anymore
+  Arena_reset(&scratch->arena);
+  ParserTask task = newParserTask(tokens, length, options, scratch);
+  ParserTask_step(&task, SIZE_MAX);
+  return ParserTask_finish(&task);
+}
 
-  JSONNode *root = calloc(1, sizeof(JSONNode));
-  root->fieldName = NULL;
+ParserTask ParserTask_new(Token *tokens, size_t length, const ParseOptions *options) {
+  return newParserTask(tokens, length, options, NULL);
+}
 
-  ParserState state = {
-    .current_node = root,
-    .current_token = tokenList.tokens,
-    .tokens_end = tokenList.tokens + tokenList.length,
-    .depth = 0,
-    .errorMsg = "",
+static ParserTask newParserTask(Token *tokens, size_t length, const ParseOptions *options, ParserScratch *scratch) {
+  JSONNode *root;
+  if (scratch != NULL) {
+    root = Arena_alloc(&scratch->arena, sizeof(JSONNode));
+    memset(root, 0, sizeof(JSONNode));
+  } else {
+    root = calloc(1, sizeof(JSONNode));
+  }
+
+  return (ParserTask) {
+    .state = {
+      .current_node = root,
+      .current_token = tokens,
+      .tokens_end = tokens + length,
+      .projection = options != NULL ? options->projection : NULL,
+      .keys = scratch != NULL ? scratch->keys : InternTable_new(),
+      .arena = scratch != NULL ? &scratch->arena : NULL,
+      .inSitu = options != NULL && options->inSitu,
+      .stack = scratch != NULL ? scratch->stack : NULL,
+      .stackCapacity = scratch != NULL ? scratch->stackCapacity : 0,
+      .depth = 0,
+      .limits = options != NULL ? options->limits : (ParseLimits) { 0 },
+      .nodes = 1,
+      .errorMsg = "",
+    },
+    .root = root,
+    .needValue = true,
+    .done = false,
+    .success = false,
+    .scratch = scratch,
   };
+}
 
-  bool status = _parse(&state);
+bool ParserTask_step(ParserTask *task, size_t budget) {
+  if (task->done) {
+    return true;
+  }
 
-  if (status) {
-    result.status = PARSER_SUCCESS;
-    result.result.PARSER_SUCCESS.tree = root;
-    TokenList_free(&tokenList);
+  ParserState *state = &task->state;
+  size_t remaining = state->tokens_end - state->current_token;
+  Token *stop = budget < remaining ? state->current_token + budget : state->tokens_end;
+  task->success = _parse(state, &task->needValue, stop);
+  task->done = !task->success || !task->needValue;
+  if (task->done && task->success) {
+    task->success = expectEof(state);
+  }
+  return task->done;
+}
+
+ParserResult ParserTask_finish(ParserTask *task) {
+  ParserResult result;
+  ParserState *state = &task->state;
+  if (task->scratch != NULL) {
+    task->scratch->stack = state->stack;
+    task->scratch->stackCapacity = state->stackCapacity;
   } else {
-    result.status = PARSER_FAIL;
-    strcpy(result.result.PARSER_ERROR.errorMsg, state.errorMsg);
-    JSONNode_free(root);
+    free(state->stack);
   }
+  state->stack = NULL;
 
+  if (task->done && task->success) {
+    result.status = PARSER_SUCCESS;
+    result.result.PARSER_SUCCESS.tree = task->root;
+    result.result.PARSER_SUCCESS.keys = state->keys;
+    return result;
+  }
+
+  result.status = PARSER_FAIL;
+  if (task->done) {
+    strcpy(result.result.PARSER_ERROR.errorMsg, state->errorMsg);
+  } else {
+    strcpy(result.result.PARSER_ERROR.errorMsg, "Parsing was not finished");
+  }
+  // The memory of a scratch is reused by the next task instead
+  if (task->scratch != NULL) {
+    return result;
+  }
+  if (state->inSitu) {
+    JSONNode_freeInSitu(task->root);
+  } else {
+    JSONNode_free(task->root);
+  }
+  InternTable_free(state->keys);
   return result;
 }
 
-static bool _parse(ParserState *state) {
-  Token next = *state->current_token;
+ParserScratch ParserScratch_new() {
+  return (ParserScratch) {
+    .counter = ContainerCounter_new(),
+    .stack = NULL,
+    .stackCapacity = 0,
+    .keys = InternTable_new(),
+    .arena = Arena_new(),
+  };
+}
+
+void ParserScratch_free(ParserScratch *scratch) {
+  Arena_free(&scratch->arena);
+  ContainerCounter_free(&scratch->counter);
+  free(scratch->stack);
+  scratch->stack = NULL;
+  InternTable_free(scratch->keys);
+  scratch->keys = NULL;
+}
+
+// Iterative rather than recursive, so that deeply nested input is bounded by `limits.maxDepth` and the heap
+// instead of overflowing the C stack. The containers that are currently open are kept on `state->stack`.
+// Stops before the value at `stop`, unless that is the end of the tokens, so that it can be resumed.
+static bool _parse(ParserState *state, bool *needValue, Token *stop) {
+  while (*needValue) {
+    if (state->current_token >= stop && stop < state->tokens_end) {
+      return true;
+    }
+    TRY(parseValue(state, needValue));
+
+    // Close every container that ends here, until we either find the next value or run out of containers
+    while (!*needValue && state->depth > 0) {
+      TRY(parseNextElement(state, needValue));
+    }
+  }
+  return true;
+}
+
+// Parses the value starting at the current token into `state->current_node`. If it is a non-empty
+// container, it is left open on the stack and `needValue` tells whether its first element is next.
+bool parseValue(ParserState *state, bool *needValue) {
+  if (eof(state)) {
+    FAIL(state, "Unexpected end of input, expecting value");
+  }
+
+  *needValue = false;
+  Token next = peekToken(state);
   switch (next.tokenType) {
     case TOKEN_NULL_LITERAL:
       parseNull(state);
@@ -88,21 +240,17 @@ static bool _parse(ParserState *state) {
       break;
 
     case TOKEN_OPEN_SQUARE:
-      TRY(parseList(state));
+      TRY(openList(state, needValue));
       break;
 
     case TOKEN_OPEN_CURLY:
-      TRY(parseObject(state));
+      TRY(openObject(state, needValue));
       break;
 
     default: {
-      FAIL(state, "Unexpected token at %d:%d: %s", next.row, next.col, tokenTypeToString(next.tokenType));
+      FAIL(state, "Unexpected token at %zu:%zu: %s", next.row, next.col, tokenTypeToString(next.tokenType));
     }
   }
-
-  if (state->depth == 0) {
-    TRY(expectEof(state));
-  }
   return true;
 }
 
@@ -121,7 +269,16 @@ void parseNumber(ParserState *state) {
 void parseString(ParserState *state) {
   JSONNode *node = state->current_node;
   node->tag = JSON_STRING;
-  node->data.JSON_STRING.string = strdup(nextToken(state)->data.TOKEN_STRING_LITERAL.string);
+  char *string = nextToken(state)->data.TOKEN_STRING_LITERAL.string;
+  // A key skipped while lexing, outside of an object, which the colon after it is about to reject
+  if (string == NULL) {
+    string = "";
+  }
+  if (state->inSitu) {
+    node->data.JSON_STRING.string = string;
+  } else {
+    node->data.JSON_STRING.string = state->arena != NULL ? Arena_strdup(state->arena, string) : strdup(string);
+  }
 }
 
 void parseBool(ParserState *state) {
@@ -131,63 +288,293 @@ void parseBool(ParserState *state) {
   node->data.JSON_BOOL.boolean = contents;
 }
 
-bool parseList(ParserState *state) {
-  state->depth++;
-  TRY(consume(state, TOKEN_OPEN_SQUARE));
+// Bytes taken up by each item of a container, including its key for objects
+static size_t itemSize(enum JSONNode_Tag tag) {
+  return sizeof(JSONNode) + (tag == JSON_OBJECT ? sizeof(char*) : 0);
+}
 
-  JSONNode *node = state->current_node;
-  NodeList *nodeList = NodeList_new();
-  node->tag = JSON_LIST;
-  node->data.JSON_LIST.nodes = nodeList;
+bool pushContainer(ParserState *state, JSONNode *node, enum JSONNode_Tag tag, size_t capacity) {
+  node->tag = tag;
+  node->length = 0;
+  node->data.JSON_LIST.items = NULL;
+
+  // Checked before the items are allocated, with the number of them found by the pre-scan. The lexer has
+  // usually failed on these already, but not when the tokens were lexed in parallel.
+  const ParseLimits *limits = &state->limits;
+  Token *token = state->current_token - 1;
+  if (limits->maxDepth > 0 && state->depth >= limits->maxDepth) {
+    FAIL(state, "Maximum nesting depth of %zu exceeded at %zu:%zu", limits->maxDepth, token->row, token->col);
+  }
+  if (limits->maxContainerLength > 0 && capacity > limits->maxContainerLength) {
+    FAIL(state, "More than the maximum of %zu elements in %s at %zu:%zu", limits->maxContainerLength,
+         tag == JSON_LIST ? "list" : "object", token->row, token->col);
+  }
+  state->nodes += capacity;
+  if (limits->maxNodes > 0 && state->nodes > limits->maxNodes) {
+    FAIL(state, "More than the maximum of %zu values at %zu:%zu", limits->maxNodes, token->row, token->col);
+  }
+  if (state->depth == state->stackCapacity) {
+    size_t newCapacity = state->stackCapacity > 0 ? state->stackCapacity * 2 : PARSER_STACK_START_CAPACITY;
+    state->stack = reallocarray(state->stack, newCapacity, sizeof(ParserFrame));
+    state->stackCapacity = newCapacity;
+  }
+  if (capacity > 0) {
+    size_t size = capacity * itemSize(tag);
+    node->data.JSON_LIST.items = state->arena != NULL ? Arena_alloc(state->arena, size) : malloc(size);
+  }
+  state->stack[state->depth++] = (ParserFrame) { .node = node, .capacity = capacity };
+  return true;
+}
 
-  while (!eof(state) && peekTokenType(state) != TOKEN_CLOSE_SQUARE) {
-    JSONNode *elem = NodeList_insertNew(nodeList);
-    state->current_node = elem;
-    TRY(_parse(state));
+// Appends an element to the innermost open container. It only needs to grow if the pre-scan counted
+// fewer elements, which only happens for input that is about to be rejected.
+static JSONNode *addElement(ParserState *state) {
+  ParserFrame *frame = &state->stack[state->depth - 1];
+  JSONNode *node = frame->node;
+
+  if (node->length == frame->capacity) {
+    size_t newCapacity = frame->capacity > 0 ? frame->capacity * 2 : PARSER_STACK_START_CAPACITY;
+    JSONNode *items;
+    if (state->arena != NULL) {
+      items = Arena_alloc(state->arena, newCapacity * itemSize(node->tag));
+      if (frame->capacity > 0) {
+        memcpy(items, node->data.JSON_LIST.items, frame->capacity * itemSize(node->tag));
+      }
+    } else {
+      items = realloc(node->data.JSON_LIST.items, newCapacity * itemSize(node->tag));
+    }
+    if (node->tag == JSON_OBJECT) {
+      memmove(items + newCapacity, items + frame->capacity, frame->capacity * sizeof(char*));
+    }
+    node->data.JSON_LIST.items = items;
+    frame->capacity = newCapacity;
+  }
 
-    if (peekTokenType(state) == TOKEN_CLOSE_SQUARE || eof(state)) {
-      break;
+  JSONNode *elem = &node->data.JSON_LIST.items[node->length++];
+  *elem = (JSONNode) { .tag = JSON_NULL };
+  return elem;
+}
+
+static void closeContainer(ParserState *state) {
+  ParserFrame *frame = &state->stack[--state->depth];
+  JSONNode *node = frame->node;
+  JSONNode *items = node->data.JSON_LIST.items;
+
+  if (node->length == 0) {
+    // Every member may have been skipped by the projection
+    if (state->arena == NULL) {
+      free(items);
     }
-    // This allows a trailing comma, could be fixed but why not keep it?
-    TRY(consume(state, TOKEN_COMMA));
+    node->data.JSON_LIST.items = NULL;
+  } else if (node->tag == JSON_OBJECT && node->length < frame->capacity) {
+    memmove(JSONNode_keys(node), items + frame->capacity, node->length * sizeof(char*));
+  }
+}
+
+bool openList(ParserState *state, bool *needValue) {
+  TRY(consume(state, TOKEN_OPEN_SQUARE));
+
+  size_t capacity = state->current_token[-1].data.TOKEN_OPEN_SQUARE.length;
+  TRY(pushContainer(state, state->current_node, JSON_LIST, capacity));
+
+  if (!eof(state) && peekTokenType(state) == TOKEN_CLOSE_SQUARE) {
+    nextToken(state);
+    closeContainer(state);
+    return true;
   }
 
-  TRY(consume(state, TOKEN_CLOSE_SQUARE));
-  state->depth--;
-  state->current_node = node;
+  state->current_node = addElement(state);
+  *needValue = true;
   return true;
 }
 
-bool parseObject(ParserState *state) {
-  state->depth++;
+bool openObject(ParserState *state, bool *needValue) {
   TRY(consume(state, TOKEN_OPEN_CURLY));
 
-  JSONNode *node = state->current_node;
-  NodeList *nodeList = NodeList_new();
-  node->tag = JSON_OBJECT;
-  node->data.JSON_OBJECT.nodes = nodeList;
+  size_t capacity = state->current_token[-1].data.TOKEN_OPEN_CURLY.length;
+  TRY(pushContainer(state, state->current_node, JSON_OBJECT, capacity));
 
-  while (!eof(state) && peekTokenType(state) != TOKEN_CLOSE_CURLY) {
-    TRY(expect(state, TOKEN_STRING_LITERAL));
-    char *name = nextToken(state)->data.TOKEN_STRING_LITERAL.string;
+  if (!eof(state) && peekTokenType(state) == TOKEN_CLOSE_CURLY) {
+    nextToken(state);
+    closeContainer(state);
+    return true;
+  }
 
-    TRY(consume(state, TOKEN_COLON));
+  return parseMemberKey(state, needValue);
+}
 
-    JSONNode *elem = NodeList_insertNew(nodeList);
-    state->current_node = elem;
-    TRY(_parse(state));
-    elem->fieldName = strdup(name);
+// Parses `"key":` and prepares the node for the value, unless the member is skipped by the projection.
+bool parseMemberKey(ParserState *state, bool *needValue) {
+  TRY(expect(state, TOKEN_STRING_LITERAL));
+  char *name = nextToken(state)->data.TOKEN_STRING_LITERAL.string;
 
-    if (peekTokenType(state) == TOKEN_CLOSE_CURLY || eof(state)) {
-      break;
-    }
-    // This allows a trailing comma, could be fixed but why not keep it?
+  TRY(consume(state, TOKEN_COLON));
+
+  // Members skipped while lexing have no key, and a null token in place of their value
+  if (name == NULL || (state->projection != NULL && !Projection_contains(state->projection, name))) {
+    TRY(skipValue(state));
+    *needValue = false;
+    return true;
+  }
+
+  JSONNode *elem = addElement(state);
+  ParserFrame *frame = &state->stack[state->depth - 1];
+  JSONNode *object = frame->node;
+  char **keys = (char**)(object->data.JSON_OBJECT.items + frame->capacity);
+  keys[object->length - 1] = InternTable_intern(state->keys, name);
+  state->current_node = elem;
+  *needValue = true;
+  return true;
+}
+
+// Called after an element of the innermost open container. Either closes the container, or moves on
+// to its next element, in which case `needValue` is set.
+bool parseNextElement(ParserState *state, bool *needValue) {
+  JSONNode *container = state->stack[state->depth - 1].node;
+  bool isList = container->tag == JSON_LIST;
+  TokenType close = isList ? TOKEN_CLOSE_SQUARE : TOKEN_CLOSE_CURLY;
+
+  *needValue = false;
+  if (eof(state)) {
+    TRY(expect(state, close));
+  }
+  if (peekTokenType(state) != close) {
     TRY(consume(state, TOKEN_COMMA));
   }
 
-  TRY(consume(state, TOKEN_CLOSE_CURLY));
-  state->depth--;
-  state->current_node = node;
+  // This allows a trailing comma, could be fixed but why not keep it?
+  if (eof(state) || peekTokenType(state) == close) {
+    TRY(consume(state, close));
+    closeContainer(state);
+    return true;
+  }
+
+  if (isList) {
+    state->current_node = addElement(state);
+    *needValue = true;
+    return true;
+  }
+  return parseMemberKey(state, needValue);
+}
+
+// Structural pre-scan which stores the number of direct children in every opening token, so that
+// the parser can allocate the items of each container with their exact number. Lists count the values directly
+// inside them, objects count their colons. Mismatched brackets are left for the parser to report.
+void countContainerLengths(Token *tokens, Token *tokensEnd) {
+  ContainerCounter counter = ContainerCounter_new();
+  ContainerCounter_scan(&counter, tokens, tokensEnd - tokens);
+  ContainerCounter_free(&counter);
+}
+
+ContainerCounter ContainerCounter_new() {
+  return (ContainerCounter) {
+    .open = malloc(16 * sizeof(size_t)),
+    .depth = 0,
+    .capacity = 16,
+    .scanned = 0,
+  };
+}
+
+static bool isSkippedKey(const Token *token) {
+  return token->tokenType == TOKEN_STRING_LITERAL && token->data.TOKEN_STRING_LITERAL.string == NULL;
+}
+
+void ContainerCounter_scan(ContainerCounter *counter, Token *tokens, size_t length) {
+  // The open containers are kept as indices, as the tokens may have moved since the last scan
+  size_t *open = counter->open;
+  size_t depth = counter->depth;
+
+  for (size_t i = counter->scanned; i < length; i++) {
+    Token *token = &tokens[i];
+    Token *parent = depth > 0 ? &tokens[open[depth - 1]] : NULL;
+
+    switch (token->tokenType) {
+      case TOKEN_OPEN_CURLY:
+      case TOKEN_OPEN_SQUARE:
+      case TOKEN_STRING_LITERAL:
+      case TOKEN_NUMBER_LITERAL:
+      case TOKEN_BOOL_LITERAL:
+      case TOKEN_NULL_LITERAL:
+        if (parent != NULL && parent->tokenType == TOKEN_OPEN_SQUARE) {
+          parent->data.TOKEN_OPEN_SQUARE.length++;
+        }
+        break;
+
+      case TOKEN_COLON:
+        // Members skipped while lexing are not kept, so they need no room
+        if (parent != NULL && parent->tokenType == TOKEN_OPEN_CURLY && !isSkippedKey(&tokens[i - 1])) {
+          parent->data.TOKEN_OPEN_CURLY.length++;
+        }
+        break;
+
+      case TOKEN_CLOSE_CURLY:
+      case TOKEN_CLOSE_SQUARE:
+        if (depth > 0) depth--;
+        break;
+
+      case TOKEN_COMMA:
+        break;
+    }
+
+    if (token->tokenType == TOKEN_OPEN_CURLY || token->tokenType == TOKEN_OPEN_SQUARE) {
+      if (depth == counter->capacity) {
+        counter->capacity *= 2;
+        open = reallocarray(open, counter->capacity, sizeof(size_t));
+      }
+      token->data.TOKEN_OPEN_SQUARE.length = 0;
+      token->data.TOKEN_OPEN_CURLY.length = 0;
+      open[depth++] = i;
+    }
+  }
+
+  counter->open = open;
+  counter->depth = depth;
+  counter->scanned = length;
+}
+
+void ContainerCounter_free(ContainerCounter *counter) {
+  free(counter->open);
+  counter->open = NULL;
+}
+
+// Skips over the next value without building any nodes, only keeping track of bracket depth.
+bool skipValue(ParserState *state) {
+  if (eof(state)) {
+    FAIL(state, "Unexpected end of input, expecting value");
+  }
+  switch (peekTokenType(state)) {
+    case TOKEN_CLOSE_CURLY:
+    case TOKEN_CLOSE_SQUARE:
+    case TOKEN_COMMA:
+    case TOKEN_COLON: {
+      Token next = peekToken(state);
+      FAIL(state, "Unexpected token at %zu:%zu: %s", next.row, next.col, tokenTypeToString(next.tokenType));
+    }
+
+    default:
+      break;
+  }
+
+  int depth = 0;
+  do {
+    if (eof(state)) {
+      FAIL(state, "Unexpected end of input while skipping value");
+    }
+    switch (nextToken(state)->tokenType) {
+      case TOKEN_OPEN_CURLY:
+      case TOKEN_OPEN_SQUARE:
+        depth++;
+        break;
+
+      case TOKEN_CLOSE_CURLY:
+      case TOKEN_CLOSE_SQUARE:
+        depth--;
+        break;
+
+      default:
+        break;
+    }
+  } while (depth > 0);
   return true;
 }
 
@@ -209,13 +596,12 @@ Token *nextToken(ParserState *state) {
 }
 
 bool expect(ParserState *state, TokenType type) {
+  if (eof(state)) {
+    FAIL(state, "Expecting %s at end of input", tokenTypeToString(type));
+  }
   Token next = peekToken(state);
-  if (eof(state) || peekTokenType(state) != type) {
-    if (eof(state)) {
-      FAIL(state, "Expecting %s at end of input", tokenTypeToString(type));
-    } else {
-      FAIL(state, "Expecting %s at %d:%d", tokenTypeToString(type), next.row, next.col);
-    }
+  if (next.tokenType != type) {
+    FAIL(state, "Expecting %s at %zu:%zu", tokenTypeToString(type), next.row, next.col);
   }
   return true;
 }
@@ -223,7 +609,7 @@ bool expect(ParserState *state, TokenType type) {
 bool expectEof(ParserState *state) {
   if (!eof(state)) {
     Token next = peekToken(state);
-    FAIL(state, "Trailing tokens at %d:%d, missmatched braces?", next.row, next.col);
+    FAIL(state, "Trailing tokens at %zu:%zu, missmatched braces?", next.row, next.col);
   }
   return true;
 }
@@ -235,69 +621,100 @@ bool consume(ParserState *state, TokenType type) {
 }
 
 #define indentDepth 2 
-#define printIndent(N) for (int i = 0; i < (N); i++) printf(" ");
+#define printIndent(out, N) for (int i = 0; i < (N); i++) fputc(' ', out);
 
-void _printTree(int indentLevel, JSONNode *tree);
+typedef struct PrintFrame {
+  JSONNode *node;
+  size_t nextIndex;
+  int indentLevel;
+} PrintFrame;
 
-void printTree(JSONNode *tree) {
-  _printTree(0, tree);
-}
-
-void _printTree(int indentLevel, JSONNode *tree) {
+// Prints a scalar, or the opening line of a container, which is then returned for its items to be printed.
+static bool printNodeStart(FILE *out, int indentLevel, JSONNode *tree, const void *base) {
   JSONNode node = *tree;
   switch (node.tag) {
     case JSON_STRING:
-      printIndent(indentLevel);
-      printf("string \"%s\"\n", node.data.JSON_STRING.string);
-      break;
+      printIndent(out, indentLevel);
+      fprintf(out, "string \"%s\"\n", JSONNode_string(&node, base));
+      return false;
 
     case JSON_NUMBER:
-      printIndent(indentLevel);
-      printf("number %f\n", node.data.JSON_NUMBER.number);
-      break;
+      printIndent(out, indentLevel);
+      fprintf(out, "number %f\n", node.data.JSON_NUMBER.number);
+      return false;
 
     case JSON_NULL:
-      printIndent(indentLevel);
-      printf("null\n");
-      break;
+      printIndent(out, indentLevel);
+      fprintf(out, "null\n");
+      return false;
 
     case JSON_BOOL: {
-      printIndent(indentLevel);
-      printf("boolean %s\n", node.data.JSON_BOOL.boolean ? "true" : "false");
-      break;
+      printIndent(out, indentLevel);
+      fprintf(out, "boolean %s\n", node.data.JSON_BOOL.boolean ? "true" : "false");
+      return false;
     }
 
     case JSON_LIST: {
-      struct JSON_LIST data = node.data.JSON_LIST;
-      JSONNode *items = data.nodes->items;
-
-      printIndent(indentLevel); printf("List (%d) [\n", data.nodes->length);
-
-      for (int i = 0; i < data.nodes->length; i++) {
-        _printTree(indentLevel + indentDepth, &items[i]);
-      }
-      
-      printIndent(indentLevel); printf("]\n");
-      break;
+      printIndent(out, indentLevel); fprintf(out, "List (%zu) [\n", (size_t)node.length);
+      return true;
     }
 
     case JSON_OBJECT: {
-      struct JSON_OBJECT data = node.data.JSON_OBJECT;
-      NodeList *list = data.nodes;
+      printIndent(out, indentLevel); fprintf(out, "Object {\n");
+      return true;
+    }
+  }
+  return false;
+}
 
-      printIndent(indentLevel); printf("Object {\n");
+void printTree(JSONNode *tree) {
+  fprintTree(stdout, tree);
+}
 
-      for (int i = 0; i < list->length; i++) {
-        char *name = list->items[i].fieldName;
-        printIndent(indentLevel + indentDepth); printf("\"%s\":\n ", name);
-        _printTree(indentLevel + (indentDepth * 2), &list->items[i]);
-        if (i < list->length - 1) printf("\n");
-      }
+void fprintTree(FILE *out, JSONNode *tree) {
+  fprintTreeAt(out, tree, NULL);
+}
 
-      printIndent(indentLevel); printf("}\n");
-      break;
+// Iterative, so that printing deeply nested trees cannot overflow the C stack.
+void fprintTreeAt(FILE *out, JSONNode *tree, const void *base) {
+  if (!printNodeStart(out, 0, tree, base)) {
+    return;
+  }
+
+  int capacity = PARSER_STACK_START_CAPACITY;
+  int depth = 0;
+  PrintFrame *stack = malloc(capacity * sizeof(PrintFrame));
+  stack[depth++] = (PrintFrame) { .node = tree, .nextIndex = 0, .indentLevel = 0 };
+
+  while (depth > 0) {
+    PrintFrame *frame = &stack[depth - 1];
+    JSONNode *items = JSONNode_items(frame->node, base);
+    bool isObject = frame->node->tag == JSON_OBJECT;
+
+    if (frame->nextIndex == frame->node->length) {
+      printIndent(out, frame->indentLevel); fprintf(out, isObject ? "}\n" : "]\n");
+      depth--;
+      continue;
+    }
+
+    size_t i = frame->nextIndex++;
+    int itemIndent = frame->indentLevel + indentDepth;
+    if (isObject) {
+      if (i > 0) fprintf(out, "\n");
+      printIndent(out, frame->indentLevel + indentDepth); fprintf(out, "\"%s\":\n ", JSONNode_key(frame->node, i, base));
+      itemIndent = frame->indentLevel + (indentDepth * 2);
+    }
+
+    if (printNodeStart(out, itemIndent, &items[i], base)) {
+      if (depth == capacity) {
+        capacity *= 2;
+        stack = reallocarray(stack, capacity, sizeof(PrintFrame));
+      }
+      stack[depth++] = (PrintFrame) { .node = &items[i], .nextIndex = 0, .indentLevel = itemIndent };
     }
   }
+
+  free(stack);
 }
 
 char *nodeTagToString(enum JSONNode_Tag tag) {
@@ -311,50 +728,102 @@ char *nodeTagToString(enum JSONNode_Tag tag) {
   }
 }
 
+static void freeContents(JSONNode root, bool freeStrings);
+
 void JSONNode_free(JSONNode *root) {
-  _JSONNode_free(root, false);
+  freeContents(*root, true);
+  free(root);
 }
 
-void _JSONNode_free(JSONNode *ptr, bool inList) {
-  if (ptr == NULL) {
-    return;
-  }
-  JSONNode node = *ptr;
-  switch (node.tag) {
-    case JSON_NULL:
-    case JSON_NUMBER:
-    case JSON_BOOL:
-      break;
+void JSONNode_freeInSitu(JSONNode *root) {
+  freeContents(*root, false);
+  free(root);
+}
 
-    case JSON_STRING: {
-      struct JSON_STRING data = node.data.JSON_STRING;
-      char *str = data.string;
-      if (str != NULL) free(str);
-      break;
-    }
+// Frees containers from a worklist rather than recursively, so that deeply nested trees cannot
+// overflow the C stack. Containers are copied onto the worklist, since the items they are stored
+// in may be freed before they are taken off it. Keys are owned by the `InternTable` of the document.
+static void freeContents(JSONNode root, bool freeStrings) {
+  size_t capacity = PARSER_STACK_START_CAPACITY;
+  size_t pending = 0;
+  JSONNode *worklist = malloc(capacity * sizeof(JSONNode));
+  worklist[pending++] = root;
+
+  while (pending > 0) {
+    JSONNode node = worklist[--pending];
+    switch (node.tag) {
+      case JSON_STRING:
+        if (freeStrings) free(node.data.JSON_STRING.string);
+        break;
+
+      case JSON_OBJECT:
+      case JSON_LIST: {
+        JSONNode *items = node.data.JSON_LIST.items;
+        for (size_t i = 0; i < node.length; i++) {
+          if (items[i].tag == JSON_STRING && !freeStrings) {
+            continue;
+          }
+          if (items[i].tag == JSON_STRING || items[i].tag == JSON_OBJECT || items[i].tag == JSON_LIST) {
+            if (pending == capacity) {
+              capacity *= 2;
+              worklist = reallocarray(worklist, capacity, sizeof(JSONNode));
+            }
+            worklist[pending++] = items[i];
+          }
+        }
+        free(items);
+        break;
+      }
 
-    case JSON_OBJECT: {
-      struct JSON_OBJECT data = node.data.JSON_OBJECT;
-      NodeList_free(data.nodes);
-      break;
+      case JSON_NULL:
+      case JSON_NUMBER:
+      case JSON_BOOL:
+        break;
     }
+  }
 
-    case JSON_LIST: {
-      struct JSON_LIST data = node.data.JSON_LIST;
-      NodeList_free(data.nodes);
-      break;
-    }
+  free(worklist);
+}
+
+Projection Projection_new() {
+  return (Projection) {
+    .names = NULL,
+    .length = 0,
+    .capacity = 0,
+  };
+}
+
+void Projection_add(Projection *projection, char *name) {
+  if (Projection_contains(projection, name)) {
+    return;
+  }
+  if (projection->length == projection->capacity) {
+    size_t newCapacity = projection->capacity == 0 ? 8 : projection->capacity * 2;
+    projection->names = reallocarray(projection->names, newCapacity, sizeof(char*));
+    projection->capacity = newCapacity;
   }
+  projection->names[projection->length++] = name;
+}
 
-  char *name = node.fieldName;
-  if (name != NULL) {
-    free(name);
+bool Projection_containsLength(const Projection *projection, const char *name, size_t length) {
+  for (size_t i = 0; i < projection->length; i++) {
+    if (strncmp(projection->names[i], name, length) == 0 && projection->names[i][length] == '\0') {
+      return true;
+    }
   }
+  return false;
+}
 
-  // If the node is stored in a list, free(ptr) on the first element would deallocate that whole list.
-  // NodeList_free is responsible for deallocating the list as a whole for such nodes.
-  if (!inList) {
-    free(ptr);
+bool Projection_contains(const Projection *projection, char *name) {
+  for (size_t i = 0; i < projection->length; i++) {
+    if (strcmp(projection->names[i], name) == 0) {
+      return true;
+    }
   }
+  return false;
 }
 
+void Projection_free(Projection *projection) {
+  free(projection->names);
+  *projection = Projection_new();
+}
@@ -29,7 +29,7 @@ void StringBuilder_append(StringBuilder *builder, const char *format, ...) {
   size_t nbytes = vsnprintf(NULL, 0, format, args);
   size_t newLength = builder->length + nbytes;
 
-  if (builder->capacity - builder->length < newLength) {
+  while (builder->capacity < newLength) {
     StringBuilder_resize(builder);
   }
   // length - 1 to overwrite old \0, nbytes + 1 to account for new \0
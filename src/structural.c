@@ -0,0 +1,226 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __PCLMUL__
+#include <wmmintrin.h>
+#endif
+
+#include "structural.h"
+
+#define BLOCK_SIZE 64
+
+// One bit per byte of a block, lowest bit first
+typedef struct BlockMasks {
+  uint64_t quotes;
+  uint64_t backslashes;
+  uint64_t whitespace;
+  uint64_t newlines;
+  // Brackets, commas and colons
+  uint64_t operators;
+} BlockMasks;
+
+#ifdef __SSE2__
+
+static uint64_t movemask(__m128i bytes, __m128i value, int chunk) {
+  return (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, value)) << (16 * chunk);
+}
+
+static BlockMasks classifyBlock(const char *block) {
+  BlockMasks masks = { 0, 0, 0, 0, 0 };
+  for (int chunk = 0; chunk < BLOCK_SIZE / 16; chunk++) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(block + 16 * chunk));
+    // Setting bit 5 turns [ into { and ] into }, and no other byte into either
+    __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    masks.quotes |= movemask(bytes, _mm_set1_epi8('"'), chunk);
+    masks.backslashes |= movemask(bytes, _mm_set1_epi8('\\'), chunk);
+    masks.whitespace |= movemask(bytes, _mm_set1_epi8(' '), chunk) | movemask(bytes, _mm_set1_epi8('\t'), chunk)
+      | movemask(bytes, _mm_set1_epi8('\r'), chunk);
+    masks.newlines |= movemask(bytes, _mm_set1_epi8('\n'), chunk);
+    masks.operators |= movemask(folded, _mm_set1_epi8('{'), chunk) | movemask(folded, _mm_set1_epi8('}'), chunk)
+      | movemask(bytes, _mm_set1_epi8(','), chunk) | movemask(bytes, _mm_set1_epi8(':'), chunk);
+  }
+  masks.whitespace |= masks.newlines;
+  return masks;
+}
+
+#else
+
+static BlockMasks classifyBlock(const char *block) {
+  BlockMasks masks = { 0, 0, 0, 0, 0 };
+  for (int i = 0; i < BLOCK_SIZE; i++) {
+    uint64_t bit = (uint64_t)1 << i;
+    switch (block[i]) {
+      case '"':  masks.quotes |= bit;      break;
+      case '\\': masks.backslashes |= bit; break;
+      case ' ':
+      case '\t':
+      case '\r':  masks.whitespace |= bit;  break;
+      case '\n': masks.newlines |= bit;    break;
+      case '{':
+      case '}':
+      case '[':
+      case ']':
+      case ',':
+      case ':':  masks.operators |= bit;   break;
+    }
+  }
+  masks.whitespace |= masks.newlines;
+  return masks;
+}
+
+#endif
+
+// Sets every bit which has an odd number of set bits at or below it, which are the bits from an
+// opening quote up to but excluding its closing quote.
+static uint64_t prefixXor(uint64_t bits) {
+#ifdef __PCLMUL__
+  __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, bits), _mm_set1_epi8((char)0xFF), 0);
+  return (uint64_t)_mm_cvtsi128_si64(product);
+#else
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+#endif
+}
+
+// Returns the bytes which are escaped by a backslash, that is preceded by a run of backslashes of odd
+// length. `prevEscaped` carries whether the first byte of the next block is escaped.
+static uint64_t findEscaped(uint64_t backslashes, uint64_t *prevEscaped) {
+  const uint64_t evenBits = 0x5555555555555555ull;
+  backslashes &= ~*prevEscaped;
+  uint64_t followsEscape = (backslashes << 1) | *prevEscaped;
+  // Adding the start of each run to the run carries out of its end, whose parity tells the length
+  uint64_t oddStarts = backslashes & ~evenBits & ~followsEscape;
+  uint64_t evenStartsEnd;
+  *prevEscaped = __builtin_add_overflow(oddStarts, backslashes, &evenStartsEnd);
+  uint64_t invert = evenStartsEnd << 1;
+  return (evenBits ^ invert) & followsEscape;
+}
+
+// State carried from one block to the next
+typedef struct IndexCarry {
+  uint64_t prevEscaped;
+  uint64_t prevInString;
+  uint64_t prevScalar;
+} IndexCarry;
+
+// Where the tokens of a block start, as far as that depends on whether they are inside of a string
+typedef struct BlockTokens {
+  // Operators and starts of numbers and literals, which are only tokens outside of strings
+  uint64_t outside;
+  // Unescaped quotes, of which only the opening ones are tokens
+  uint64_t quotes;
+  // Bytes from an opening quote up to its closing quote, assuming the block does not start in a string
+  uint64_t inString;
+} BlockTokens;
+
+static BlockTokens findTokens(const BlockMasks *masks, IndexCarry *carry) {
+  BlockTokens tokens;
+  tokens.quotes = masks->quotes & ~findEscaped(masks->backslashes, &carry->prevEscaped);
+  tokens.inString = prefixXor(tokens.quotes) ^ carry->prevInString;
+  carry->prevInString = (uint64_t)((int64_t)tokens.inString >> 63);
+
+  uint64_t scalar = ~(masks->operators | masks->whitespace | tokens.quotes);
+  uint64_t followsScalar = (scalar << 1) | carry->prevScalar;
+  carry->prevScalar = scalar >> 63;
+  tokens.outside = masks->operators | (scalar & ~followsScalar);
+  return tokens;
+}
+
+// Finds the tokens in the `size` bytes at `start`, storing their offsets in `positions` unless it is
+// NULL, and returns their number.
+static size_t indexBlocks(IndexCarry *carry, const char *start, size_t size, uint32_t *positions) {
+  size_t count = 0;
+  char padded[BLOCK_SIZE];
+
+  for (size_t offset = 0; offset < size; offset += BLOCK_SIZE) {
+    const char *block = start + offset;
+    if (size - offset < BLOCK_SIZE) {
+      // The last block is padded with whitespace, which never starts a token
+      memset(padded, ' ', BLOCK_SIZE);
+      memcpy(padded, block, size - offset);
+      block = padded;
+    }
+
+    BlockMasks masks = classifyBlock(block);
+    BlockTokens found = findTokens(&masks, carry);
+    uint64_t tokens = (found.outside & ~found.inString) | (found.quotes & found.inString);
+    if (positions == NULL) {
+      count += __builtin_popcountll(tokens);
+      continue;
+    }
+    while (tokens != 0) {
+      positions[count++] = offset + __builtin_ctzll(tokens);
+      tokens &= tokens - 1;
+    }
+  }
+  return count;
+}
+
+StructuralIndex StructuralIndex_new() {
+  return (StructuralIndex) {
+    .start = NULL,
+    .end = NULL,
+    .positions = malloc(STRUCTURAL_WINDOW_SIZE * sizeof(uint32_t)),
+    .length = 0,
+  };
+}
+
+void StructuralIndex_build(StructuralIndex *index, const char *start, const char *inputEnd) {
+  size_t size = (size_t)(inputEnd - start) < STRUCTURAL_WINDOW_SIZE ? (size_t)(inputEnd - start) : STRUCTURAL_WINDOW_SIZE;
+  index->start = start;
+  index->end = start + size;
+
+  IndexCarry carry = { 0, 0, 0 };
+  index->length = indexBlocks(&carry, start, size, index->positions);
+}
+
+size_t StructuralIndex_count(const char *start, const char *end) {
+  IndexCarry carry = { 0, 0, 0 };
+  return indexBlocks(&carry, start, end - start, NULL);
+}
+
+StructuralChunk StructuralIndex_summarize(const char *start, const char *end) {
+  StructuralChunk summary = { .tokens = { 0, 0 }, .flipsString = false, .firstQuote = NULL, .newlines = 0, .lastNewline = NULL };
+  IndexCarry carry = { 0, 0, 0 };
+  size_t size = end - start;
+  char padded[BLOCK_SIZE];
+
+  for (size_t offset = 0; offset < size; offset += BLOCK_SIZE) {
+    const char *block = start + offset;
+    if (size - offset < BLOCK_SIZE) {
+      memset(padded, ' ', BLOCK_SIZE);
+      memcpy(padded, block, size - offset);
+      block = padded;
+    }
+
+    BlockMasks masks = classifyBlock(block);
+    BlockTokens found = findTokens(&masks, &carry);
+    // Starting inside of a string inverts which bytes are inside of one
+    summary.tokens[0] += __builtin_popcountll((found.outside & ~found.inString) | (found.quotes & found.inString));
+    summary.tokens[1] += __builtin_popcountll((found.outside & found.inString) | (found.quotes & ~found.inString));
+    if (summary.firstQuote == NULL && found.quotes != 0) {
+      summary.firstQuote = start + offset + __builtin_ctzll(found.quotes);
+    }
+    if (masks.newlines != 0) {
+      summary.newlines += __builtin_popcountll(masks.newlines);
+      summary.lastNewline = start + offset + 63 - __builtin_clzll(masks.newlines);
+    }
+  }
+  summary.flipsString = carry.prevInString != 0;
+  return summary;
+}
+
+void StructuralIndex_free(StructuralIndex *index) {
+  free(index->positions);
+  index->positions = NULL;
+  index->length = 0;
+}
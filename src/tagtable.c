@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "interntable.h"
+#include "tagtable.h"
+
+// Returns the slot holding the case for `tag`, or the empty slot where it would be inserted.
+static int *findSlot(const TagTable *table, const char *tag, uint32_t hash) {
+  int mask = table->capacity - 1;
+  int i = hash & mask;
+  while (table->slots[i] != -1) {
+    int index = table->slots[i];
+    if (table->hashes[index] == hash && strcmp(table->cases[index].tag, tag) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return &table->slots[i];
+}
+
+TagTable *TagTable_new(int count, const TagCase *cases) {
+  TagTable *table = malloc(sizeof(TagTable));
+  table->count = count;
+  table->cases = malloc(count * sizeof(TagCase));
+  table->hashes = malloc(count * sizeof(uint32_t));
+
+  // At most half full, so that probe sequences stay short
+  table->capacity = 2;
+  while (table->capacity < 2 * count) {
+    table->capacity *= 2;
+  }
+  table->slots = malloc(table->capacity * sizeof(int));
+  for (int i = 0; i < table->capacity; i++) {
+    table->slots[i] = -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    table->cases[i] = cases[i];
+    table->hashes[i] = InternTable_hash(cases[i].tag, strlen(cases[i].tag));
+    *findSlot(table, cases[i].tag, table->hashes[i]) = i;
+  }
+  return table;
+}
+
+int TagTable_find(const TagTable *table, const char *tag) {
+  return *findSlot(table, tag, InternTable_hash(tag, strlen(tag)));
+}
+
+void TagTable_free(TagTable *table) {
+  free(table->cases);
+  free(table->hashes);
+  free(table->slots);
+  free(table);
+}
@@ -1,16 +1,32 @@
 #include "lexer.h"
 #include <stdlib.h>
 
+TokenList TokenList_new(size_t capacity, bool borrowsStrings) {
+  return (TokenList) {
+    .length = 0,
+    .capacity = capacity,
+    .tokens = malloc(capacity * sizeof(Token)),
+    .borrowsStrings = borrowsStrings,
+  };
+}
+
 void TokenList_resize(TokenList *list) {
-  int newCapacity = list->capacity * 2;
+  size_t newCapacity = list->capacity * 2;
   Token *newItems = reallocarray(list->tokens, newCapacity, sizeof(Token));
   list->tokens = newItems;
   list->capacity = newCapacity;
 }
 
+void TokenList_reserve(TokenList *list, size_t capacity) {
+  if (capacity > list->capacity) {
+    list->tokens = reallocarray(list->tokens, capacity, sizeof(Token));
+    list->capacity = capacity;
+  }
+}
+
 struct Token *TokenList_insertNew(TokenList *list) {
-  int oldLength = list->length;
-  int newLength = oldLength + 1;
+  size_t oldLength = list->length;
+  size_t newLength = oldLength + 1;
   if (newLength > list->capacity) {
     TokenList_resize(list);
   }
@@ -19,12 +35,12 @@ struct Token *TokenList_insertNew(TokenList *list) {
 }
 
 void TokenList_free(TokenList *list) {
-  for (int i = 0; i < list->length; i++) {
+  for (size_t i = 0; i < list->length; i++) {
     struct Token token = list->tokens[i];
     switch (token.tokenType) {
       case TOKEN_STRING_LITERAL: {
         char *str = token.data.TOKEN_STRING_LITERAL.string;
-        free(str);
+        if (!list->borrowsStrings) free(str);
         break;
       }
 
@@ -43,3 +59,12 @@ void TokenList_free(TokenList *list) {
   free(list->tokens);
 }
 
+void TokenList_clear(TokenList *list) {
+  for (size_t i = 0; i < list->length && !list->borrowsStrings; i++) {
+    if (list->tokens[i].tokenType == TOKEN_STRING_LITERAL) {
+      free(list->tokens[i].data.TOKEN_STRING_LITERAL.string);
+    }
+  }
+  list->length = 0;
+}
+
@@ -0,0 +1,137 @@
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "unicode.h"
+
+// The bulk loops below only ever load whole aligned blocks. Such a load never crosses a page
+// boundary, so it may safely read past the terminating NUL, which itself always ends the run.
+// Those bytes are still outside of the allocation as far as the sanitizers are concerned.
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#elif defined(__SANITIZE_ADDRESS__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#ifndef NO_SANITIZE_ADDRESS
+#define NO_SANITIZE_ADDRESS
+#endif
+
+#ifdef __SSE2__
+
+NO_SANITIZE_ADDRESS size_t Unicode_plainAsciiLength(const char *str) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  // A signed comparison with 0x20 catches both control characters and bytes >= 0x80
+  const __m128i space = _mm_set1_epi8(0x20);
+
+  size_t misalignment = (uintptr_t)str & 15;
+  const char *block = str - misalignment;
+  unsigned int ignored = (1u << misalignment) - 1;
+
+  for (;;) {
+    __m128i bytes = _mm_load_si128((const __m128i*)block);
+    __m128i special = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash)),
+      _mm_cmplt_epi8(bytes, space)
+    );
+    unsigned int mask = _mm_movemask_epi8(special) & ~ignored;
+    if (mask != 0) {
+      return (block + __builtin_ctz(mask)) - str;
+    }
+    block += 16;
+    ignored = 0;
+  }
+}
+
+#else
+
+static bool isPlainAscii(unsigned char c) {
+  return c >= 0x20 && c < 0x80 && c != '"' && c != '\\';
+}
+
+typedef unsigned long Word;
+
+#define ONES ((Word)-1 / 0xFF)
+#define HIGHS (ONES * 0x80)
+// Nonzero if any byte of `x` is zero, or less than `n` respectively. May flag bytes above the first
+// matching one, but never misses a match, so it is only used to skip words entirely.
+#define HAS_ZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+#define HAS_LESS(x, n) (((x) - ONES * (n)) & ~(x) & HIGHS)
+
+NO_SANITIZE_ADDRESS size_t Unicode_plainAsciiLength(const char *str) {
+  const char *pos = str;
+  while ((uintptr_t)pos % sizeof(Word) != 0) {
+    if (!isPlainAscii(*pos)) return pos - str;
+    pos++;
+  }
+
+  for (;;) {
+    Word word = *(const Word*)pos;
+    if (((word & HIGHS) | HAS_LESS(word, 0x20) | HAS_ZERO(word ^ (ONES * '"')) | HAS_ZERO(word ^ (ONES * '\\'))) != 0) {
+      break;
+    }
+    pos += sizeof(Word);
+  }
+
+  while (isPlainAscii(*pos)) {
+    pos++;
+  }
+  return pos - str;
+}
+
+#endif
+
+int Unicode_utf8SequenceLength(const char *str) {
+  const unsigned char *s = (const unsigned char*)str;
+  #define CONTINUATION(c) (((c) & 0xC0) == 0x80)
+
+  if (s[0] < 0x80) {
+    return 1;
+  }
+  if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+    return CONTINUATION(s[1]) ? 2 : 0;
+  }
+  if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+    // Excludes overlong encodings (E0 80..9F) and surrogates (ED A0..BF)
+    unsigned char min = s[0] == 0xE0 ? 0xA0 : 0x80;
+    unsigned char max = s[0] == 0xED ? 0x9F : 0xBF;
+    return s[1] >= min && s[1] <= max && CONTINUATION(s[2]) ? 3 : 0;
+  }
+  if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+    // Excludes overlong encodings (F0 80..8F) and code points above U+10FFFF (F4 90..BF)
+    unsigned char min = s[0] == 0xF0 ? 0x90 : 0x80;
+    unsigned char max = s[0] == 0xF4 ? 0x8F : 0xBF;
+    return s[1] >= min && s[1] <= max && CONTINUATION(s[2]) && CONTINUATION(s[3]) ? 4 : 0;
+  }
+  return 0;
+
+  #undef CONTINUATION
+}
+
+int Unicode_encodeUtf8(uint32_t codepoint, char *dest) {
+  if (codepoint < 0x80) {
+    dest[0] = codepoint;
+    return 1;
+  }
+  if (codepoint < 0x800) {
+    dest[0] = 0xC0 | (codepoint >> 6);
+    dest[1] = 0x80 | (codepoint & 0x3F);
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    dest[0] = 0xE0 | (codepoint >> 12);
+    dest[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+    dest[2] = 0x80 | (codepoint & 0x3F);
+    return 3;
+  }
+  dest[0] = 0xF0 | (codepoint >> 18);
+  dest[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+  dest[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+  dest[3] = 0x80 | (codepoint & 0x3F);
+  return 4;
+}
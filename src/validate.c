@@ -0,0 +1,465 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "unicode.h"
+#include "validate.h"
+
+#define MAX_MESSAGE_SIZE 128
+
+// A list or object which is open, with its elements found so far
+typedef struct OpenContainer {
+  const char *start;
+  size_t length;
+} OpenContainer;
+
+typedef struct Validator {
+  const char *start;
+  const char *pos;
+  const char *end;
+  // Where the error is reported, whose row and column are only worked out once validation has failed
+  const char *errorPos;
+  char errorMsg[MAX_MESSAGE_SIZE];
+  ParseLimits limits;
+  size_t nodes;
+  // Points to `inlineStack` until it is full, and to the heap after that
+  OpenContainer *stack;
+  size_t depth;
+  size_t stackCapacity;
+  OpenContainer inlineStack[VALIDATE_STACK_SIZE];
+} Validator;
+
+#define FAIL(validator, at, args...) do {\
+  (validator)->errorPos = (at);\
+  snprintf((validator)->errorMsg, MAX_MESSAGE_SIZE, args);\
+  return false;\
+} while(0)
+
+#define TRY(cmd) do {\
+  if (!cmd) return false;\
+} while(0)
+
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool isPlainAscii(unsigned char c) {
+  return c >= 0x20 && c < 0x80 && c != '"' && c != '\\';
+}
+
+static const char *skipWhitespace(const char *pos, const char *end) {
+  while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\t' || *pos == '\r')) {
+    pos++;
+  }
+  return pos;
+}
+
+// Same as `Unicode_plainAsciiLength`, but stops at `end` instead of a NUL, so it never reads past it
+static size_t plainRun(const char *pos, const char *end) {
+  const char *start = pos;
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+  while (end - pos >= 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)pos);
+    __m128i special = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash)),
+      _mm_cmplt_epi8(bytes, space)
+    );
+    unsigned int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      return (pos + __builtin_ctz(mask)) - start;
+    }
+    pos += 16;
+  }
+#endif
+  while (pos < end && isPlainAscii(*pos)) {
+    pos++;
+  }
+  return pos - start;
+}
+
+static int utf8Length(const char *pos, const char *end) {
+  if (end - pos >= UNICODE_MAX_UTF8_LENGTH) {
+    return Unicode_utf8SequenceLength(pos);
+  }
+  // Padding with NULs, which are never continuation bytes, cuts off sequences at the end of the input
+  char padded[UNICODE_MAX_UTF8_LENGTH] = { 0 };
+  memcpy(padded, pos, end - pos);
+  return Unicode_utf8SequenceLength(padded);
+}
+
+static long readHex4(const char *pos, const char *end) {
+  if (end - pos < 4) {
+    return -1;
+  }
+  long value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = pos[i];
+    int digit = isDigit(c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+    if (digit < 0) return -1;
+    value = (value << 4) | digit;
+  }
+  return value;
+}
+
+// Returns the length of the escape sequence at `pos`, which starts with a backslash, 0 if it is invalid,
+// or -1 if it is \u0000. Accepts the same escapes as the lexer, including its check of surrogate pairs.
+static int escapeLength(const char *pos, const char *end) {
+  if (end - pos < 2) {
+    return 0;
+  }
+  switch (pos[1]) {
+    case '"':
+    case '\\':
+    case '/':
+    case 'b':
+    case 'f':
+    case 'n':
+    case 'r':
+    case 't':
+      return 2;
+
+    case 'u': {
+      long codepoint = readHex4(pos + 2, end);
+      if (codepoint < 0 || (codepoint >= 0xDC00 && codepoint <= 0xDFFF)) {
+        return 0;
+      }
+      if (codepoint == 0) {
+        return -1;
+      }
+      if (codepoint < 0xD800 || codepoint > 0xDBFF) {
+        return 6;
+      }
+      if (end - pos < 8 || pos[6] != '\\' || pos[7] != 'u') return 0;
+      long low = readHex4(pos + 8, end);
+      return low >= 0xDC00 && low <= 0xDFFF ? 12 : 0;
+    }
+
+    default:
+      return 0;
+  }
+}
+
+// Returns how many bytes the valid escape sequence of `length` bytes at `pos` takes once unescaped
+static int unescapedLength(const char *pos, int length) {
+  if (length == 2) {
+    return 1;
+  } else if (length == 12) {
+    return 4;
+  }
+  long codepoint = readHex4(pos + 2, pos + 6);
+  return codepoint < 0x80 ? 1 : codepoint < 0x800 ? 2 : 3;
+}
+
+// The length is that of the unescaped string, as `lex` measures it, and is checked as the string is scanned
+static bool validateString(Validator *v) {
+  const char *quote = v->pos;
+  const char *pos = quote + 1;
+  const char *end = v->end;
+  size_t maxLength = v->limits.maxStringLength;
+  // Bytes by which the escapes seen so far shrink once unescaped
+  size_t saved = 0;
+
+  for (;;) {
+    pos += plainRun(pos, end);
+    if (maxLength > 0 && (size_t)(pos - quote - 1) - saved > maxLength) {
+      FAIL(v, quote, "String longer than the maximum of %zu bytes", maxLength);
+    }
+    if (pos >= end) {
+      FAIL(v, quote, "Unterminated string literal");
+    }
+
+    unsigned char c = *pos;
+    if (c == '"') {
+      break;
+    } else if (c == '\\') {
+      int length = escapeLength(pos, end);
+      if (length == 0) {
+        FAIL(v, pos, "Invalid escape sequence");
+      } else if (length < 0) {
+        FAIL(v, pos, "Escaped NUL character in string literal");
+      }
+      saved += length - unescapedLength(pos, length);
+      pos += length;
+    } else if (c == '\n') {
+      FAIL(v, quote, "Unterminated string literal");
+    } else if (c < 0x20) {
+      FAIL(v, pos, "Unescaped control character in string literal");
+    } else {
+      int length = utf8Length(pos, end);
+      if (length == 0) {
+        FAIL(v, pos, "Invalid UTF-8 in string literal");
+      }
+      pos += length;
+    }
+  }
+
+  v->pos = pos + 1;
+  return true;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool validateNumber(Validator *v) {
+  const char *pos = v->pos;
+  const char *end = v->end;
+
+  if (*pos == '-') {
+    pos++;
+  }
+  if (pos < end && *pos == '0') {
+    pos++;
+  } else if (pos < end && isDigit(*pos)) {
+    while (pos < end && isDigit(*pos)) pos++;
+  } else {
+    FAIL(v, v->pos, "Invalid number");
+  }
+
+  if (pos < end && *pos == '.') {
+    pos++;
+    if (pos >= end || !isDigit(*pos)) {
+      FAIL(v, v->pos, "Invalid number");
+    }
+    while (pos < end && isDigit(*pos)) pos++;
+  }
+
+  if (pos < end && (*pos == 'e' || *pos == 'E')) {
+    pos++;
+    if (pos < end && (*pos == '+' || *pos == '-')) {
+      pos++;
+    }
+    if (pos >= end || !isDigit(*pos)) {
+      FAIL(v, v->pos, "Invalid number");
+    }
+    while (pos < end && isDigit(*pos)) pos++;
+  }
+
+  v->pos = pos;
+  return true;
+}
+
+static bool validateWord(Validator *v, const char *word) {
+  size_t length = strlen(word);
+  if ((size_t)(v->end - v->pos) < length || memcmp(v->pos, word, length) != 0) {
+    FAIL(v, v->pos, "Expected \"%s\"", word);
+  }
+  v->pos += length;
+  return true;
+}
+
+// Counts the value starting at `v->pos` against `maxNodes`, as the lexer does
+static bool countValue(Validator *v) {
+  if (v->limits.maxNodes > 0 && ++v->nodes > v->limits.maxNodes) {
+    FAIL(v, v->pos, "More than the maximum of %zu values", v->limits.maxNodes);
+  }
+  return true;
+}
+
+// Counts an element of the innermost container, which is reported where that container starts like the
+// parser does
+static bool countElement(Validator *v) {
+  OpenContainer *container = &v->stack[v->depth - 1];
+  size_t maxLength = v->limits.maxContainerLength;
+  if (maxLength > 0 && ++container->length > maxLength) {
+    FAIL(v, container->start, "More than the maximum of %zu elements in %s", maxLength,
+         *container->start == '{' ? "object" : "list");
+  }
+  return true;
+}
+
+static bool openContainer(Validator *v) {
+  size_t maxDepth = v->limits.maxDepth;
+  if (maxDepth > 0 && v->depth >= maxDepth) {
+    FAIL(v, v->pos, "Maximum nesting depth of %zu exceeded", maxDepth);
+  }
+  if (v->depth == v->stackCapacity) {
+    size_t capacity = v->stackCapacity * 2;
+    if (v->stack == v->inlineStack) {
+      v->stack = malloc(capacity * sizeof(OpenContainer));
+      memcpy(v->stack, v->inlineStack, sizeof(v->inlineStack));
+    } else {
+      v->stack = reallocarray(v->stack, capacity, sizeof(OpenContainer));
+    }
+    v->stackCapacity = capacity;
+  }
+  v->stack[v->depth++] = (OpenContainer) { .start = v->pos, .length = 0 };
+  return true;
+}
+
+// Validates `"key":` up to the value of an object member. Like the lexer, the key counts as a value until
+// its colon is found.
+static bool validateKey(Validator *v) {
+  v->pos = skipWhitespace(v->pos, v->end);
+  if (v->pos >= v->end) {
+    FAIL(v, v->pos, "Unexpected end of input, expecting string literal");
+  }
+  if (*v->pos != '"') {
+    FAIL(v, v->pos, "Expecting string literal");
+  }
+  if (v->limits.maxNodes > 0 && v->nodes >= v->limits.maxNodes) {
+    FAIL(v, v->pos, "More than the maximum of %zu values", v->limits.maxNodes);
+  }
+  TRY(validateString(v));
+
+  v->pos = skipWhitespace(v->pos, v->end);
+  if (v->pos >= v->end || *v->pos != ':') {
+    FAIL(v, v->pos, "Expecting :");
+  }
+  v->pos++;
+  return true;
+}
+
+// Iterative like the parser, alternating between expecting a value and closing the containers which end
+// after it. Elements are counted as they start, right after the opening bracket or a comma.
+static bool validateDocument(Validator *v, bool allowTrailingCommas) {
+  const char *end = v->end;
+
+  for (;;) {
+    v->pos = skipWhitespace(v->pos, end);
+    if (v->pos >= end) {
+      FAIL(v, v->pos, "Unexpected end of input, expecting value");
+    }
+
+    char c = *v->pos;
+    switch (c) {
+      case '{':
+      case '[': {
+        TRY(openContainer(v));
+        TRY(countValue(v));
+
+        char close = c == '{' ? '}' : ']';
+        v->pos = skipWhitespace(v->pos + 1, end);
+        if (v->pos < end && *v->pos == close) {
+          v->pos++;
+          v->depth--;
+          break;
+        }
+        TRY(countElement(v));
+        if (c == '{') {
+          TRY(validateKey(v));
+        }
+        continue;
+      }
+
+      case '"':
+        TRY(countValue(v));
+        TRY(validateString(v));
+        break;
+
+      case 't':
+        TRY(countValue(v));
+        TRY(validateWord(v, "true"));
+        break;
+
+      case 'f':
+        TRY(countValue(v));
+        TRY(validateWord(v, "false"));
+        break;
+
+      case 'n':
+        TRY(countValue(v));
+        TRY(validateWord(v, "null"));
+        break;
+
+      default:
+        if (c != '-' && !isDigit(c)) {
+          FAIL(v, v->pos, "Unexpected character '%c'", c);
+        }
+        TRY(countValue(v));
+        TRY(validateNumber(v));
+        break;
+    }
+
+    // Close every container that ends here, until we either find the next value or run out of containers
+    for (;;) {
+      v->pos = skipWhitespace(v->pos, end);
+      if (v->depth == 0) {
+        if (v->pos < end) {
+          FAIL(v, v->pos, "Trailing characters after the value");
+        }
+        return true;
+      }
+
+      bool isObject = *v->stack[v->depth - 1].start == '{';
+      char close = isObject ? '}' : ']';
+      if (v->pos >= end) {
+        FAIL(v, v->pos, "Unexpected end of input, expecting , or %c", close);
+      }
+      if (*v->pos == close) {
+        v->pos++;
+        v->depth--;
+        continue;
+      }
+      if (*v->pos != ',') {
+        FAIL(v, v->pos, "Expecting , or %c", close);
+      }
+
+      const char *comma = v->pos;
+      v->pos = skipWhitespace(v->pos + 1, end);
+      if (v->pos < end && *v->pos == close) {
+        if (!allowTrailingCommas) {
+          FAIL(v, comma, "Trailing comma");
+        }
+        v->pos++;
+        v->depth--;
+        continue;
+      }
+      TRY(countElement(v));
+      if (isObject) {
+        TRY(validateKey(v));
+      }
+      break;
+    }
+  }
+}
+
+ValidateResult validate(const char *input, size_t length, const ParseLimits *limits, bool allowTrailingCommas) {
+  Validator v = {
+    .start = input,
+    .pos = input,
+    .end = input + length,
+    .errorPos = NULL,
+    .errorMsg = "",
+    .limits = limits != NULL ? *limits : (ParseLimits) { 0 },
+    .nodes = 0,
+    .stack = NULL,
+    .depth = 0,
+    .stackCapacity = VALIDATE_STACK_SIZE,
+  };
+  v.stack = v.inlineStack;
+  ValidateResult result = { .valid = true, .offset = 0, .row = 0, .col = 0, .errorMsg = "" };
+
+  size_t maxLength = v.limits.maxInputBytes;
+  bool valid = false;
+  if (maxLength > 0 && length > maxLength) {
+    v.errorPos = input + maxLength;
+    snprintf(v.errorMsg, MAX_MESSAGE_SIZE, "Input is longer than the maximum of %zu bytes", maxLength);
+  } else {
+    valid = validateDocument(&v, allowTrailingCommas);
+  }
+  if (v.stack != v.inlineStack) {
+    free(v.stack);
+  }
+  if (valid) {
+    return result;
+  }
+
+  result.valid = false;
+  result.offset = v.errorPos - input;
+  result.row = 1;
+  const char *lineStart = input;
+  const char *newline;
+  while ((newline = memchr(lineStart, '\n', v.errorPos - lineStart)) != NULL) {
+    result.row++;
+    lineStart = newline + 1;
+  }
+  result.col = v.errorPos - lineStart + 1;
+  snprintf(result.errorMsg, MAX_ERR_SIZE, "%s at %zu:%zu", v.errorMsg, result.row, result.col);
+  return result;
+}